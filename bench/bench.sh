@@ -0,0 +1,92 @@
+#!/bin/sh
+#
+# Run swmbench against spectrwm on a private Xvfb server.
+#
+# usage: bench.sh spectrwm swmbench output [counts]
+#
+# Results are appended to output as JSON lines, labelled with the spectrwm
+# version; spectrwm's own handler statistics (SIGUSR1) go to output.log.
+# The exit status is non-zero if any rtt_budget in bench.conf was exceeded or
+# the autorun check (swmbench -a) failed.
+
+[ $# -lt 3 ] && { echo "usage: $0 spectrwm swmbench output [counts]" >&2; exit 1; }
+
+SPECTRWM=$(readlink -f "$1")
+SWMBENCH=$(readlink -f "$2")
+OUT=$(readlink -f "$3")
+COUNTS=${4:-10,100,1000}
+BENCHDIR=$(dirname "$(readlink -f "$0")")
+
+command -v Xvfb >/dev/null || { echo "$0: Xvfb not found" >&2; exit 1; }
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/swmbench.XXXXXX")
+cp "$BENCHDIR/bench.conf" "$WORK/.spectrwm.conf"
+# A client with no _NET_WM_PID that autorun must still place on ws 2.
+echo "autorun = ws[2]:$SWMBENCH -a 1 -o $WORK/autorun.json" \
+    >>"$WORK/.spectrwm.conf"
+
+cleanup() {
+	[ -n "$WMPID" ] && kill "$WMPID" 2>/dev/null
+	[ -n "$XPID" ] && kill "$XPID" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+# Let Xvfb pick a free display number.
+Xvfb -displayfd 3 -screen 0 1920x1080x24 -nolisten tcp 3>"$WORK/display" \
+    2>"$WORK/xvfb.log" &
+XPID=$!
+i=0
+while [ ! -s "$WORK/display" ]; do
+	i=$((i + 1))
+	[ $i -gt 50 ] && { echo "$0: Xvfb did not start" >&2; exit 1; }
+	sleep 0.1
+done
+DISPLAY=:$(cat "$WORK/display")
+export DISPLAY
+
+HOME="$WORK" "$SPECTRWM" 2>"$OUT.log" &
+WMPID=$!
+i=0
+while [ ! -S "$WORK/ctl.sock" ]; do
+	i=$((i + 1))
+	[ $i -gt 50 ] && { echo "$0: spectrwm did not start" >&2; exit 1; }
+	sleep 0.1
+done
+
+# "Welcome to spectrwm V<version> Build: <build>"
+LABEL=$(sed -n 's/.*spectrwm V\([^ ]*\) Build: \(.*\)/\1 \2/p' "$OUT.log" |
+    head -n 1)
+
+# swmbench -a gives up after 10s on its own.
+i=0
+while [ ! -s "$WORK/autorun.json" ] && [ $i -lt 120 ]; do
+	i=$((i + 1))
+	sleep 0.1
+done
+AUTORUN_RC=0
+if ! grep -q '"expected_ws":\([0-9]*\),"ws":\1}' "$WORK/autorun.json" \
+    2>/dev/null; then
+	echo "$0: autorun did not place its window:" >&2
+	cat "$WORK/autorun.json" >&2 2>/dev/null
+	AUTORUN_RC=1
+fi
+sed "s/\"label\":\"\"/\"label\":\"${LABEL:-unknown}\"/" \
+    "$WORK/autorun.json" >>"$OUT" 2>/dev/null
+
+"$SWMBENCH" -s "$WORK/ctl.sock" -n "$COUNTS" -l "${LABEL:-unknown}" -o "$OUT"
+RC=$?
+[ $AUTORUN_RC -ne 0 ] && RC=1
+
+kill -USR1 "$WMPID"
+sleep 0.5
+
+# See rtt_budget in bench.conf.
+if grep -q 'round trips, budget' "$OUT.log"; then
+	echo "$0: round trip budget exceeded:" >&2
+	grep 'round trips, budget' "$OUT.log" >&2
+	RC=1
+fi
+
+exit $RC
@@ -0,0 +1,103 @@
+#!/bin/sh
+#
+# Time screen changes, from the xrandr call until spectrwm has laid the
+# windows out again, on a private Xvfb server.
+#
+# usage: hotplug.sh swmbench output spectrwm [spectrwm ...]
+#
+# Each spectrwm given (e.g. builds before and after a change to the RandR
+# code) gets a fresh server and is labelled with its path and version.  The
+# screen is switched back and forth between 1920x1080 and 1280x720 with
+# swmbench -x, whose hotplug and hotplug_cmd results are appended to output as
+# JSON lines.  spectrwm's own scan_randr and screenchange timings (SIGUSR1),
+# where the build has them, are appended to output.log.
+
+[ $# -lt 3 ] && {
+	echo "usage: $0 swmbench output spectrwm [spectrwm ...]" >&2
+	exit 1
+}
+
+SWMBENCH=$(readlink -f "$1")
+OUT=$(readlink -f "$2")
+shift 2
+COUNTS=${HOTPLUG_COUNTS:-10,100}
+ITERATIONS=${HOTPLUG_ITERATIONS:-20}
+BENCHDIR=$(dirname "$(readlink -f "$0")")
+
+command -v Xvfb >/dev/null || { echo "$0: Xvfb not found" >&2; exit 1; }
+command -v xrandr >/dev/null || { echo "$0: xrandr not found" >&2; exit 1; }
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/swmhotplug.XXXXXX")
+
+stop() {
+	[ -n "$WMPID" ] && kill "$WMPID" 2>/dev/null
+	[ -n "$XPID" ] && kill "$XPID" 2>/dev/null
+	wait 2>/dev/null
+	WMPID=
+	XPID=
+}
+
+cleanup() {
+	stop
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+RC=0
+for WM in "$@"; do
+	SPECTRWM=$(readlink -f "$WM")
+	rm -f "$WORK/display" "$WORK/ctl.sock"
+	cp "$BENCHDIR/bench.conf" "$WORK/.spectrwm.conf"
+
+	# Let Xvfb pick a free display number.
+	Xvfb -displayfd 3 -screen 0 1920x1080x24 -nolisten tcp \
+	    3>"$WORK/display" 2>"$WORK/xvfb.log" &
+	XPID=$!
+	i=0
+	while [ ! -s "$WORK/display" ]; do
+		i=$((i + 1))
+		[ $i -gt 50 ] && { echo "$0: Xvfb did not start" >&2; exit 1; }
+		sleep 0.1
+	done
+	DISPLAY=:$(cat "$WORK/display")
+	export DISPLAY
+
+	# Xvfb only knows the mode it started with; add a smaller one.
+	OUTPUT=$(xrandr | awk '/ connected/ { print $1; exit }')
+	MODE=$(xrandr | awk '/\*/ { print $1; exit }')
+	xrandr --newmode swmbench 74.25 1280 1390 1430 1650 720 725 730 750 \
+	    +hsync +vsync &&
+	    xrandr --addmode "$OUTPUT" swmbench ||
+	    { echo "$0: can not add a mode to $OUTPUT" >&2; exit 1; }
+
+	HOME="$WORK" "$SPECTRWM" 2>"$WORK/spectrwm.log" &
+	WMPID=$!
+	i=0
+	while [ ! -S "$WORK/ctl.sock" ]; do
+		i=$((i + 1))
+		[ $i -gt 50 ] &&
+		    { echo "$0: $WM did not start" >&2; exit 1; }
+		sleep 0.1
+	done
+
+	# "Welcome to spectrwm V<version> Build: <build>"
+	LABEL="$WM $(sed -n 's/.*spectrwm V\([^ ]*\) Build: \(.*\)/\1 \2/p' \
+	    "$WORK/spectrwm.log" | head -n 1)"
+
+	"$SWMBENCH" -s "$WORK/ctl.sock" -n "$COUNTS" -i "$ITERATIONS" \
+	    -l "$LABEL" -o "$OUT" \
+	    -x "xrandr --output $OUTPUT --mode swmbench --fb 1280x720" \
+	    -x "xrandr --output $OUTPUT --mode $MODE --fb 1920x1080" ||
+	    RC=1
+
+	kill -USR1 "$WMPID"
+	sleep 0.5
+	{
+		echo "=== $LABEL"
+		grep -E '^(scan_randr|screenchange) ' "$WORK/spectrwm.log"
+	} >>"$OUT.log"
+
+	stop
+done
+
+exit $RC
@@ -0,0 +1,77 @@
+#!/bin/sh
+#
+# Compare two workload.sh runs, e.g. a plain and a profile-guided build.
+#
+# usage: pgo-report.sh before after
+#
+# Prints spectrwm's CPU time and handler time, then the median and 95th
+# percentile latency of each swmstorm and swmbench measurement, with the
+# change in percent.  Lower is better throughout.
+
+[ $# -ne 2 ] && { echo "usage: $0 before after" >&2; exit 1; }
+
+for f in "$1" "$2"; do
+	[ -r "$f" ] || { echo "$0: $f: not readable" >&2; exit 1; }
+done
+
+# Flatten both runs to "key value" lines, then join them.
+flatten() {
+	[ -r "$1.cpu" ] && printf 'cpu_ticks %s\n' "$(cat "$1.cpu")"
+	[ -r "$1.prom" ] && awk '
+	    /^spectrwm_event_seconds_total/ { ev += $2 }
+	    /^spectrwm_round_trips_total/ { print "round_trips", $2 }
+	    END { printf "handler_ms %.0f\n", ev * 1000 }' "$1.prom"
+	awk '
+	function field(name,	s) {
+		if (!match($0, "\"" name "\":[^,}]*"))
+			return "";
+		s = substr($0, RSTART, RLENGTH);
+		sub(/.*:/, "", s);
+		gsub(/"/, "", s);
+		return s;
+	}
+	function lat(name,	s, p50, p95) {
+		if (!match($0, "\"" name "\":\\{[^}]*\\}"))
+			return;
+		s = substr($0, RSTART, RLENGTH);
+		p50 = s; sub(/.*"p50_us":/, "", p50); sub(/[,}].*/, "", p50);
+		p95 = s; sub(/.*"p95_us":/, "", p95); sub(/[,}].*/, "", p95);
+		if (s ~ /p50_us/) {
+			print "storm_" name "_p50_us", p50;
+			print "storm_" name "_p95_us", p95;
+		}
+	}
+	/"duration_s"/ {
+		lat("manage");
+		lat("unmanage");
+		print "storm_drain_ms", field("drain_ms");
+		next;
+	}
+	/"metric"/ && field("p50_us") != "" {
+		k = field("metric") "_" field("windows");
+		print k "_p50_us", field("p50_us");
+		print k "_p95_us", field("p95_us");
+	}' "$1"
+}
+
+flatten "$1" >"${TMPDIR:-/tmp}/pgo-before.$$"
+flatten "$2" >"${TMPDIR:-/tmp}/pgo-after.$$"
+trap 'rm -f "${TMPDIR:-/tmp}/pgo-before.$$" "${TMPDIR:-/tmp}/pgo-after.$$"' EXIT
+
+awk -v before="$1" -v after="$2" '
+NR == FNR { b[$1] = $2; order[++n] = $1; next }
+{ a[$1] = $2 }
+END {
+	printf "%-28s %12s %12s %8s\n", "", "before", "after", "change";
+	for (i = 1; i <= n; i++) {
+		k = order[i];
+		if (!(k in a))
+			continue;
+		if (b[k] > 0)
+			printf "%-28s %12s %12s %+7.1f%%\n", k, b[k], a[k],
+			    (a[k] - b[k]) * 100 / b[k];
+		else
+			printf "%-28s %12s %12s %8s\n", k, b[k], a[k], "-";
+	}
+	printf "\nbefore: %s\nafter:  %s\n", before, after;
+}' "${TMPDIR:-/tmp}/pgo-before.$$" "${TMPDIR:-/tmp}/pgo-after.$$"
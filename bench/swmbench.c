@@ -0,0 +1,575 @@
+/*
+ * swmbench - measure spectrwm hot paths from the outside.
+ *
+ * Runs against a spectrwm with a control_socket (see bench.sh, which starts
+ * one on Xvfb) and for each window count reports:
+ *
+ *	map		XMapWindow until the client sees its MapNotify
+ *	switchws	ws_2 / ws_1 until all windows are unmapped / mapped
+ *	focus		focus_next until the client sees FocusIn
+ *	stack		master_grow / master_shrink until the command is answered
+ *	bar		bar_toggle until the command is answered
+ *
+ * Results are written as one JSON object per line.
+ *
+ * With -x, swmbench instead measures how long a screen change takes to reach
+ * the windows: it maps each count of windows, then runs the -x commands in
+ * turn (e.g. xrandr calls, see hotplug.sh) and reports
+ *
+ *	hotplug		command start until every window was resized
+ *	hotplug_cmd	command start until the command exited
+ *
+ * so that the cost of running the command itself can be told apart.
+ *
+ * With -a, swmbench instead checks that an autorun entry claims its window:
+ * started as "autorun = ws[n]:swmbench -a n-1 ...", it maps a window that
+ * sets no _NET_WM_PID and, being plain xcb, gets no _SWM_PID from libswmhack
+ * either, so spectrwm can only place it by asking X-Resource for the pid.
+ * The exit status is non-zero unless the window lands on workspace n.
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <err.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <xcb/xcb.h>
+
+#define SWMB_TIMEOUT_MS		(10000)
+#define SWMB_LINELEN		(256)
+#define SWMB_HOTPLUG_CMDS	(8)
+
+xcb_connection_t	*conn;
+xcb_screen_t		*screen;
+int			ctl = -1;
+FILE			*out;
+const char		*label = "";
+
+uint64_t		*samples;
+size_t			nsamples, samples_size;
+int			timeouts;
+
+char			*hotplug_cmds[SWMB_HOTPLUG_CMDS];
+int			nhotplug_cmds;
+
+int		 autorun_check(int);
+void		 bench(int, int);
+xcb_window_t	 create_window(void);
+int		 ctl_cmd(const char *);
+void		 ctl_open(const char *);
+void		 drain_events(void);
+void		 hotplug(int, int);
+uint64_t	 now_usec(void);
+void		 report(const char *, int);
+void		 sample_add(uint64_t);
+int		 sample_cmp(const void *, const void *);
+void		 usage(void);
+int		 wait_events(uint8_t, xcb_window_t, int);
+int		 wait_resized(xcb_window_t *, uint32_t *, int);
+
+uint64_t
+now_usec(void)
+{
+	struct timespec		ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+void
+sample_add(uint64_t usec)
+{
+	if (nsamples == samples_size) {
+		samples_size = samples_size ? samples_size * 2 : 1024;
+		if ((samples = realloc(samples, samples_size *
+		    sizeof *samples)) == NULL)
+			err(1, "realloc");
+	}
+	samples[nsamples++] = usec;
+}
+
+int
+sample_cmp(const void *a, const void *b)
+{
+	uint64_t		x = *(const uint64_t *)a;
+	uint64_t		y = *(const uint64_t *)b;
+
+	return (x < y ? -1 : x > y);
+}
+
+/* Emit a result line for the collected samples and reset them. */
+void
+report(const char *metric, int windows)
+{
+	uint64_t		total = 0;
+	size_t			i;
+
+	if (nsamples) {
+		qsort(samples, nsamples, sizeof *samples, sample_cmp);
+		for (i = 0; i < nsamples; i++)
+			total += samples[i];
+		fprintf(out, "{\"label\":\"%s\",\"metric\":\"%s\","
+		    "\"windows\":%d,\"n\":%zu,\"timeouts\":%d,"
+		    "\"min_us\":%llu,\"p50_us\":%llu,\"p95_us\":%llu,"
+		    "\"max_us\":%llu,\"mean_us\":%llu}\n",
+		    label, metric, windows, nsamples, timeouts,
+		    (unsigned long long)samples[0],
+		    (unsigned long long)samples[nsamples / 2],
+		    (unsigned long long)samples[nsamples * 95 / 100],
+		    (unsigned long long)samples[nsamples - 1],
+		    (unsigned long long)(total / nsamples));
+	} else
+		fprintf(out, "{\"label\":\"%s\",\"metric\":\"%s\","
+		    "\"windows\":%d,\"n\":0,\"timeouts\":%d}\n",
+		    label, metric, windows, timeouts);
+	fflush(out);
+
+	nsamples = 0;
+	timeouts = 0;
+}
+
+void
+ctl_open(const char *path)
+{
+	struct sockaddr_un	sun;
+
+	memset(&sun, 0, sizeof sun);
+	sun.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof sun.sun_path)
+		errx(1, "socket path too long: %s", path);
+	strncpy(sun.sun_path, path, sizeof sun.sun_path - 1);
+
+	if ((ctl = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		err(1, "socket");
+	if (connect(ctl, (struct sockaddr *)&sun, sizeof sun) == -1)
+		err(1, "connect %s", path);
+}
+
+/* Send one control command and wait for its answer. */
+int
+ctl_cmd(const char *cmd)
+{
+	char			line[SWMB_LINELEN];
+	size_t			len = 0;
+	ssize_t			n;
+
+	dprintf(ctl, "%s\n", cmd);
+	while (len < sizeof line - 1) {
+		if ((n = read(ctl, line + len, 1)) <= 0)
+			errx(1, "control socket closed");
+		if (line[len] == '\n')
+			break;
+		len++;
+	}
+	line[len] = '\0';
+
+	if (strncmp(line, "ok", 2)) {
+		warnx("%s: %s", cmd, line);
+		return (1);
+	}
+	return (0);
+}
+
+/*
+ * Wait until count events of type (for win, unless XCB_WINDOW_NONE) have
+ * arrived.  Returns the number seen before the timeout.
+ */
+int
+wait_events(uint8_t type, xcb_window_t win, int count)
+{
+	struct pollfd		pfd;
+	xcb_generic_event_t	*evt;
+	xcb_window_t		ev_win;
+	int			seen = 0;
+
+	pfd.fd = xcb_get_file_descriptor(conn);
+	pfd.events = POLLIN;
+
+	xcb_flush(conn);
+	while (seen < count) {
+		while (seen < count && (evt = xcb_poll_for_event(conn))) {
+			if ((evt->response_type & ~0x80) == type) {
+				switch (type) {
+				case XCB_MAP_NOTIFY:
+					ev_win = ((xcb_map_notify_event_t *)
+					    evt)->window;
+					break;
+				case XCB_UNMAP_NOTIFY:
+					ev_win = ((xcb_unmap_notify_event_t *)
+					    evt)->window;
+					break;
+				case XCB_FOCUS_IN:
+					ev_win = ((xcb_focus_in_event_t *)
+					    evt)->event;
+					break;
+				case XCB_PROPERTY_NOTIFY:
+					ev_win = ((xcb_property_notify_event_t
+					    *)evt)->window;
+					break;
+				default:
+					ev_win = XCB_WINDOW_NONE;
+				}
+				if (win == XCB_WINDOW_NONE || win == ev_win)
+					seen++;
+			}
+			free(evt);
+		}
+		if (seen == count)
+			break;
+		if (poll(&pfd, 1, SWMB_TIMEOUT_MS) <= 0) {
+			timeouts++;
+			break;
+		}
+		if (xcb_connection_has_error(conn))
+			errx(1, "X connection lost");
+	}
+
+	return (seen);
+}
+
+/*
+ * Wait until each of the n windows got a ConfigureNotify with a size other
+ * than its entry in size (width << 16 | height), which is updated.  Returns
+ * false on timeout.
+ */
+int
+wait_resized(xcb_window_t *wins, uint32_t *size, int n)
+{
+	struct pollfd			pfd;
+	xcb_generic_event_t		*evt;
+	xcb_configure_notify_event_t	*ce;
+	uint32_t			*old, wh;
+	int				i, left = n;
+
+	if ((old = calloc(n, sizeof *old)) == NULL)
+		err(1, "calloc");
+	memcpy(old, size, n * sizeof *old);
+
+	pfd.fd = xcb_get_file_descriptor(conn);
+	pfd.events = POLLIN;
+
+	xcb_flush(conn);
+	while (left) {
+		while (left && (evt = xcb_poll_for_event(conn))) {
+			if ((evt->response_type & ~0x80) ==
+			    XCB_CONFIGURE_NOTIFY) {
+				ce = (xcb_configure_notify_event_t *)evt;
+				for (i = 0; i < n; i++)
+					if (wins[i] == ce->window)
+						break;
+				wh = (uint32_t)ce->width << 16 | ce->height;
+				if (i < n && size[i] == old[i] && wh != old[i])
+					left--;
+				if (i < n)
+					size[i] = wh;
+			}
+			free(evt);
+		}
+		if (left == 0)
+			break;
+		if (poll(&pfd, 1, SWMB_TIMEOUT_MS) <= 0) {
+			timeouts++;
+			break;
+		}
+		if (xcb_connection_has_error(conn))
+			errx(1, "X connection lost");
+	}
+	free(old);
+
+	return (left == 0);
+}
+
+void
+drain_events(void)
+{
+	xcb_generic_event_t	*evt;
+
+	free(xcb_get_input_focus_reply(conn, xcb_get_input_focus(conn), NULL));
+	while ((evt = xcb_poll_for_event(conn)))
+		free(evt);
+}
+
+xcb_window_t
+create_window(void)
+{
+	xcb_window_t		win;
+	uint32_t		val[2];
+
+	win = xcb_generate_id(conn);
+	val[0] = screen->black_pixel;
+	val[1] = XCB_EVENT_MASK_STRUCTURE_NOTIFY |
+	    XCB_EVENT_MASK_FOCUS_CHANGE;
+	xcb_create_window(conn, XCB_COPY_FROM_PARENT, win, screen->root,
+	    0, 0, 100, 100, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+	    screen->root_visual, XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK, val);
+	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, win,
+	    XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 8, strlen("swmbench"),
+	    "swmbench");
+
+	return (win);
+}
+
+/* Map a window and wait for spectrwm to give it a _NET_WM_DESKTOP. */
+int
+autorun_check(int ws)
+{
+	xcb_intern_atom_reply_t		*ar;
+	xcb_get_property_reply_t	*pr;
+	xcb_atom_t			a_desktop;
+	xcb_window_t			win;
+	uint32_t			val;
+	int				desktop = -1;
+
+	ar = xcb_intern_atom_reply(conn, xcb_intern_atom(conn, 0,
+	    strlen("_NET_WM_DESKTOP"), "_NET_WM_DESKTOP"), NULL);
+	if (ar == NULL)
+		errx(1, "can not intern _NET_WM_DESKTOP");
+	a_desktop = ar->atom;
+	free(ar);
+
+	win = create_window();
+	val = XCB_EVENT_MASK_STRUCTURE_NOTIFY | XCB_EVENT_MASK_PROPERTY_CHANGE;
+	xcb_change_window_attributes(conn, win, XCB_CW_EVENT_MASK, &val);
+	xcb_map_window(conn, win);
+
+	while (desktop == -1 && timeouts == 0) {
+		wait_events(XCB_PROPERTY_NOTIFY, win, 1);
+		pr = xcb_get_property_reply(conn, xcb_get_property(conn, 0, win,
+		    a_desktop, XCB_ATOM_CARDINAL, 0, 1), NULL);
+		if (pr && xcb_get_property_value_length(pr) == sizeof val)
+			desktop = *(uint32_t *)xcb_get_property_value(pr);
+		free(pr);
+	}
+
+	fprintf(out, "{\"label\":\"%s\",\"metric\":\"autorun\","
+	    "\"expected_ws\":%d,\"ws\":%d}\n", label, ws, desktop);
+	fflush(out);
+
+	xcb_destroy_window(conn, win);
+	xcb_flush(conn);
+
+	return (desktop != ws);
+}
+
+void
+bench(int nwin, int iterations)
+{
+	xcb_window_t		*wins;
+	uint64_t		start;
+	int			i;
+
+	if ((wins = calloc(nwin, sizeof *wins)) == NULL)
+		err(1, "calloc");
+
+	/* map: each new window is managed and stacked with the others. */
+	for (i = 0; i < nwin; i++) {
+		wins[i] = create_window();
+		start = now_usec();
+		xcb_map_window(conn, wins[i]);
+		if (wait_events(XCB_MAP_NOTIFY, wins[i], 1) == 1)
+			sample_add(now_usec() - start);
+	}
+	report("map", nwin);
+	drain_events();
+
+	/* switchws: away from and back to the populated workspace. */
+	for (i = 0; i < iterations; i++) {
+		start = now_usec();
+		if (ctl_cmd("ws_2") == 0 &&
+		    wait_events(XCB_UNMAP_NOTIFY, XCB_WINDOW_NONE, nwin) == nwin)
+			sample_add(now_usec() - start);
+		start = now_usec();
+		if (ctl_cmd("ws_1") == 0 &&
+		    wait_events(XCB_MAP_NOTIFY, XCB_WINDOW_NONE, nwin) == nwin)
+			sample_add(now_usec() - start);
+	}
+	report("switchws", nwin);
+	drain_events();
+
+	/* focus: cycle through the stack. */
+	for (i = 0; i < iterations; i++) {
+		start = now_usec();
+		if (ctl_cmd("focus_next") == 0 &&
+		    wait_events(XCB_FOCUS_IN, XCB_WINDOW_NONE, 1) == 1)
+			sample_add(now_usec() - start);
+	}
+	report("focus", nwin);
+	drain_events();
+
+	/* stack: each change to the master area restacks the region. */
+	for (i = 0; i < iterations; i++) {
+		start = now_usec();
+		if (ctl_cmd(i % 2 ? "master_shrink" : "master_grow") == 0)
+			sample_add(now_usec() - start);
+	}
+	report("stack", nwin);
+	drain_events();
+
+	/* bar: toggling hides/shows, restacks and redraws the bar. */
+	for (i = 0; i < iterations; i++) {
+		start = now_usec();
+		if (ctl_cmd("bar_toggle") == 0)
+			sample_add(now_usec() - start);
+	}
+	report("bar", nwin);
+
+	for (i = 0; i < nwin; i++)
+		xcb_destroy_window(conn, wins[i]);
+	drain_events();
+	free(wins);
+}
+
+/* Run the -x commands in turn with nwin tiled windows on the screen. */
+void
+hotplug(int nwin, int iterations)
+{
+	xcb_get_geometry_reply_t	*gr;
+	xcb_window_t			*wins;
+	uint32_t			*size;
+	uint64_t			start, *cmd_usec;
+	int				i, ncmd = 0;
+
+	if ((wins = calloc(nwin, sizeof *wins)) == NULL ||
+	    (size = calloc(nwin, sizeof *size)) == NULL ||
+	    (cmd_usec = calloc(iterations, sizeof *cmd_usec)) == NULL)
+		err(1, "calloc");
+
+	for (i = 0; i < nwin; i++) {
+		wins[i] = create_window();
+		xcb_map_window(conn, wins[i]);
+	}
+	wait_events(XCB_MAP_NOTIFY, XCB_WINDOW_NONE, nwin);
+	drain_events();
+	for (i = 0; i < nwin; i++) {
+		gr = xcb_get_geometry_reply(conn, xcb_get_geometry(conn,
+		    wins[i]), NULL);
+		if (gr)
+			size[i] = (uint32_t)gr->width << 16 | gr->height;
+		free(gr);
+	}
+
+	for (i = 0; i < iterations; i++) {
+		start = now_usec();
+		if (system(hotplug_cmds[i % nhotplug_cmds]) != 0) {
+			warnx("failed: %s", hotplug_cmds[i % nhotplug_cmds]);
+			break;
+		}
+		cmd_usec[ncmd++] = now_usec() - start;
+		if (wait_resized(wins, size, nwin))
+			sample_add(now_usec() - start);
+	}
+	report("hotplug", nwin);
+	for (i = 0; i < ncmd; i++)
+		sample_add(cmd_usec[i]);
+	report("hotplug_cmd", nwin);
+
+	for (i = 0; i < nwin; i++)
+		xcb_destroy_window(conn, wins[i]);
+	drain_events();
+	free(cmd_usec);
+	free(size);
+	free(wins);
+}
+
+void
+usage(void)
+{
+	fprintf(stderr, "usage: swmbench -s socket [-i iterations] "
+	    "[-l label] [-n count,...] [-o file]\n"
+	    "       swmbench -s socket -x command [-x command ...] "
+	    "[-i iterations]\n"
+	    "                [-l label] [-n count,...] [-o file]\n"
+	    "       swmbench -a ws [-l label] [-o file]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char		*sock = getenv("SWM_CONTROL_SOCKET");
+	char			*counts = NULL, *cp, *ap;
+	int			ch, iterations = 20, n, autorun = -1, rc;
+
+	out = stdout;
+	while ((ch = getopt(argc, argv, "a:i:l:n:o:s:x:")) != -1) {
+		switch (ch) {
+		case 'a':
+			autorun = strtol(optarg, NULL, 10);
+			if (autorun < 0)
+				usage();
+			break;
+		case 'i':
+			iterations = strtol(optarg, NULL, 10);
+			if (iterations <= 0)
+				usage();
+			break;
+		case 'l':
+			label = optarg;
+			break;
+		case 'n':
+			counts = optarg;
+			break;
+		case 'o':
+			if ((out = fopen(optarg, "a")) == NULL)
+				err(1, "%s", optarg);
+			break;
+		case 's':
+			sock = optarg;
+			break;
+		case 'x':
+			if (nhotplug_cmds == SWMB_HOTPLUG_CMDS)
+				usage();
+			hotplug_cmds[nhotplug_cmds++] = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (sock == NULL && autorun == -1)
+		usage();
+
+	conn = xcb_connect(NULL, NULL);
+	if (xcb_connection_has_error(conn))
+		errx(1, "can not open display");
+	screen = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
+
+	if (autorun != -1) {
+		rc = autorun_check(autorun);
+		xcb_disconnect(conn);
+		if (out != stdout)
+			fclose(out);
+		return (rc);
+	}
+
+	ctl_open(sock);
+	ctl_cmd("ws_1");
+
+	if ((cp = strdup(counts ? counts : "10,100,1000")) == NULL)
+		err(1, "strdup");
+	counts = cp;
+	while ((ap = strsep(&cp, ",")) != NULL) {
+		if ((n = strtol(ap, NULL, 10)) <= 0)
+			usage();
+		if (nhotplug_cmds)
+			hotplug(n, iterations);
+		else
+			bench(n, iterations);
+	}
+	free(counts);
+
+	close(ctl);
+	xcb_disconnect(conn);
+	if (out != stdout)
+		fclose(out);
+
+	return (0);
+}
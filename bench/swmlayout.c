@@ -0,0 +1,627 @@
+/*
+ * swmlayout - micro-benchmark for the tiling layouts in layout.c.
+ *
+ * Runs the vertical, horizontal and max layouts, flipped and not, for a range
+ * of window counts and master/stack settings, and reports the cost per call
+ * as one JSON object per line.
+ *
+ * Each pass (-r, default 5) times every case right after the old geometry
+ * code (see below) doing the same layout on the same windows, and the median
+ * time and median ratio to the old code are reported.  The ratio is what
+ * -b compares against an earlier run: a machine or process that is slower as
+ * a whole slows both sides alike, so only a change to layout.c moves it.  The
+ * exit status is non-zero if any ratio grew by more than the given percentage
+ * (twice that for cases that take well under a microsecond, where a few ns
+ * are a large part).  Cases that look slower are timed again over the next
+ * few seconds before they count.
+ *
+ * Before timing anything, the layouts are checked against a copy of the
+ * geometry code that stack_master() and max_stack() used before it moved to
+ * layout.c; the exit status is non-zero if any cell differs.
+ */
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../layout.h"
+
+#define SWML_MIN_NSEC		(10000000)	/* run each case >= 10ms */
+#define SWML_SMALL_NSEC		(100)		/* twice the -t below this */
+#define SWML_SAMPLES		(64)		/* most passes of a case */
+#define SWML_LINELEN		(256)
+#define SWML_SCAN	"{\"layout\":\"%15[a-z]\",\"flip\":%d,\"windows\":%d," \
+			"\"mwin\":%d,\"stacks\":%d,\"ns_per_call\":%lf," \
+			"\"vs_ref\":%lf}"
+#define SWML_FMT	"{\"layout\":\"%s\",\"flip\":%d,\"windows\":%d," \
+			"\"mwin\":%d,\"stacks\":%d,\"ns_per_call\":%.1f," \
+			"\"vs_ref\":%.3f}"
+
+enum {
+	SWML_MASTER,
+	SWML_MAX,
+};
+
+struct swml_result {
+	char			layout[16];
+	int			flip, windows, mwin, stacks;
+	double			ns, ratio;
+};
+
+struct swml_case {
+	const char		*name;
+	struct swm_layout_params lp;
+	int			n;
+	int			kind;
+	int			samples;
+	double			ns[SWML_SAMPLES];	/* one per pass */
+	double			ratio[SWML_SAMPLES];	/* to the old code */
+};
+
+const int		counts[] = { 1, 10, 100, 1000, 10000 };
+const int		mwins[] = { 0, 1, 3 };
+const int		stackss[] = { 1, 2, 4 };
+
+struct swm_geometry	region = { 0, 17, 2560 - 2, 1440 - 17 - 2 };
+struct swm_layout_hints	*hints;
+struct swm_geometry	*cells;
+struct swml_result	*baseline;
+size_t			nbaseline;
+double			tolerance = 25;
+int			runs = 5;
+FILE			*out;
+int			regressions;
+int			mismatches;
+
+void		 baseline_load(const char *);
+double		 baseline_ratio(const char *, int, int, int, int);
+void		 check(void);
+void		 check_case(const struct swm_geometry *,
+		    const struct swm_layout_params *,
+		    const struct swm_layout_hints *, int);
+void		 hints_init(int);
+double		 limit_ratio(const struct swml_case *);
+double		 median(const double *, int);
+int		 median_cmp(const void *, const void *);
+uint64_t	 now_nsec(void);
+void		 ref_master(const struct swm_geometry *,
+		    const struct swm_layout_params *,
+		    const struct swm_layout_hints *, int, struct swm_geometry *);
+void		 ref_max(const struct swm_geometry *, bool, int,
+		    struct swm_geometry *);
+void		 report(const struct swml_case *);
+double		 run(const struct swm_layout_params *, int, int, bool);
+void		 sample(struct swml_case *);
+void		 usage(void);
+
+uint64_t
+now_nsec(void)
+{
+	struct timespec		ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/* Every third window asks for terminal-like size increments. */
+void
+hints_init(int n)
+{
+	int			i;
+
+	if ((hints = calloc(n, sizeof *hints)) == NULL ||
+	    (cells = calloc(n, sizeof *cells)) == NULL)
+		err(1, "calloc");
+	for (i = 0; i < n; i += 3) {
+		hints[i].width_inc = 7;
+		hints[i].height_inc = 14;
+		hints[i].base_width = 4;
+		hints[i].base_height = 4;
+	}
+}
+
+/*
+ * The tiled part of stack_master() before layout.c, with the workspace and
+ * the globals it read replaced by the parameters of layout_master().
+ */
+void
+ref_master(const struct swm_geometry *g, const struct swm_layout_params *lp,
+    const struct swm_layout_hints *sh, int winno, struct swm_geometry *res)
+{
+	struct swm_geometry	cell, r_g = *g;
+	int			i = 0, j = 0, s = 0, stacks = 0, tmp;
+	int			w_inc = 1, h_inc, w_base = 1, h_base;
+	int			hrh = 0, extra = 0, h_slice = 0, last_h = 0;
+	int			split = 0, colno = 0;
+	int			mwin = 0, msize = 0;
+	int			remain, missing, v_slice, mscale;
+	int			border_width = lp->border_width;
+	int			tile_gap = lp->tile_gap;
+
+	if (winno <= 0)
+		return;
+
+	if (lp->rot) {
+		w_inc = sh[0].width_inc;
+		w_base = sh[0].base_width;
+		tmp = r_g.y; r_g.y = r_g.x; r_g.x = tmp;
+		tmp = r_g.h; r_g.h = r_g.w; r_g.w = tmp;
+	} else {
+		w_inc = sh[0].height_inc;
+		w_base = sh[0].base_height;
+	}
+	mwin = lp->mwin;
+	mscale = lp->msize;
+	stacks = lp->stacks;
+
+	cell = r_g;
+	cell.x += border_width;
+	cell.y += border_width;
+
+	if (stacks > winno - mwin)
+		stacks = winno - mwin;
+	if (stacks < 1)
+		stacks = 1;
+
+	h_slice = r_g.h / SWM_H_SLICE;
+	if (mwin && winno > mwin) {
+		v_slice = r_g.w / SWM_V_SLICE;
+
+		split = mwin;
+		colno = split;
+		cell.w = v_slice * mscale;
+
+		if (w_inc > 1 && w_inc < v_slice) {
+			remain = (cell.w - w_base) % w_inc;
+			cell.w -= remain;
+		}
+
+		msize = cell.w;
+		if (lp->flip)
+			cell.x += r_g.w - msize;
+		s = stacks;
+	} else {
+		msize = - 2 * border_width;
+		colno = split = winno / stacks;
+		cell.w = ((r_g.w - (stacks * 2 * border_width) +
+		    2 * border_width) / stacks);
+		s = stacks - 1;
+	}
+
+	hrh = r_g.h / colno;
+	extra = r_g.h - (colno * hrh);
+	cell.h = hrh - 2 * border_width;
+
+	for (i = 0; i < winno; i++) {
+		if (split && i == split) {
+			colno = (winno - mwin) / stacks;
+			if (s <= (winno - mwin) % stacks)
+				colno++;
+			split += colno;
+			hrh = r_g.h / colno;
+			extra = r_g.h - (colno * hrh);
+
+			if (!lp->flip)
+				cell.x += cell.w + 2 * border_width + tile_gap;
+
+			cell.w = (r_g.w - msize -
+			    (stacks * (2 * border_width + tile_gap))) / stacks;
+			if (s == 1)
+				cell.w += (r_g.w - msize -
+				    (stacks * (2 * border_width + tile_gap))) %
+				    stacks;
+
+			if (lp->flip)
+				cell.x -= cell.w + 2 * border_width +
+				    tile_gap;
+			s--;
+			j = 0;
+		}
+
+		cell.h = hrh - 2 * border_width - tile_gap;
+
+		if (lp->rot) {
+			h_inc = sh[i].width_inc;
+			h_base = sh[i].base_width;
+		} else {
+			h_inc = sh[i].height_inc;
+			h_base = sh[i].base_height;
+		}
+
+		if (j == colno - 1) {
+			cell.h = hrh + extra;
+		} else if (h_inc > 1 && h_inc < h_slice) {
+			remain = (cell.h - h_base) % h_inc;
+			missing = h_inc - remain;
+
+			if (missing <= extra || j == 0) {
+				extra -= missing;
+				cell.h += missing;
+			} else {
+				cell.h -= remain;
+				extra += remain;
+			}
+		}
+
+		if (j == 0)
+			cell.y = r_g.y + border_width;
+		else
+			cell.y += last_h + 2 * border_width + tile_gap;
+
+		if (lp->rot) {
+			res[i].x = cell.y;
+			res[i].y = cell.x;
+			res[i].w = cell.h;
+			res[i].h = cell.w;
+		} else
+			res[i] = cell;
+
+		if (!lp->bordered) {
+			res[i].x -= border_width;
+			res[i].y -= border_width;
+			res[i].w += 2 * border_width;
+			res[i].h += 2 * border_width;
+		}
+
+		last_h = cell.h;
+		j++;
+	}
+}
+
+/* The geometry max_stack() gave each window before layout.c. */
+void
+ref_max(const struct swm_geometry *g, bool bordered, int border_width,
+    struct swm_geometry *res)
+{
+	*res = *g;
+	if (!bordered) {
+		res->w += 2 * border_width;
+		res->h += 2 * border_width;
+	} else {
+		res->x += border_width;
+		res->y += border_width;
+	}
+}
+
+void
+check_case(const struct swm_geometry *g, const struct swm_layout_params *lp,
+    const struct swm_layout_hints *sh, int n)
+{
+	static struct swm_geometry	ref[64], got[64];
+	int				i;
+
+	memset(ref, 0, sizeof ref);
+	memset(got, 0, sizeof got);
+	ref_master(g, lp, sh, n, ref);
+	layout_master(g, lp, sh, n, got);
+	for (i = 0; i < n; i++)
+		if (memcmp(&ref[i], &got[i], sizeof ref[i])) {
+			warnx("%dx%d+%d+%d rot %d flip %d windows %d mwin %d "
+			    "msize %d stacks %d border %d/%d gap %d: "
+			    "window %d is %dx%d+%d+%d, was %dx%d+%d+%d",
+			    g->w, g->h, g->x, g->y, lp->rot, lp->flip, n,
+			    lp->mwin, lp->msize, lp->stacks, lp->bordered,
+			    lp->border_width, lp->tile_gap, i, got[i].w,
+			    got[i].h, got[i].x, got[i].y, ref[i].w, ref[i].h,
+			    ref[i].x, ref[i].y);
+			mismatches++;
+			return;
+		}
+
+	ref_max(g, lp->bordered, lp->border_width, &ref[0]);
+	layout_max(g, lp->bordered, lp->border_width, &got[0]);
+	if (memcmp(&ref[0], &got[0], sizeof ref[0])) {
+		warnx("max %dx%d+%d+%d border %d/%d: %dx%d+%d+%d, was "
+		    "%dx%d+%d+%d", g->w, g->h, g->x, g->y, lp->bordered,
+		    lp->border_width, got[0].w, got[0].h, got[0].x, got[0].y,
+		    ref[0].w, ref[0].h, ref[0].x, ref[0].y);
+		mismatches++;
+	}
+}
+
+/* Compare layout.c with the old code over a grid of settings. */
+void
+check(void)
+{
+	static const struct swm_geometry regions[] = {
+		{ 0, 17, 2560 - 2, 1440 - 17 - 2 },
+		{ 1920, 0, 1080, 1920 },
+		{ 0, 0, 800, 600 },
+		{ 5, 3, 333, 211 },
+	};
+	struct swm_layout_hints	plain[64];
+	struct swm_layout_params lp;
+	const struct swm_layout_hints *sh;
+	size_t			r;
+	int			n, mwin, msize, stacks, bw, gap, rot, flip;
+	int			bordered, h;
+
+	memset(plain, 0, sizeof plain);
+	for (r = 0; r < sizeof regions / sizeof regions[0]; r++)
+	for (h = 0; h <= 1; h++)
+	for (n = 1; n <= 64; n += n < 8 ? 1 : 7)
+	for (mwin = 0; mwin <= 4; mwin++)
+	for (msize = 1; msize < SWM_V_SLICE; msize += 7)
+	for (stacks = 1; stacks <= 4; stacks++)
+	for (bw = 0; bw <= 3; bw += 3)
+	for (gap = 0; gap <= 5; gap += 5)
+	for (rot = 0; rot <= 1; rot++)
+	for (flip = 0; flip <= 1; flip++)
+	for (bordered = 0; bordered <= 1; bordered++) {
+		sh = h ? hints : plain;
+		lp.mwin = mwin;
+		lp.msize = msize;
+		lp.stacks = stacks;
+		lp.rot = rot;
+		lp.flip = flip;
+		lp.bordered = bordered;
+		lp.border_width = bw;
+		lp.tile_gap = gap;
+		check_case(&regions[r], &lp, sh, n);
+	}
+}
+
+/* Average ns per layout of n windows, by layout.c or else the old code. */
+double
+run(const struct swm_layout_params *lp, int n, int kind, bool ref)
+{
+	uint64_t		start, elapsed;
+	unsigned long		iter, calls = 0;
+	int			i;
+
+	iter = 1;
+	start = now_nsec();
+	do {
+		for (; calls < iter; calls++) {
+			if (kind == SWML_MAX) {
+				/* max_stack configures every window alike. */
+				for (i = 0; i < n; i++)
+					if (ref)
+						ref_max(&region, lp->bordered,
+						    lp->border_width,
+						    &cells[i]);
+					else
+						layout_max(&region,
+						    lp->bordered,
+						    lp->border_width,
+						    &cells[i]);
+			} else if (ref)
+				ref_master(&region, lp, hints, n, cells);
+			else
+				layout_master(&region, lp, hints, n, cells);
+		}
+		iter *= 2;
+	} while ((elapsed = now_nsec() - start) < SWML_MIN_NSEC);
+
+	return ((double)elapsed / calls);
+}
+
+/* Time a case once more, the old code right before it. */
+void
+sample(struct swml_case *k)
+{
+	double			ref;
+
+	if (k->samples == SWML_SAMPLES)
+		return;
+	ref = run(&k->lp, k->n, k->kind, true);
+	k->ns[k->samples] = run(&k->lp, k->n, k->kind, false);
+	k->ratio[k->samples] = k->ns[k->samples] / ref;
+	k->samples++;
+}
+
+int
+median_cmp(const void *a, const void *b)
+{
+	double			x = *(const double *)a, y = *(const double *)b;
+
+	return (x < y ? -1 : x > y);
+}
+
+double
+median(const double *v, int n)
+{
+	double			s[SWML_SAMPLES];
+
+	memcpy(s, v, n * sizeof *v);
+	qsort(s, n, sizeof *s, median_cmp);
+	return (n % 2 ? s[n / 2] : (s[n / 2 - 1] + s[n / 2]) / 2);
+}
+
+/* Baseline ratio to the old code of a case, 0 if there is none. */
+double
+baseline_ratio(const char *name, int flip, int n, int mwin, int stacks)
+{
+	size_t			i;
+
+	for (i = 0; i < nbaseline; i++)
+		if (strcmp(baseline[i].layout, name) == 0 &&
+		    baseline[i].flip == flip && baseline[i].windows == n &&
+		    baseline[i].mwin == mwin && baseline[i].stacks == stacks)
+			return (baseline[i].ratio);
+
+	return (0);
+}
+
+/* Ratio allowed for a case given the baseline, 0 if there is none. */
+double
+limit_ratio(const struct swml_case *k)
+{
+	double			ratio, tol = tolerance;
+
+	if ((ratio = baseline_ratio(k->name, k->lp.flip, k->n, k->lp.mwin,
+	    k->lp.stacks)) == 0)
+		return (0);
+
+	/* A few ns either way is timer noise on the smallest cases. */
+	if (median(k->ns, k->samples) < SWML_SMALL_NSEC)
+		tol *= 2;
+	return (ratio * (100 + tol) / 100);
+}
+
+void
+report(const struct swml_case *k)
+{
+	double			limit, ratio;
+
+	ratio = median(k->ratio, k->samples);
+	fprintf(out, SWML_FMT "\n", k->name, k->lp.flip, k->n, k->lp.mwin,
+	    k->lp.stacks, median(k->ns, k->samples), ratio);
+
+	limit = limit_ratio(k);
+	if (limit > 0 && ratio > limit) {
+		warnx("%s flip %d windows %d mwin %d stacks %d: %.2fx the old "
+		    "code, allowed %.2fx", k->name, k->lp.flip, k->n,
+		    k->lp.mwin, k->lp.stacks, ratio, limit);
+		regressions++;
+	}
+}
+
+void
+baseline_load(const char *path)
+{
+	FILE			*f;
+	struct swml_result	r;
+	char			line[SWML_LINELEN];
+	size_t			size = 0;
+
+	if ((f = fopen(path, "r")) == NULL)
+		err(1, "%s", path);
+	while (fgets(line, sizeof line, f)) {
+		if (sscanf(line, SWML_SCAN, r.layout, &r.flip, &r.windows,
+		    &r.mwin, &r.stacks, &r.ns, &r.ratio) != 7)
+			continue;
+		if (nbaseline == size) {
+			size = size ? size * 2 : 64;
+			if ((baseline = realloc(baseline,
+			    size * sizeof *baseline)) == NULL)
+				err(1, "realloc");
+		}
+		baseline[nbaseline++] = r;
+	}
+	fclose(f);
+}
+
+void
+usage(void)
+{
+	fprintf(stderr, "usage: swmlayout [-b baseline] [-o file] [-r runs] "
+	    "[-t tolerance%%]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct swml_case	*cases, *k;
+	struct swm_layout_params lp;
+	struct timespec		pause = { 0, 200000000 };
+	const char		*name;
+	size_t			c, m, s, ncases = 0;
+	int			ch, flip, rot, n, pass, slow;
+	double			limit;
+
+	out = stdout;
+	while ((ch = getopt(argc, argv, "b:o:r:t:")) != -1) {
+		switch (ch) {
+		case 'b':
+			baseline_load(optarg);
+			break;
+		case 'o':
+			if ((out = fopen(optarg, "w")) == NULL)
+				err(1, "%s", optarg);
+			break;
+		case 'r':
+			runs = atoi(optarg);
+			if (runs < 1 || runs > SWML_SAMPLES / 4)
+				usage();
+			break;
+		case 't':
+			tolerance = strtod(optarg, NULL);
+			if (tolerance < 0)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+
+	hints_init(counts[sizeof counts / sizeof counts[0] - 1]);
+
+	check();
+	if (mismatches)
+		warnx("%d layouts differ from the old code", mismatches);
+
+	if ((cases = calloc(sizeof counts / sizeof counts[0] * (2 * 2 *
+	    sizeof mwins / sizeof mwins[0] * sizeof stackss / sizeof stackss[0]
+	    + 1), sizeof *cases)) == NULL)
+		err(1, "calloc");
+
+	memset(&lp, 0, sizeof lp);
+	lp.bordered = true;
+	lp.border_width = 1;
+
+	for (c = 0; c < sizeof counts / sizeof counts[0]; c++) {
+		n = counts[c];
+		for (rot = 0; rot <= 1; rot++) {
+			name = rot ? "horizontal" : "vertical";
+			for (flip = 0; flip <= 1; flip++)
+			for (m = 0; m < sizeof mwins / sizeof mwins[0]; m++)
+			for (s = 0; s < sizeof stackss / sizeof stackss[0];
+			    s++) {
+				k = &cases[ncases++];
+				k->name = name;
+				k->lp = lp;
+				k->lp.rot = rot;
+				k->lp.flip = flip;
+				k->lp.mwin = mwins[m];
+				k->lp.stacks = stackss[s];
+				k->lp.msize = (rot ? SWM_H_SLICE :
+				    SWM_V_SLICE) / 2;
+				k->n = n;
+			}
+		}
+		/* Reported with flip, mwin and stacks 0. */
+		k = &cases[ncases++];
+		k->name = "max";
+		k->lp = lp;
+		k->n = n;
+		k->kind = SWML_MAX;
+	}
+
+	/* Interleave the passes so that a slow spell hits every case once. */
+	for (pass = 0; pass < runs; pass++)
+		for (c = 0; c < ncases; c++)
+			sample(&cases[c]);
+
+	/*
+	 * Cases that look slower than their baseline get more passes, spread
+	 * out so that they do not all land in the same busy spell.
+	 */
+	for (pass = 0, slow = 1; slow && pass < 3 * runs; pass++) {
+		if (pass)
+			nanosleep(&pause, NULL);
+		slow = 0;
+		for (c = 0; c < ncases; c++) {
+			k = &cases[c];
+			limit = limit_ratio(k);
+			if (limit == 0 || median(k->ratio, k->samples) <= limit)
+				continue;
+			sample(k);
+			slow++;
+		}
+	}
+
+	for (c = 0; c < ncases; c++)
+		report(&cases[c]);
+	free(cases);
+
+	if (out != stdout)
+		fclose(out);
+
+	return (regressions != 0 || mismatches != 0);
+}
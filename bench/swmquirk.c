@@ -0,0 +1,266 @@
+/*
+ * swmquirk - micro-benchmark for the quirk matcher in quirk.c.
+ *
+ * Builds a list of quirks (1000 by default) shaped like real ones: mostly
+ * literal classes, some class prefixes and catch-alls, instance and title
+ * patterns, a few with a workspace.  Windows are then matched the old way,
+ * trying every regex of every quirk, and through the matcher, with each
+ * title new (cache misses) and with titles repeating (cache hits).  Reports
+ * the cost per window as one JSON object per line and exits non-zero if the
+ * matcher ever disagrees with the old way.
+ */
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../quirk.h"
+
+#define SWMQ_MIN_NSEC		(20000000)	/* run each case >= 20ms */
+#define SWMQ_WINDOWS		(64)		/* distinct windows */
+#define SWMQ_WS_LIMIT		(10)
+#define SWMQ_FMT	"{\"case\":\"%s\",\"quirks\":%d,\"ns_per_window\":%.1f}"
+
+struct swmq_window {
+	char			class[32];
+	char			instance[32];
+	char			name[64];
+};
+
+struct swm_quirk_rule	*rules;
+regex_t			*regexes;
+char			*patterns;
+struct swmq_window	windows[SWMQ_WINDOWS];
+int			nrules = 1000;
+unsigned long		serial;
+int			mismatches;
+FILE			*out;
+
+void		 naive(const struct swmq_window *, const char *,
+		    struct swm_quirk_result *);
+uint64_t	 now_nsec(void);
+void		 report(const char *, double);
+double		 run(int);
+void		 rules_init(void);
+void		 usage(void);
+void		 windows_init(void);
+
+uint64_t
+now_nsec(void)
+{
+	struct timespec		ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+void
+rules_init(void)
+{
+	char			*p, buf[64];
+	int			i, j;
+
+	if ((rules = calloc(nrules, sizeof *rules)) == NULL ||
+	    (regexes = calloc(nrules * SWM_QUIRK_FIELDS,
+	    sizeof *regexes)) == NULL ||
+	    (patterns = calloc(nrules * SWM_QUIRK_FIELDS, 32)) == NULL)
+		err(1, "calloc");
+
+	for (i = 0; i < nrules; i++) {
+		p = patterns + i * SWM_QUIRK_FIELDS * 32;
+
+		/* 70% literal, 15% prefix, 10% alternation, 5% any. */
+		switch (i % 20) {
+		case 0:
+			snprintf(p, 32, ".*");
+			break;
+		case 1: case 2:
+			snprintf(p, 32, "(Gtk|Qt)App%d", i);
+			break;
+		case 3: case 4: case 5:
+			snprintf(p, 32, "Tool%d.*", i);
+			break;
+		default:
+			snprintf(p, 32, "App%d", i);
+		}
+		snprintf(p + 32, 32, i % 2 ? ".*" : "inst%d", i);
+		snprintf(p + 64, 32, i % 5 ? ".*" : ".*Dialog.*");
+
+		for (j = 0; j < SWM_QUIRK_FIELDS; j++) {
+			rules[i].pattern[j] = p + j * 32;
+			snprintf(buf, sizeof buf, "^%s$", p + j * 32);
+			if (regcomp(&regexes[i * SWM_QUIRK_FIELDS + j], buf,
+			    REG_EXTENDED | REG_NOSUB))
+				errx(1, "regcomp %s", buf);
+			rules[i].regex[j] = &regexes[i * SWM_QUIRK_FIELDS + j];
+		}
+		rules[i].quirk = 1 << (i % 13);
+		rules[i].ws = i % 10 == 7 ? i % SWMQ_WS_LIMIT : -1;
+	}
+}
+
+/* Windows of the quirked applications, plus some nobody has a quirk for. */
+void
+windows_init(void)
+{
+	struct swmq_window	*w;
+	int			i, r;
+
+	srandom(1);
+	for (i = 0; i < SWMQ_WINDOWS; i++) {
+		w = &windows[i];
+		r = random() % nrules;
+		switch (i % 4) {
+		case 0:
+			snprintf(w->class, sizeof w->class, "Unknown%d", i);
+			break;
+		case 1:
+			snprintf(w->class, sizeof w->class, "Tool%d-bin",
+			    r - r % 20 + 3);
+			break;
+		default:
+			snprintf(w->class, sizeof w->class, "App%d",
+			    r - r % 20 + 10);
+		}
+		snprintf(w->instance, sizeof w->instance, "inst%d",
+		    r - r % 2);
+		snprintf(w->name, sizeof w->name, i % 3 ? "Terminal" :
+		    "Open Dialog");
+	}
+}
+
+/* Every rule, first to last, as manage_window did. */
+void
+naive(const struct swmq_window *w, const char *name,
+    struct swm_quirk_result *res)
+{
+	int			i;
+
+	res->quirk = 0;
+	res->ws = -1;
+	res->rule = -1;
+	for (i = 0; i < nrules; i++) {
+		if (regexec(rules[i].regex[SWM_QUIRK_CLASS], w->class, 0,
+		    NULL, 0) == 0 &&
+		    regexec(rules[i].regex[SWM_QUIRK_INSTANCE], w->instance,
+		    0, NULL, 0) == 0 &&
+		    regexec(rules[i].regex[SWM_QUIRK_NAME], name, 0,
+		    NULL, 0) == 0) {
+			res->quirk = rules[i].quirk;
+			res->rule = i;
+			if (rules[i].ws >= 0 && rules[i].ws < SWMQ_WS_LIMIT)
+				res->ws = rules[i].ws;
+		}
+	}
+}
+
+/*
+ * Average ns per window: 0 the old way, 1 through the matcher with a new title
+ * every time, 2 through the matcher with titles repeating.
+ */
+double
+run(int mode)
+{
+	struct swm_quirk_matcher	*m;
+	struct swm_quirk_result		res, check;
+	const struct swmq_window	*w;
+	uint64_t			start, elapsed;
+	unsigned long			iter, calls = 0;
+	char				name[96];
+
+	if ((m = quirk_matcher_new(rules, nrules)) == NULL)
+		err(1, "quirk_matcher_new");
+
+	iter = 1;
+	start = now_nsec();
+	do {
+		for (; calls < iter; calls++) {
+			w = &windows[calls % SWMQ_WINDOWS];
+			if (mode == 1)
+				snprintf(name, sizeof name, "%s %lu", w->name,
+				    serial++);
+			else
+				snprintf(name, sizeof name, "%s", w->name);
+
+			if (mode == 0)
+				naive(w, name, &res);
+			else
+				quirk_match(m, w->class, w->instance, name,
+				    SWMQ_WS_LIMIT, &res);
+		}
+		iter *= 2;
+	} while ((elapsed = now_nsec() - start) < SWMQ_MIN_NSEC);
+
+	/* Outside the timing: the answers must not change. */
+	if (mode != 0)
+		for (iter = 0; iter < SWMQ_WINDOWS; iter++) {
+			w = &windows[iter];
+			naive(w, w->name, &check);
+			quirk_match(m, w->class, w->instance, w->name,
+			    SWMQ_WS_LIMIT, &res);
+			if (res.quirk != check.quirk || res.ws != check.ws ||
+			    res.rule != check.rule) {
+				warnx("%s:%s:%s: rule %d ws %d, expected "
+				    "rule %d ws %d", w->class, w->instance,
+				    w->name, res.rule, res.ws, check.rule,
+				    check.ws);
+				mismatches++;
+			}
+		}
+
+	quirk_matcher_free(m);
+
+	return ((double)elapsed / calls);
+}
+
+void
+report(const char *name, double ns)
+{
+	fprintf(out, SWMQ_FMT "\n", name, nrules, ns);
+}
+
+void
+usage(void)
+{
+	fprintf(stderr, "usage: swmquirk [-n quirks] [-o file]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int			ch;
+
+	out = stdout;
+	while ((ch = getopt(argc, argv, "n:o:")) != -1) {
+		switch (ch) {
+		case 'n':
+			nrules = atoi(optarg);
+			if (nrules < 1)
+				usage();
+			break;
+		case 'o':
+			if ((out = fopen(optarg, "w")) == NULL)
+				err(1, "%s", optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	rules_init();
+	windows_init();
+
+	report("regexec", run(0));
+	report("matcher", run(1));
+	report("cached", run(2));
+
+	if (out != stdout)
+		fclose(out);
+
+	return (mismatches != 0);
+}
@@ -0,0 +1,388 @@
+/*
+ * swmrec - summarize event recordings written by spectrwm's event_record.
+ *
+ * Reads one or more recordings (e.g. rec.1 rec, oldest first) and reports
+ *
+ *	rates		events per second, average and peak
+ *	bursts		windows of -w ms holding at least -n events
+ *	event kinds	count, handler time and round trips, most expensive first
+ *	windows		the windows that produced the most events, by file and
+ *			index, as indices start over in each file
+ *	atoms		the most frequently changed properties
+ */
+#include <sys/types.h>
+
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../record.h"
+
+#define SWMR_TYPES		(256)
+#define SWMR_ATOM_NAMELEN	(64)
+#define SWMR_PROPERTY_NOTIFY	(28)
+
+struct swmr_kind {
+	uint64_t		count;
+	uint64_t		usec;
+	uint64_t		usec_max;
+	uint64_t		rtt;
+};
+
+struct swmr_count {
+	uint32_t		file;		/* index in files, for windows */
+	uint32_t		id;
+	uint64_t		count;
+	uint64_t		usec;
+};
+
+struct swmr_atom {
+	uint32_t		atom;
+	char			name[SWMR_ATOM_NAMELEN];
+};
+
+/* Core protocol event names, by type. */
+const char		*event_names[] = {
+	"Error", "Reply", "KeyPress", "KeyRelease", "ButtonPress",
+	"ButtonRelease", "MotionNotify", "EnterNotify", "LeaveNotify",
+	"FocusIn", "FocusOut", "KeymapNotify", "Expose", "GraphicsExpose",
+	"NoExpose", "VisibilityNotify", "CreateNotify", "DestroyNotify",
+	"UnmapNotify", "MapNotify", "MapRequest", "ReparentNotify",
+	"ConfigureNotify", "ConfigureRequest", "GravityNotify",
+	"ResizeRequest", "CirculateNotify", "CirculateRequest",
+	"PropertyNotify", "SelectionClear", "SelectionRequest",
+	"SelectionNotify", "ColormapNotify", "ClientMessage", "MappingNotify",
+	"GenericEvent",
+};
+
+/* Predefined atoms, see the X protocol. */
+const char		*atom_names[] = {
+	NULL, "PRIMARY", "SECONDARY", "ARC", "ATOM", "BITMAP", "CARDINAL",
+	"COLORMAP", "CURSOR", "CUT_BUFFER0", "CUT_BUFFER1", "CUT_BUFFER2",
+	"CUT_BUFFER3", "CUT_BUFFER4", "CUT_BUFFER5", "CUT_BUFFER6",
+	"CUT_BUFFER7", "DRAWABLE", "FONT", "INTEGER", "PIXMAP", "POINT",
+	"RECTANGLE", "RESOURCE_MANAGER", "RGB_COLOR_MAP", "RGB_BEST_MAP",
+	"RGB_BLUE_MAP", "RGB_DEFAULT_MAP", "RGB_GRAY_MAP", "RGB_GREEN_MAP",
+	"RGB_RED_MAP", "STRING", "VISUALID", "WINDOW", "WM_COMMAND",
+	"WM_HINTS", "WM_CLIENT_MACHINE", "WM_ICON_NAME", "WM_ICON_SIZE",
+	"WM_NAME", "WM_NORMAL_HINTS", "WM_SIZE_HINTS", "WM_ZOOM_HINTS",
+	"MIN_SPACE", "NORM_SPACE", "MAX_SPACE", "END_SPACE", "SUPERSCRIPT_X",
+	"SUPERSCRIPT_Y", "SUBSCRIPT_X", "SUBSCRIPT_Y", "UNDERLINE_POSITION",
+	"UNDERLINE_THICKNESS", "STRIKEOUT_ASCENT", "STRIKEOUT_DESCENT",
+	"ITALIC_ANGLE", "X_HEIGHT", "QUAD_WIDTH", "WEIGHT", "POINT_SIZE",
+	"RESOLUTION", "COPYRIGHT", "NOTICE", "FONT_NAME", "FAMILY_NAME",
+	"FULL_NAME", "CAP_HEIGHT", "WM_CLASS", "WM_TRANSIENT_FOR",
+};
+
+struct swmr_kind	kinds[SWMR_TYPES];
+struct swmr_count	*wins, *atoms;
+size_t			nwins, nwins_size, natoms, natoms_size;
+struct swmr_atom	*atom_defs;
+size_t			natom_defs, natom_defs_size;
+
+uint64_t		total, first, last;
+uint64_t		sec_start, sec_count, sec_peak;
+uint64_t		*window;		/* start times of recent events */
+size_t			window_head, window_len;
+uint64_t		bursts, burst_size, burst_max, burst_end;
+
+char			**files;
+int			nfiles, cur_file;
+
+int			burst_ms = 100;
+int			burst_events = 50;
+int			top = 10;
+
+const char	*atom_name(uint32_t);
+void		 atom_define(uint32_t, const char *);
+int		 count_cmp(const void *, const void *);
+void		 count_add(struct swmr_count **, size_t *, size_t *, uint32_t,
+		    uint32_t, uint32_t);
+const char	*event_name(uint8_t, char *, size_t);
+int		 kind_cmp(const void *, const void *);
+void		 process(const struct swm_rec *);
+void		 read_file(const char *);
+void		 report(void);
+void		 usage(void);
+
+const char *
+atom_name(uint32_t atom)
+{
+	static char		buf[16];
+	size_t			i;
+
+	for (i = 0; i < natom_defs; i++)
+		if (atom_defs[i].atom == atom)
+			return (atom_defs[i].name);
+	if (atom < sizeof atom_names / sizeof atom_names[0] &&
+	    atom_names[atom])
+		return (atom_names[atom]);
+	snprintf(buf, sizeof buf, "atom %u", atom);
+	return (buf);
+}
+
+void
+atom_define(uint32_t atom, const char *name)
+{
+	size_t			i;
+
+	for (i = 0; i < natom_defs; i++)
+		if (atom_defs[i].atom == atom)
+			return;
+	if (natom_defs == natom_defs_size) {
+		natom_defs_size = natom_defs_size ? natom_defs_size * 2 : 64;
+		if ((atom_defs = realloc(atom_defs,
+		    natom_defs_size * sizeof *atom_defs)) == NULL)
+			err(1, "realloc");
+	}
+	atom_defs[natom_defs].atom = atom;
+	strncpy(atom_defs[natom_defs].name, name, SWMR_ATOM_NAMELEN - 1);
+	atom_defs[natom_defs].name[SWMR_ATOM_NAMELEN - 1] = '\0';
+	natom_defs++;
+}
+
+const char *
+event_name(uint8_t type, char *buf, size_t sz)
+{
+	if (type < sizeof event_names / sizeof event_names[0])
+		return (event_names[type]);
+	snprintf(buf, sz, "extension %u", type);
+	return (buf);
+}
+
+/* Linear search is fine: recordings rarely exceed a few thousand windows. */
+void
+count_add(struct swmr_count **c, size_t *n, size_t *size, uint32_t file,
+    uint32_t id, uint32_t usec)
+{
+	size_t			i;
+
+	for (i = 0; i < *n; i++)
+		if ((*c)[i].id == id && (*c)[i].file == file)
+			break;
+	if (i == *n) {
+		if (*n == *size) {
+			*size = *size ? *size * 2 : 256;
+			if ((*c = realloc(*c, *size * sizeof **c)) == NULL)
+				err(1, "realloc");
+		}
+		(*c)[i].file = file;
+		(*c)[i].id = id;
+		(*c)[i].count = 0;
+		(*c)[i].usec = 0;
+		(*n)++;
+	}
+	(*c)[i].count++;
+	(*c)[i].usec += usec;
+}
+
+int
+count_cmp(const void *a, const void *b)
+{
+	const struct swmr_count	*x = a, *y = b;
+
+	return (x->count < y->count ? 1 : x->count > y->count ? -1 : 0);
+}
+
+int
+kind_cmp(const void *a, const void *b)
+{
+	const struct swmr_kind	*x = &kinds[*(const int *)a];
+	const struct swmr_kind	*y = &kinds[*(const int *)b];
+
+	return (x->usec < y->usec ? 1 : x->usec > y->usec ? -1 : 0);
+}
+
+void
+process(const struct swm_rec *r)
+{
+	struct swmr_kind	*k = &kinds[r->type];
+
+	if (total == 0)
+		first = sec_start = r->start;
+	last = r->start;
+	total++;
+
+	k->count++;
+	k->usec += r->usec;
+	k->rtt += r->rtt;
+	if (r->usec > k->usec_max)
+		k->usec_max = r->usec;
+
+	if (r->win)
+		count_add(&wins, &nwins, &nwins_size, cur_file, r->win,
+		    r->usec);
+	if (r->atom && r->type == SWMR_PROPERTY_NOTIFY)
+		count_add(&atoms, &natoms, &natoms_size, 0, r->atom, r->usec);
+
+	/* Events per second. */
+	if (r->start - sec_start >= 1000000) {
+		sec_start = r->start;
+		sec_count = 0;
+	}
+	if (++sec_count > sec_peak)
+		sec_peak = sec_count;
+
+	/* Sliding window of burst_ms; a burst ends when it drains. */
+	while (window_len && r->start - window[window_head] >=
+	    (uint64_t)burst_ms * 1000) {
+		window_head = (window_head + 1) % burst_events;
+		window_len--;
+	}
+	if (window_len == (size_t)burst_events) {
+		window_head = (window_head + 1) % burst_events;
+		window_len--;
+	}
+	window[(window_head + window_len) % burst_events] = r->start;
+	window_len++;
+
+	if (window_len == (size_t)burst_events) {
+		if (r->start > burst_end) {
+			bursts++;
+			burst_size = burst_events - 1;
+		}
+		burst_end = r->start + (uint64_t)burst_ms * 1000;
+	}
+	if (bursts && r->start <= burst_end && ++burst_size > burst_max)
+		burst_max = burst_size;
+}
+
+void
+read_file(const char *path)
+{
+	struct swm_rec_header	hdr;
+	struct swm_rec		rec;
+	char			name[SWMR_ATOM_NAMELEN + sizeof rec];
+	FILE			*f;
+	size_t			len;
+
+	if ((f = fopen(path, "r")) == NULL)
+		err(1, "%s", path);
+	if (fread(&hdr, sizeof hdr, 1, f) != 1 ||
+	    strncmp(hdr.magic, SWM_REC_MAGIC, sizeof hdr.magic) ||
+	    hdr.version != SWM_REC_VERSION || hdr.rec_size != sizeof rec)
+		errx(1, "%s: not a spectrwm event recording", path);
+
+	while (fread(&rec, sizeof rec, 1, f) == 1) {
+		if (rec.type != SWM_REC_ATOM) {
+			process(&rec);
+			continue;
+		}
+		len = rec.rtt + sizeof rec - rec.rtt % sizeof rec;
+		if (len > sizeof name) {
+			fseek(f, len, SEEK_CUR);
+			continue;
+		}
+		if (fread(name, len, 1, f) != 1)
+			break;
+		name[sizeof name - 1] = '\0';
+		atom_define(rec.atom, name);
+	}
+	fclose(f);
+}
+
+void
+report(void)
+{
+	int			order[SWMR_TYPES];
+	char			buf[32], label[64];
+	double			secs;
+	size_t			i;
+	int			t;
+
+	if (total == 0) {
+		printf("no events\n");
+		return;
+	}
+
+	secs = (last - first) / 1e6;
+	printf("%llu events in %.1f s, %.1f/s average, %llu/s peak\n",
+	    (unsigned long long)total, secs, secs > 0 ? total / secs : 0.0,
+	    (unsigned long long)sec_peak);
+	printf("%llu bursts of >= %d events in %d ms, largest %llu events\n",
+	    (unsigned long long)bursts, burst_events, burst_ms,
+	    (unsigned long long)burst_max);
+
+	for (t = 0; t < SWMR_TYPES; t++)
+		order[t] = t;
+	qsort(order, SWMR_TYPES, sizeof order[0], kind_cmp);
+	printf("\n%-20s %10s %12s %8s %8s %8s\n", "event", "count",
+	    "total ms", "avg us", "max us", "rtt/n");
+	for (t = 0; t < SWMR_TYPES && kinds[order[t]].count; t++)
+		printf("%-20s %10llu %12.1f %8llu %8llu %8.2f\n",
+		    event_name(order[t], buf, sizeof buf),
+		    (unsigned long long)kinds[order[t]].count,
+		    kinds[order[t]].usec / 1e3,
+		    (unsigned long long)(kinds[order[t]].usec /
+		    kinds[order[t]].count),
+		    (unsigned long long)kinds[order[t]].usec_max,
+		    (double)kinds[order[t]].rtt / kinds[order[t]].count);
+
+	qsort(wins, nwins, sizeof *wins, count_cmp);
+	printf("\n%-20s %10s %12s\n", "window", "events", "total ms");
+	for (i = 0; i < nwins && i < (size_t)top; i++) {
+		if (nfiles > 1)
+			snprintf(label, sizeof label, "%s #%u",
+			    files[wins[i].file], wins[i].id);
+		else
+			snprintf(label, sizeof label, "#%u", wins[i].id);
+		printf("%-20s %10llu %12.1f\n", label,
+		    (unsigned long long)wins[i].count, wins[i].usec / 1e3);
+	}
+
+	qsort(atoms, natoms, sizeof *atoms, count_cmp);
+	printf("\n%-32s %10s %12s\n", "property", "changes", "total ms");
+	for (i = 0; i < natoms && i < (size_t)top; i++)
+		printf("%-32s %10llu %12.1f\n", atom_name(atoms[i].id),
+		    (unsigned long long)atoms[i].count, atoms[i].usec / 1e3);
+}
+
+void
+usage(void)
+{
+	fprintf(stderr, "usage: swmrec [-n burst_events] [-t top] "
+	    "[-w burst_ms] file ...\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int			ch;
+
+	while ((ch = getopt(argc, argv, "n:t:w:")) != -1) {
+		switch (ch) {
+		case 'n':
+			burst_events = atoi(optarg);
+			break;
+		case 't':
+			top = atoi(optarg);
+			break;
+		case 'w':
+			burst_ms = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc == 0 || burst_events <= 1 || burst_ms <= 0 || top < 0)
+		usage();
+
+	if ((window = calloc(burst_events, sizeof *window)) == NULL)
+		err(1, "calloc");
+
+	files = argv;
+	nfiles = argc;
+	for (cur_file = 0; cur_file < nfiles; cur_file++)
+		read_file(files[cur_file]);
+	report();
+
+	return (0);
+}
@@ -0,0 +1,557 @@
+/*
+ * swmstorm - bursty client load generator for spectrwm.
+ *
+ * Creates, maps, retitles, flags urgent, reparents and destroys top-level
+ * windows at configurable rates and watches how fast the window manager keeps
+ * up.  A share of the new windows can be made transient for a live one, like
+ * an IDE popping up and tearing down dialogs.  Progress is observed without
+ * any help from spectrwm:
+ *
+ *	manage lag	XMapWindow until MapNotify (maprequest, manage_window,
+ *			stack and map_window have all run)
+ *	unmanage lag	XDestroyWindow/XReparentWindow until the frame spectrwm
+ *			put around the window is destroyed (destroynotify or
+ *			unmapnotify, unmanage_window)
+ *	queue depth	windows waiting on either of the above
+ *	focus		mapped windows that never received FocusIn, and whether
+ *			focus rests on a live window once the storm is over
+ *
+ * The summary is written as a single JSON object.
+ */
+#include <sys/types.h>
+
+#include <err.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <xcb/xcb.h>
+
+#define SWMS_DRAIN_MS		(10000)
+#define SWMS_URGENCY_HINT	(1 << 8)	/* ICCCM XUrgencyHint */
+#define SWMS_HINTS_LEN		(9)
+
+enum {
+	SWMS_FREE,
+	SWMS_MAPPING,		/* map sent, no MapNotify yet */
+	SWMS_MAPPED,
+	SWMS_UNMANAGING,	/* destroyed or reparented, frame still alive */
+};
+
+struct swms_win {
+	xcb_window_t		id;
+	xcb_window_t		frame;
+	int			state;
+	bool			focused;
+	bool			urgent;
+	bool			embedded;	/* reparented into another win */
+	uint64_t		t_map;
+	uint64_t		t_unmanage;
+	uint64_t		t_expire;	/* destroy when reached */
+};
+
+struct swms_lat {
+	uint64_t		*v;
+	size_t			n, size;
+};
+
+struct swms_rate {
+	double			per_sec;
+	double			tokens;
+	unsigned long		done;
+};
+
+xcb_connection_t	*conn;
+xcb_screen_t		*screen;
+xcb_atom_t		a_net_wm_name, a_utf8_string;
+
+struct swms_win		*wins;
+int			max_live = 256;
+int			lifetime_ms = 2000;
+int			burst = 0;
+int			transient_pct = 0;
+
+struct swms_rate	r_create, r_retitle, r_urgent, r_reparent;
+struct swms_lat		lat_manage, lat_unmanage;
+unsigned long		destroyed, never_focused, transients;
+int			depth, depth_max;
+double			depth_sum;
+unsigned long		depth_samples;
+
+void		 lat_add(struct swms_lat *, uint64_t);
+int		 lat_cmp(const void *, const void *);
+void		 lat_print(FILE *, const char *, struct swms_lat *);
+struct swms_win	*win_alloc(void);
+void		 win_create(uint64_t);
+void		 win_destroy(struct swms_win *, uint64_t);
+struct swms_win	*win_find(xcb_window_t);
+struct swms_win	*win_find_frame(xcb_window_t);
+struct swms_win	*win_pick(void);
+void		 win_reparent(uint64_t);
+void		 win_retitle(void);
+void		 win_urgent(void);
+void		 handle_event(xcb_generic_event_t *, uint64_t);
+void		 pump(int);
+uint64_t	 now_usec(void);
+xcb_atom_t	 intern(const char *);
+void		 usage(void);
+
+uint64_t
+now_usec(void)
+{
+	struct timespec		ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+xcb_atom_t
+intern(const char *name)
+{
+	xcb_intern_atom_reply_t	*r;
+	xcb_atom_t		atom = XCB_ATOM_NONE;
+
+	r = xcb_intern_atom_reply(conn,
+	    xcb_intern_atom(conn, 0, strlen(name), name), NULL);
+	if (r) {
+		atom = r->atom;
+		free(r);
+	}
+	return (atom);
+}
+
+void
+lat_add(struct swms_lat *l, uint64_t usec)
+{
+	if (l->n == l->size) {
+		l->size = l->size ? l->size * 2 : 1024;
+		if ((l->v = realloc(l->v, l->size * sizeof *l->v)) == NULL)
+			err(1, "realloc");
+	}
+	l->v[l->n++] = usec;
+}
+
+int
+lat_cmp(const void *a, const void *b)
+{
+	uint64_t		x = *(const uint64_t *)a;
+	uint64_t		y = *(const uint64_t *)b;
+
+	return (x < y ? -1 : x > y);
+}
+
+void
+lat_print(FILE *f, const char *name, struct swms_lat *l)
+{
+	if (l->n == 0) {
+		fprintf(f, "\"%s\":{\"n\":0}", name);
+		return;
+	}
+	qsort(l->v, l->n, sizeof *l->v, lat_cmp);
+	fprintf(f, "\"%s\":{\"n\":%zu,\"p50_us\":%llu,\"p95_us\":%llu,"
+	    "\"p99_us\":%llu,\"max_us\":%llu}", name, l->n,
+	    (unsigned long long)l->v[l->n / 2],
+	    (unsigned long long)l->v[l->n * 95 / 100],
+	    (unsigned long long)l->v[l->n * 99 / 100],
+	    (unsigned long long)l->v[l->n - 1]);
+}
+
+struct swms_win *
+win_alloc(void)
+{
+	int			i;
+
+	for (i = 0; i < max_live; i++)
+		if (wins[i].state == SWMS_FREE)
+			return (&wins[i]);
+	return (NULL);
+}
+
+struct swms_win *
+win_find(xcb_window_t id)
+{
+	int			i;
+
+	for (i = 0; i < max_live; i++)
+		if (wins[i].state != SWMS_FREE && wins[i].id == id)
+			return (&wins[i]);
+	return (NULL);
+}
+
+struct swms_win *
+win_find_frame(xcb_window_t frame)
+{
+	int			i;
+
+	for (i = 0; i < max_live; i++)
+		if (wins[i].state != SWMS_FREE && wins[i].frame == frame)
+			return (&wins[i]);
+	return (NULL);
+}
+
+/* A random mapped, top-level window. */
+struct swms_win *
+win_pick(void)
+{
+	int			i, start;
+
+	start = random() % max_live;
+	for (i = 0; i < max_live; i++)
+		if (wins[(start + i) % max_live].state == SWMS_MAPPED &&
+		    !wins[(start + i) % max_live].embedded)
+			return (&wins[(start + i) % max_live]);
+	return (NULL);
+}
+
+void
+win_create(uint64_t now)
+{
+	struct swms_win		*w, *parent = NULL;
+	uint32_t		val[2];
+	char			name[32];
+
+	/* Pick the parent first; win_pick() only sees mapped windows. */
+	if (transient_pct && random() % 100 < transient_pct)
+		parent = win_pick();
+	if ((w = win_alloc()) == NULL)
+		return;
+
+	memset(w, 0, sizeof *w);
+	w->id = xcb_generate_id(conn);
+	val[0] = screen->white_pixel;
+	val[1] = XCB_EVENT_MASK_STRUCTURE_NOTIFY |
+	    XCB_EVENT_MASK_FOCUS_CHANGE;
+	xcb_create_window(conn, XCB_COPY_FROM_PARENT, w->id, screen->root,
+	    0, 0, 200, 100, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+	    screen->root_visual, XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK, val);
+	snprintf(name, sizeof name, "swmstorm %lu", r_create.done);
+	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, w->id,
+	    XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 8, strlen(name), name);
+	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, w->id,
+	    XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 8, sizeof("swmstorm\0SwmStorm"),
+	    "swmstorm\0SwmStorm");
+	if (parent)
+		xcb_change_property(conn, XCB_PROP_MODE_REPLACE, w->id,
+		    XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 32, 1,
+		    &parent->id);
+	xcb_map_window(conn, w->id);
+
+	w->state = SWMS_MAPPING;
+	w->t_map = now;
+	w->t_expire = now + (uint64_t)lifetime_ms * 1000;
+	depth++;
+	r_create.done++;
+	if (parent)
+		transients++;
+}
+
+void
+win_destroy(struct swms_win *w, uint64_t now)
+{
+	if (w->state == SWMS_MAPPING)
+		depth--;
+	/* win_reparent() already counted embedded windows. */
+	if (w->state == SWMS_MAPPED && !w->focused && !w->embedded)
+		never_focused++;
+
+	xcb_destroy_window(conn, w->id);
+	destroyed++;
+
+	/* Embedded windows were already unmanaged; just forget them. */
+	if (w->frame == XCB_WINDOW_NONE || w->embedded) {
+		if (w->state != SWMS_UNMANAGING)
+			w->state = SWMS_FREE;
+		return;
+	}
+
+	w->state = SWMS_UNMANAGING;
+	w->t_unmanage = now;
+	depth++;
+}
+
+void
+win_retitle(void)
+{
+	struct swms_win		*w;
+	char			name[64];
+
+	if ((w = win_pick()) == NULL)
+		return;
+
+	snprintf(name, sizeof name, "swmstorm %#x title %lu", w->id,
+	    r_retitle.done);
+	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, w->id,
+	    XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 8, strlen(name), name);
+	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, w->id,
+	    a_net_wm_name, a_utf8_string, 8, strlen(name), name);
+	r_retitle.done++;
+}
+
+void
+win_urgent(void)
+{
+	struct swms_win		*w;
+	uint32_t		hints[SWMS_HINTS_LEN];
+
+	if ((w = win_pick()) == NULL)
+		return;
+
+	memset(hints, 0, sizeof hints);
+	w->urgent = !w->urgent;
+	hints[0] = w->urgent ? SWMS_URGENCY_HINT : 0;
+	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, w->id,
+	    XCB_ATOM_WM_HINTS, XCB_ATOM_WM_HINTS, 32, SWMS_HINTS_LEN, hints);
+	r_urgent.done++;
+}
+
+/* Embed one top-level window into another, like a dock or tab bar would. */
+void
+win_reparent(uint64_t now)
+{
+	struct swms_win		*child, *parent;
+
+	if ((child = win_pick()) == NULL || (parent = win_pick()) == NULL ||
+	    child == parent)
+		return;
+
+	if (!child->focused)
+		never_focused++;
+	xcb_reparent_window(conn, child->id, parent->id, 0, 0);
+	child->embedded = true;
+	child->state = SWMS_UNMANAGING;
+	child->t_unmanage = now;
+	depth++;
+	r_reparent.done++;
+}
+
+void
+handle_event(xcb_generic_event_t *evt, uint64_t now)
+{
+	struct swms_win		*w;
+
+	switch (evt->response_type & ~0x80) {
+	case XCB_REPARENT_NOTIFY:
+		w = win_find(((xcb_reparent_notify_event_t *)evt)->window);
+		if (w && !w->embedded)
+			w->frame = ((xcb_reparent_notify_event_t *)evt)->parent;
+		break;
+	case XCB_MAP_NOTIFY:
+		w = win_find(((xcb_map_notify_event_t *)evt)->window);
+		if (w && w->state == SWMS_MAPPING) {
+			lat_add(&lat_manage, now - w->t_map);
+			w->state = SWMS_MAPPED;
+			depth--;
+		}
+		break;
+	case XCB_FOCUS_IN:
+		w = win_find(((xcb_focus_in_event_t *)evt)->event);
+		if (w)
+			w->focused = true;
+		break;
+	case XCB_DESTROY_NOTIFY:
+		/* Frames are children of the root, see SubstructureNotify. */
+		w = win_find_frame(((xcb_destroy_notify_event_t *)evt)->window);
+		if (w && w->state == SWMS_UNMANAGING) {
+			lat_add(&lat_unmanage, now - w->t_unmanage);
+			w->frame = XCB_WINDOW_NONE;
+			depth--;
+			if (!w->embedded)
+				w->state = SWMS_FREE;
+			else
+				w->state = SWMS_MAPPED;	/* destroy it later */
+		}
+		break;
+	}
+}
+
+/* Process events, waiting at most timeout ms for the first one. */
+void
+pump(int timeout)
+{
+	struct pollfd		pfd;
+	xcb_generic_event_t	*evt;
+
+	xcb_flush(conn);
+	pfd.fd = xcb_get_file_descriptor(conn);
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, timeout) == -1 && errno != EINTR)
+		err(1, "poll");
+
+	while ((evt = xcb_poll_for_event(conn))) {
+		handle_event(evt, now_usec());
+		free(evt);
+	}
+	if (xcb_connection_has_error(conn))
+		errx(1, "X connection lost");
+}
+
+void
+usage(void)
+{
+	fprintf(stderr, "usage: swmstorm [-b burst] [-c creates/s] "
+	    "[-d seconds] [-l lifetime_ms]\n"
+	    "                [-m max_live] [-p reparents/s] "
+	    "[-T transient%%] [-t retitles/s]\n"
+	    "                [-u urgency/s]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct swms_rate	*rates[4];
+	xcb_get_input_focus_reply_t *fr;
+	uint64_t		now, last, start, end, drain;
+	uint32_t		val[1];
+	double			dt;
+	bool			focus_ok = false;
+	int			ch, i, duration = 10;
+
+	r_create.per_sec = 50;
+	r_retitle.per_sec = 100;
+	r_urgent.per_sec = 10;
+	r_reparent.per_sec = 2;
+
+	while ((ch = getopt(argc, argv, "b:c:d:l:m:p:T:t:u:")) != -1) {
+		switch (ch) {
+		case 'b':
+			burst = atoi(optarg);
+			break;
+		case 'c':
+			r_create.per_sec = atof(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'l':
+			lifetime_ms = atoi(optarg);
+			break;
+		case 'm':
+			max_live = atoi(optarg);
+			break;
+		case 'p':
+			r_reparent.per_sec = atof(optarg);
+			break;
+		case 'T':
+			transient_pct = atoi(optarg);
+			break;
+		case 't':
+			r_retitle.per_sec = atof(optarg);
+			break;
+		case 'u':
+			r_urgent.per_sec = atof(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (duration <= 0 || max_live <= 0 || lifetime_ms < 0 || burst < 0 ||
+	    transient_pct < 0 || transient_pct > 100)
+		usage();
+
+	if ((wins = calloc(max_live, sizeof *wins)) == NULL)
+		err(1, "calloc");
+
+	conn = xcb_connect(NULL, NULL);
+	if (xcb_connection_has_error(conn))
+		errx(1, "can not open display");
+	screen = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
+	a_net_wm_name = intern("_NET_WM_NAME");
+	a_utf8_string = intern("UTF8_STRING");
+
+	/* Watch frames come and go; allowed alongside the WM's redirect. */
+	val[0] = XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY;
+	xcb_change_window_attributes(conn, screen->root, XCB_CW_EVENT_MASK,
+	    val);
+
+	rates[0] = &r_create;
+	rates[1] = &r_retitle;
+	rates[2] = &r_urgent;
+	rates[3] = &r_reparent;
+
+	srandom(getpid());
+	start = last = now_usec();
+	end = start + (uint64_t)duration * 1000000;
+
+	/* A burst arrives all at once, like a dashboard opening its views. */
+	for (i = 0; i < burst; i++)
+		win_create(start);
+
+	while ((now = now_usec()) < end) {
+		dt = (now - last) / 1e6;
+		last = now;
+		for (i = 0; i < 4; i++)
+			rates[i]->tokens += rates[i]->per_sec * dt;
+
+		for (; r_create.tokens >= 1; r_create.tokens--)
+			win_create(now);
+		for (; r_retitle.tokens >= 1; r_retitle.tokens--)
+			win_retitle();
+		for (; r_urgent.tokens >= 1; r_urgent.tokens--)
+			win_urgent();
+		for (; r_reparent.tokens >= 1; r_reparent.tokens--)
+			win_reparent(now);
+
+		for (i = 0; i < max_live; i++)
+			if (wins[i].state == SWMS_MAPPED &&
+			    now >= wins[i].t_expire)
+				win_destroy(&wins[i], now);
+
+		depth_sum += depth;
+		depth_samples++;
+		if (depth > depth_max)
+			depth_max = depth;
+
+		pump(1);
+	}
+
+	/* Let spectrwm catch up, then see where focus ended up. */
+	drain = now_usec();
+	while (depth > 0 && now_usec() - drain < SWMS_DRAIN_MS * 1000)
+		pump(100);
+	drain = now_usec() - drain;
+
+	fr = xcb_get_input_focus_reply(conn, xcb_get_input_focus(conn), NULL);
+	if (fr) {
+		for (i = 0; i < max_live; i++)
+			if (wins[i].state == SWMS_MAPPED &&
+			    (fr->focus == wins[i].id ||
+			    fr->focus == wins[i].frame))
+				focus_ok = true;
+		free(fr);
+	}
+	for (i = 0; i < max_live; i++)
+		if (wins[i].state == SWMS_MAPPED && !wins[i].embedded &&
+		    !wins[i].focused)
+			never_focused++;
+
+	printf("{\"duration_s\":%d,\"burst\":%d,\"max_live\":%d,"
+	    "\"lifetime_ms\":%d,\"created\":%lu,\"transients\":%lu,"
+	    "\"destroyed\":%lu,"
+	    "\"retitled\":%lu,\"urgency\":%lu,\"reparented\":%lu,"
+	    "\"depth_max\":%d,\"depth_mean\":%.2f,\"depth_end\":%d,"
+	    "\"drain_ms\":%llu,\"never_focused\":%lu,\"focus_on_client\":%s,",
+	    duration, burst, max_live, lifetime_ms, r_create.done, transients,
+	    destroyed,
+	    r_retitle.done, r_urgent.done, r_reparent.done, depth_max,
+	    depth_samples ? depth_sum / depth_samples : 0.0, depth,
+	    (unsigned long long)(drain / 1000), never_focused,
+	    focus_ok ? "true" : "false");
+	lat_print(stdout, "manage", &lat_manage);
+	printf(",");
+	lat_print(stdout, "unmanage", &lat_unmanage);
+	printf("}\n");
+
+	for (i = 0; i < max_live; i++)
+		if (wins[i].state != SWMS_FREE)
+			xcb_destroy_window(conn, wins[i].id);
+	xcb_disconnect(conn);
+
+	return (depth > 0);
+}
@@ -0,0 +1,95 @@
+#!/bin/sh
+#
+# Drive spectrwm through a fixed, representative workload on a private Xvfb
+# server: a window storm with retitles, urgency and reparenting (swmstorm),
+# workspace switching, focus cycling, restacking and bar toggling (swmbench),
+# while an external bar script updates the status bar continuously.
+#
+# usage: workload.sh spectrwm swmbench swmstorm output
+#
+# Used both to train profile-guided builds and to compare them (see the pgo
+# target in linux/Makefile).  swmbench and swmstorm results go to output as
+# JSON lines, spectrwm's counters to output.prom and the CPU time spent by
+# spectrwm, in clock ticks, to output.cpu.
+
+[ $# -lt 4 ] && {
+	echo "usage: $0 spectrwm swmbench swmstorm output" >&2
+	exit 1
+}
+
+SPECTRWM=$(readlink -f "$1")
+SWMBENCH=$(readlink -f "$2")
+SWMSTORM=$(readlink -f "$3")
+OUT=$(readlink -f "$4")
+BENCHDIR=$(dirname "$(readlink -f "$0")")
+COUNTS=${WORKLOAD_COUNTS:-10,50,100}
+STORM=${WORKLOAD_STORM:-20}
+
+command -v Xvfb >/dev/null || { echo "$0: Xvfb not found" >&2; exit 1; }
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/swmload.XXXXXX")
+cp "$BENCHDIR/bench.conf" "$WORK/.spectrwm.conf"
+cat >>"$WORK/.spectrwm.conf" <<EOC
+clock_enabled		= 1
+bar_action		= $WORK/baraction.sh
+bar_format		= +N:+I +S +F +U <+D> +_32W +64A +V %a %b %d %T
+stats_file		= $WORK/stats.prom
+EOC
+cat >"$WORK/baraction.sh" <<'EOB'
+#!/bin/sh
+# A busy status script: several updates a second.
+i=0
+while :; do
+	i=$((i + 1))
+	echo "load $((i % 7)).$((i % 100)) mem $((i * 37 % 1000))M net $i"
+	sleep 0.05
+done
+EOB
+chmod +x "$WORK/baraction.sh"
+
+cleanup() {
+	[ -n "$WMPID" ] && kill "$WMPID" 2>/dev/null
+	[ -n "$XPID" ] && kill "$XPID" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+Xvfb -displayfd 3 -screen 0 1920x1080x24 -nolisten tcp 3>"$WORK/display" \
+    2>"$WORK/xvfb.log" &
+XPID=$!
+i=0
+while [ ! -s "$WORK/display" ]; do
+	i=$((i + 1))
+	[ $i -gt 50 ] && { echo "$0: Xvfb did not start" >&2; exit 1; }
+	sleep 0.1
+done
+DISPLAY=:$(cat "$WORK/display")
+export DISPLAY
+
+HOME="$WORK" "$SPECTRWM" 2>"$OUT.log" &
+WMPID=$!
+i=0
+while [ ! -S "$WORK/ctl.sock" ]; do
+	i=$((i + 1))
+	[ $i -gt 50 ] && { echo "$0: spectrwm did not start" >&2; exit 1; }
+	sleep 0.1
+done
+
+: >"$OUT"
+"$SWMSTORM" -d "$STORM" >>"$OUT" || exit 1
+"$SWMBENCH" -s "$WORK/ctl.sock" -n "$COUNTS" -l workload -o "$WORK/bench" ||
+    exit 1
+cat "$WORK/bench" >>"$OUT"
+
+kill -USR1 "$WMPID"
+sleep 0.5
+cp "$WORK/stats.prom" "$OUT.prom" 2>/dev/null
+# utime + stime of spectrwm itself, see proc(5).
+awk '{ print $14 + $15 }' "/proc/$WMPID/stat" >"$OUT.cpu"
+
+# Let a profiling build write its data on a clean exit.
+kill "$WMPID"
+wait "$WMPID" 2>/dev/null
+WMPID=
+exit 0
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2009-2015 Marco Peereboom <marco@peereboom.us>
+ * Copyright (c) 2011-2017 Reginald Kennedy <rk@rejii.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "layout.h"
+
+#define SWAPXY(g)	do {				\
+	int tmp;					\
+	tmp = (g)->y; (g)->y = (g)->x; (g)->x = tmp;	\
+	tmp = (g)->h; (g)->h = (g)->w; (g)->w = tmp;	\
+} while (0)
+
+void
+layout_master(const struct swm_geometry *g, const struct swm_layout_params *lp,
+    const struct swm_layout_hints *sh, int winno, struct swm_geometry *out)
+{
+	struct swm_geometry	cell, r_g = *g;
+	int			i, j = 0, s = 0, stacks;
+	int			w_inc, h_inc, w_base, h_base;
+	int			hrh = 0, extra = 0, h_slice = 0, last_h = 0;
+	int			split = 0, colno = 0;
+	int			mwin, msize = 0, mscale;
+	int			remain, missing, v_slice;
+	int			bw = lp->border_width, gap = lp->tile_gap;
+
+	/*
+	 * cell: geometry for window, including frame.
+	 * mwin: # of windows in master area.
+	 * mscale: size increment of master area.
+	 * stacks: # of stack columns
+	 */
+	if (winno <= 0)
+		return;
+
+	mwin = lp->mwin;
+	mscale = lp->msize;
+	stacks = lp->stacks;
+
+	/* Take into account size hints of first tiled window. */
+	if (lp->rot) {
+		w_inc = sh[0].width_inc;
+		w_base = sh[0].base_width;
+		SWAPXY(&r_g);
+	} else {
+		w_inc = sh[0].height_inc;
+		w_base = sh[0].base_height;
+	}
+
+	cell = r_g;
+	cell.x += bw;
+	cell.y += bw;
+
+	if (stacks > winno - mwin)
+		stacks = winno - mwin;
+	if (stacks < 1)
+		stacks = 1;
+
+	h_slice = r_g.h / SWM_H_SLICE;
+	if (mwin && winno > mwin) {
+		v_slice = r_g.w / SWM_V_SLICE;
+
+		split = mwin;
+		colno = split;
+		cell.w = v_slice * mscale;
+
+		if (w_inc > 1 && w_inc < v_slice) {
+			/* Adjust for requested size increment. */
+			remain = (cell.w - w_base) % w_inc;
+			cell.w -= remain;
+		}
+
+		msize = cell.w;
+		if (lp->flip)
+			cell.x += r_g.w - msize;
+		s = stacks;
+	} else {
+		msize = - 2 * bw;
+		colno = split = winno / stacks;
+		cell.w = ((r_g.w - (stacks * 2 * bw) + 2 * bw) / stacks);
+		s = stacks - 1;
+	}
+
+	hrh = r_g.h / colno;
+	extra = r_g.h - (colno * hrh);
+
+	for (i = 0; i < winno; i++) {
+		if (split && i == split) {
+			colno = (winno - mwin) / stacks;
+			if (s <= (winno - mwin) % stacks)
+				colno++;
+			split += colno;
+			hrh = r_g.h / colno;
+			extra = r_g.h - (colno * hrh);
+
+			if (!lp->flip)
+				cell.x += cell.w + 2 * bw + gap;
+
+			cell.w = (r_g.w - msize - (stacks * (2 * bw + gap))) /
+			    stacks;
+			if (s == 1)
+				cell.w += (r_g.w - msize -
+				    (stacks * (2 * bw + gap))) % stacks;
+
+			if (lp->flip)
+				cell.x -= cell.w + 2 * bw + gap;
+			s--;
+			j = 0;
+		}
+
+		cell.h = hrh - 2 * bw - gap;
+
+		if (lp->rot) {
+			h_inc = sh[i].width_inc;
+			h_base = sh[i].base_width;
+		} else {
+			h_inc = sh[i].height_inc;
+			h_base = sh[i].base_height;
+		}
+
+		if (j == colno - 1) {
+			cell.h = hrh + extra;
+		} else if (h_inc > 1 && h_inc < h_slice) {
+			/* adjust for window's requested size increment */
+			remain = (cell.h - h_base) % h_inc;
+			missing = h_inc - remain;
+
+			if (missing <= extra || j == 0) {
+				extra -= missing;
+				cell.h += missing;
+			} else {
+				cell.h -= remain;
+				extra += remain;
+			}
+		}
+
+		if (j == 0)
+			cell.y = r_g.y + bw;
+		else
+			cell.y += last_h + 2 * bw + gap;
+
+		/* Window coordinates exclude frame. */
+		if (lp->rot) {
+			out[i].x = cell.y;
+			out[i].y = cell.x;
+			out[i].w = cell.h;
+			out[i].h = cell.w;
+		} else
+			out[i] = cell;
+
+		if (!lp->bordered) {
+			out[i].x -= bw;
+			out[i].y -= bw;
+			out[i].w += 2 * bw;
+			out[i].h += 2 * bw;
+		}
+
+		last_h = cell.h;
+		j++;
+	}
+}
+
+void
+layout_max(const struct swm_geometry *g, bool bordered, int bw,
+    struct swm_geometry *out)
+{
+	*out = *g;
+	if (bordered) {
+		out->x += bw;
+		out->y += bw;
+	} else {
+		out->w += 2 * bw;
+		out->h += 2 * bw;
+	}
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2009-2015 Marco Peereboom <marco@peereboom.us>
+ * Copyright (c) 2011-2017 Reginald Kennedy <rk@rejii.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Tiling geometry, free of any X calls so that it can be exercised on its own
+ * (see bench/swmlayout.c).  spectrwm fills in the inputs from a workspace,
+ * computes the cells here and then configures the windows in a second pass.
+ */
+
+#ifndef SWM_LAYOUT_H
+#define SWM_LAYOUT_H
+
+#include <stdbool.h>
+
+#define SWM_H_SLICE		(32)
+#define SWM_V_SLICE		(32)
+
+struct swm_geometry {
+	int			x;
+	int			y;
+	int			w;
+	int			h;
+};
+
+/* WM_NORMAL_HINTS of a tiled window that affect its cell. */
+struct swm_layout_hints {
+	int			width_inc;
+	int			height_inc;
+	int			base_width;
+	int			base_height;
+};
+
+struct swm_layout_params {
+	int			mwin;		/* # of windows in master area */
+	int			msize;		/* master size, in slices */
+	int			stacks;		/* # of stack columns */
+	bool			rot;		/* horizontal: stack rows */
+	bool			flip;		/* master on the right/bottom */
+	bool			bordered;	/* windows get a frame border */
+	int			border_width;
+	int			tile_gap;
+};
+
+/*
+ * Compute the geometry of n tiled windows, in stacking-list order, within g.
+ * Results exclude the frame border, as with ws_win.g.
+ */
+void	layout_master(const struct swm_geometry *,
+	    const struct swm_layout_params *, const struct swm_layout_hints *,
+	    int, struct swm_geometry *);
+/* Geometry of a maximized window in g. */
+void	layout_max(const struct swm_geometry *, bool, int,
+	    struct swm_geometry *);
+
+#endif /* SWM_LAYOUT_H */
@@ -44,6 +44,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <dlfcn.h>
 #include <X11/Xlib.h>
 #include <X11/X.h>
@@ -58,7 +59,32 @@ static Window		root = None;
 static bool		xterm = false;
 static Display		*display = NULL;
 
-void	set_property(Display *, Window, char *, char *);
+/* _SWM_* environment, read once */
+#define SWM_PROPLEN	(16)
+static bool		env_loaded = false;
+static char		env_ws[SWM_PROPLEN];
+static char		env_pid[SWM_PROPLEN];
+
+/* interned atoms, valid for atom_dpy */
+static Display		*atom_dpy = NULL;
+static Atom		atom_ws = None;
+static Atom		atom_pid = None;
+
+/* call counters, dumped on exit when SWM_HACK_STATS is set */
+static struct {
+	unsigned long	create_window;
+	unsigned long	create_simple_window;
+	unsigned long	reparent_window;
+	unsigned long	app_next_event;
+	unsigned long	props_set;
+	unsigned long	props_skipped;
+	unsigned long	atoms_interned;
+} stats;
+
+void	set_property(Display *, Window, Atom, char *);
+void	set_swm_properties(Display *, Window, Window);
+void	load_env(void);
+void	dump_stats(void);
 
 #ifdef _GNU_SOURCE
 #define DLOPEN(s)	RTLD_NEXT
@@ -85,6 +111,21 @@ MyRoot(Display * dpy)
 	return root;
 }
 
+/* Is w the root of any screen, or the ENL_WM_ROOT override? */
+static bool
+IsRoot(Display *dpy, Window w)
+{
+	int			i;
+
+	if (w == MyRoot(dpy))
+		return (true);
+	for (i = 0; i < ScreenCount(dpy); i++)
+		if (w == RootWindow(dpy, i))
+			return (true);
+
+	return (false);
+}
+
 
 typedef Atom	(XIA) (Display *display, char *atom_name, Bool
 		    only_if_exists);
@@ -93,35 +134,99 @@ typedef int	(XCP) (Display *display, Window w, Atom property,
 		    Atom type, int format, int mode, unsigned char *data,
 		    int nelements);
 
-#define SWM_PROPLEN	(16)
 void
-set_property(Display *dpy, Window id, char *name, char *val)
+dump_stats(void)
+{
+	fprintf(stderr, "libswmhack.so: pid %ld: XCreateWindow %lu, "
+	    "XCreateSimpleWindow %lu, XReparentWindow %lu, XtAppNextEvent %lu, "
+	    "properties set %lu, skipped %lu, atoms interned %lu\n",
+	    (long)getpid(), stats.create_window, stats.create_simple_window,
+	    stats.reparent_window, stats.app_next_event, stats.props_set,
+	    stats.props_skipped, stats.atoms_interned);
+}
+
+/* Copy the _SWM_* environment once; it does not change after exec. */
+void
+load_env(void)
+{
+	char			*env;
+
+	if (env_loaded)
+		return;
+	env_loaded = true;
+
+	if ((env = getenv("_SWM_WS")) != NULL)
+		snprintf(env_ws, sizeof env_ws, "%s", env);
+	if ((env = getenv("_SWM_PID")) != NULL)
+		snprintf(env_pid, sizeof env_pid, "%s", env);
+	if (getenv("_SWM_XTERM_FONTADJ") != NULL) {
+		unsetenv("_SWM_XTERM_FONTADJ");
+		xterm = true;
+	}
+	if (getenv("SWM_HACK_STATS") != NULL)
+		atexit(dump_stats);
+}
+
+void
+set_property(Display *dpy, Window id, Atom atom, char *val)
 {
-	Atom			atom = 0;
-	char			prop[SWM_PROPLEN];
-	static XIA		*xia = NULL;
 	static XCP		*xcp = NULL;
 
 	if (lib_xlib == NULL)
 		lib_xlib = DLOPEN("libX11.so");
-	if (lib_xlib) {
-		if (xia == NULL)
-			xia = (XIA *) dlsym(lib_xlib, "XInternAtom");
-		if (xcp == NULL)
-			xcp = (XCP *) dlsym(lib_xlib, "XChangeProperty");
+	if (lib_xlib && xcp == NULL)
+		xcp = (XCP *) dlsym(lib_xlib, "XChangeProperty");
+	if (xcp == NULL) {
+		fprintf(stderr, "libswmhack.so: ERROR: %s\n", dlerror());
+		return;
+	}
+
+	(*xcp)(dpy, id, atom, XA_STRING, 8, PropModeReplace,
+	    (unsigned char *)val, strlen(val));
+	stats.props_set++;
+}
+
+/*
+ * Tag a newly created window with the workspace and pid it was spawned from.
+ * Only top-level windows are of interest to spectrwm; toolkits can create
+ * hundreds of subwindows, so skip anything not parented to a root window.
+ */
+void
+set_swm_properties(Display *dpy, Window id, Window parent)
+{
+	static XIA		*xia = NULL;
+
+	load_env();
+
+	if (env_ws[0] == '\0' && env_pid[0] == '\0')
+		return;
+	if (!IsRoot(dpy, parent)) {
+		stats.props_skipped++;
+		return;
 	}
-	if (xia == NULL || xcp == NULL) {
+
+	if (lib_xlib == NULL)
+		lib_xlib = DLOPEN("libX11.so");
+	if (lib_xlib && xia == NULL)
+		xia = (XIA *) dlsym(lib_xlib, "XInternAtom");
+	if (xia == NULL) {
 		fprintf(stderr, "libswmhack.so: ERROR: %s\n", dlerror());
 		return;
 	}
 
+	/* Atoms are per server; intern again if the display changed. */
+	if (atom_dpy != dpy) {
+		atom_ws = (*xia)(dpy, "_SWM_WS", False);
+		atom_pid = (*xia)(dpy, "_SWM_PID", False);
+		atom_dpy = dpy;
+		stats.atoms_interned += 2;
+	}
+
 	/* Try to update the window's workspace property */
-	atom = (*xia)(dpy, name, False);
-	if (atom)
-		if (snprintf(prop, SWM_PROPLEN, "%s", val) < SWM_PROPLEN)
-			(*xcp)(dpy, id, atom, XA_STRING,
-			    8, PropModeReplace, (unsigned char *)prop,
-			    strlen((char *)prop));
+	if (atom_ws && env_ws[0] != '\0')
+		set_property(dpy, id, atom_ws, env_ws);
+	if (atom_pid && env_pid[0] != '\0')
+		set_property(dpy, id, atom_pid, env_pid);
 }
 
 typedef             Window(CWF) (Display * _display, Window _parent, int _x,
@@ -141,7 +246,6 @@ XCreateWindow(Display *dpy, Window parent, int x, int y,
    unsigned long valuemask, XSetWindowAttributes * attributes)
 {
 	static CWF	*func = NULL;
-	char		*env;
 	Window		id;
 
 	if (lib_xlib == NULL)
@@ -160,17 +264,10 @@ XCreateWindow(Display *dpy, Window parent, int x, int y,
 
 	id = (*func) (dpy, parent, x, y, width, height, border_width,
 	    depth, clss, visual, valuemask, attributes);
+	stats.create_window++;
 
-	if (id) {
-		if ((env = getenv("_SWM_WS")) != NULL)
-			set_property(dpy, id, "_SWM_WS", env);
-		if ((env = getenv("_SWM_PID")) != NULL)
-			set_property(dpy, id, "_SWM_PID", env);
-		if ((env = getenv("_SWM_XTERM_FONTADJ")) != NULL) {
-			unsetenv("_SWM_XTERM_FONTADJ");
-			xterm = true;
-		}
-	}
+	if (id)
+		set_swm_properties(dpy, id, parent);
 	return (id);
 }
 
@@ -189,7 +286,6 @@ XCreateSimpleWindow(Display *dpy, Window parent, int x, int y,
     unsigned long border, unsigned long background)
 {
 	static CSWF	*func = NULL;
-	char		*env;
 	Window		id;
 
 	if (lib_xlib == NULL)
@@ -206,17 +302,10 @@ XCreateSimpleWindow(Display *dpy, Window parent, int x, int y,
 
 	id = (*func) (dpy, parent, x, y, width, height,
 	    border_width, border, background);
+	stats.create_simple_window++;
 
-	if (id) {
-		if ((env = getenv("_SWM_WS")) != NULL)
-			set_property(dpy, id, "_SWM_WS", env);
-		if ((env = getenv("_SWM_PID")) != NULL)
-			set_property(dpy, id, "_SWM_PID", env);
-		if ((env = getenv("_SWM_XTERM_FONTADJ")) != NULL) {
-			unsetenv("_SWM_XTERM_FONTADJ");
-			xterm = true;
-		}
-	}
+	if (id)
+		set_swm_properties(dpy, id, parent);
 	return (id);
 }
 
@@ -241,6 +330,11 @@ XReparentWindow(Display *dpy, Window window, Window parent, int x, int y)
 
 	if (parent == DefaultRootWindow(dpy))
 		parent = MyRoot(dpy);
+	stats.reparent_window++;
+
+	/* A subwindow promoted to top-level needs tagging as well. */
+	if (IsRoot(dpy, parent))
+		set_swm_properties(dpy, window, parent);
 
 	return (*func) (dpy, window, parent, x, y);
 }
@@ -275,6 +369,7 @@ XtAppNextEvent(XtAppContext app_context, XEvent *event_return)
 	}
 
 	(*func) (app_context, event_return);
+	stats.app_next_event++;
 
 	/* Return here if it's not an Xterm. */
 	if (!xterm)
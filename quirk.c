@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2009-2015 Marco Peereboom <marco@peereboom.us>
+ * Copyright (c) 2011-2017 Reginald Kennedy <rk@rejii.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "quirk.h"
+
+#define SWM_QF_ANY		(0)	/* ".*" */
+#define SWM_QF_LITERAL		(1)	/* no regex syntax; strcmp */
+#define SWM_QF_REGEX		(2)	/* regexec after a prefix check */
+
+#define SWM_QUIRK_META		"\\^$.[]|()*+?{}"
+#define SWM_QUIRK_PREFIXES	(256)	/* lists by first byte of prefix */
+#define SWM_QUIRK_CACHE		(256)	/* direct mapped */
+
+struct swm_quirk_field {
+	int			kind;
+	const char		*text;
+	size_t			len;		/* of literal or prefix */
+	const regex_t		*regex;
+};
+
+struct swm_quirk_entry {
+	struct swm_quirk_field	f[SWM_QUIRK_FIELDS];
+	uint32_t		quirk;
+	int			ws;
+};
+
+struct swm_quirk_cached {
+	char			*key;		/* class\0instance\0name\0 */
+	size_t			len;
+	int			ws_limit;
+	struct swm_quirk_result	res;
+};
+
+struct swm_quirk_matcher {
+	struct swm_quirk_entry	*rules;
+	int			nrules;
+
+	/*
+	 * Candidate lists of rule indices, ascending: nexact lists of
+	 * rules with a literal class, by hash of the class, then one per
+	 * first byte of a class prefix, then one for all other rules.
+	 */
+	int			nexact;
+	int			*start;		/* nlists + 1 offsets */
+	int			*idx;
+
+	struct swm_quirk_cached	cache[SWM_QUIRK_CACHE];
+};
+
+uint32_t	quirk_hash(const char *, size_t, uint32_t);
+bool		quirk_field_match(const struct swm_quirk_field *, const char *);
+void		quirk_field_init(struct swm_quirk_field *, const char *,
+		    const regex_t *);
+int		quirk_list(const struct swm_quirk_matcher *,
+		    const struct swm_quirk_entry *);
+
+/* FNV-1a. */
+uint32_t
+quirk_hash(const char *s, size_t len, uint32_t h)
+{
+	size_t			i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)s[i];
+		h *= 16777619u;
+	}
+
+	return (h);
+}
+
+void
+quirk_field_init(struct swm_quirk_field *f, const char *pattern,
+    const regex_t *regex)
+{
+	size_t			n;
+
+	f->text = pattern;
+	f->regex = regex;
+	f->len = strlen(pattern);
+
+	if (strcmp(pattern, ".*") == 0) {
+		f->kind = SWM_QF_ANY;
+		return;
+	}
+
+	n = strcspn(pattern, SWM_QUIRK_META);
+	if (pattern[n] == '\0') {
+		f->kind = SWM_QF_LITERAL;
+		return;
+	}
+
+	/*
+	 * Anchored with ^, a match starts with the text before the first
+	 * special character, less one if that character is a quantifier.
+	 * Alternation anywhere makes the prefix meaningless.
+	 */
+	f->kind = SWM_QF_REGEX;
+	if (strchr(pattern, '|'))
+		n = 0;
+	else if (n > 0 && strchr("*?{", pattern[n]))
+		n--;
+	f->len = n;
+}
+
+bool
+quirk_field_match(const struct swm_quirk_field *f, const char *s)
+{
+	switch (f->kind) {
+	case SWM_QF_ANY:
+		return (true);
+	case SWM_QF_LITERAL:
+		return (strcmp(s, f->text) == 0);
+	default:
+		if (strncmp(s, f->text, f->len))
+			return (false);
+		return (regexec(f->regex, s, 0, NULL, 0) == 0);
+	}
+}
+
+/* Candidate list of a rule, by its class pattern. */
+int
+quirk_list(const struct swm_quirk_matcher *m, const struct swm_quirk_entry *e)
+{
+	const struct swm_quirk_field	*f = &e->f[SWM_QUIRK_CLASS];
+
+	if (f->kind == SWM_QF_LITERAL)
+		return (quirk_hash(f->text, f->len, 2166136261u) &
+		    (m->nexact - 1));
+	if (f->kind == SWM_QF_REGEX && f->len > 0)
+		return (m->nexact + (unsigned char)f->text[0]);
+
+	return (m->nexact + SWM_QUIRK_PREFIXES);
+}
+
+struct swm_quirk_matcher *
+quirk_matcher_new(const struct swm_quirk_rule *rules, int n)
+{
+	struct swm_quirk_matcher	*m;
+	int				*fill = NULL, i, j, l, nlists;
+
+	if ((m = calloc(1, sizeof *m)) == NULL)
+		return (NULL);
+
+	m->nrules = n;
+	for (m->nexact = 16; m->nexact < n; m->nexact *= 2)
+		;
+	nlists = m->nexact + SWM_QUIRK_PREFIXES + 1;
+
+	if ((n && (m->rules = calloc(n, sizeof *m->rules)) == NULL) ||
+	    (n && (m->idx = calloc(n, sizeof *m->idx)) == NULL) ||
+	    (m->start = calloc(nlists + 1, sizeof *m->start)) == NULL ||
+	    (fill = calloc(nlists, sizeof *fill)) == NULL) {
+		free(fill);
+		quirk_matcher_free(m);
+		return (NULL);
+	}
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < SWM_QUIRK_FIELDS; j++)
+			quirk_field_init(&m->rules[i].f[j],
+			    rules[i].pattern[j], rules[i].regex[j]);
+		m->rules[i].quirk = rules[i].quirk;
+		m->rules[i].ws = rules[i].ws;
+		m->start[quirk_list(m, &m->rules[i]) + 1]++;
+	}
+
+	for (l = 0; l < nlists; l++)
+		m->start[l + 1] += m->start[l];
+	for (i = 0; i < n; i++) {
+		l = quirk_list(m, &m->rules[i]);
+		m->idx[m->start[l] + fill[l]++] = i;
+	}
+	free(fill);
+
+	return (m);
+}
+
+void
+quirk_matcher_free(struct swm_quirk_matcher *m)
+{
+	int			i;
+
+	if (m == NULL)
+		return;
+
+	for (i = 0; i < SWM_QUIRK_CACHE; i++)
+		free(m->cache[i].key);
+	free(m->rules);
+	free(m->idx);
+	free(m->start);
+	free(m);
+}
+
+void
+quirk_match(struct swm_quirk_matcher *m, const char *class,
+    const char *instance, const char *name, int ws_limit,
+    struct swm_quirk_result *res)
+{
+	struct swm_quirk_cached		*c;
+	const struct swm_quirk_entry	*e;
+	const char			*s[SWM_QUIRK_FIELDS];
+	size_t				len[SWM_QUIRK_FIELDS], klen;
+	uint32_t			h;
+	int				lists[3], pos[3], i, j, best;
+	bool				found = false;
+
+	s[SWM_QUIRK_CLASS] = class;
+	s[SWM_QUIRK_INSTANCE] = instance;
+	s[SWM_QUIRK_NAME] = name;
+
+	h = 2166136261u;
+	klen = 0;
+	for (i = 0; i < SWM_QUIRK_FIELDS; i++) {
+		len[i] = strlen(s[i]) + 1;
+		h = quirk_hash(s[i], len[i], h);
+		klen += len[i];
+	}
+
+	c = &m->cache[h % SWM_QUIRK_CACHE];
+	if (c->key && c->len == klen && c->ws_limit == ws_limit) {
+		j = 0;
+		for (i = 0; i < SWM_QUIRK_FIELDS; i++) {
+			if (memcmp(c->key + j, s[i], len[i]))
+				break;
+			j += len[i];
+		}
+		if (i == SWM_QUIRK_FIELDS) {
+			*res = c->res;
+			return;
+		}
+	}
+
+	res->quirk = 0;
+	res->ws = -1;
+	res->rule = -1;
+
+	/* Rules with this literal class, class prefix, or neither. */
+	lists[0] = quirk_hash(class, len[0] - 1, 2166136261u) &
+	    (m->nexact - 1);
+	lists[1] = m->nexact + (unsigned char)class[0];
+	lists[2] = m->nexact + SWM_QUIRK_PREFIXES;
+	for (i = 0; i < 3; i++)
+		pos[i] = m->start[lists[i] + 1] - 1;
+
+	/* Merge the lists from the last rule back. */
+	for (;;) {
+		best = -1;
+		for (i = 0; i < 3; i++)
+			if (pos[i] >= m->start[lists[i]] && (best == -1 ||
+			    m->idx[pos[i]] > m->idx[pos[best]]))
+				best = i;
+		if (best == -1)
+			break;
+		e = &m->rules[m->idx[pos[best]--]];
+
+		/* Once the quirks are known, only a ws can still change. */
+		if (found && (e->ws < 0 || e->ws >= ws_limit))
+			continue;
+
+		for (i = 0; i < SWM_QUIRK_FIELDS; i++)
+			if (!quirk_field_match(&e->f[i], s[i]))
+				break;
+		if (i < SWM_QUIRK_FIELDS)
+			continue;
+
+		if (!found) {
+			found = true;
+			res->quirk = e->quirk;
+			res->rule = e - m->rules;
+		}
+		if (e->ws >= 0 && e->ws < ws_limit) {
+			res->ws = e->ws;
+			break;
+		}
+	}
+
+	free(c->key);
+	c->len = 0;
+	if ((c->key = malloc(klen)) == NULL)
+		return;
+	j = 0;
+	for (i = 0; i < SWM_QUIRK_FIELDS; i++) {
+		memcpy(c->key + j, s[i], len[i]);
+		j += len[i];
+	}
+	c->len = klen;
+	c->ws_limit = ws_limit;
+	c->res = *res;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2009-2015 Marco Peereboom <marco@peereboom.us>
+ * Copyright (c) 2011-2017 Reginald Kennedy <rk@rejii.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Quirk matching, free of any X calls so that it can be exercised on its own
+ * (see bench/swmquirk.c).  spectrwm compiles its quirk list into a matcher
+ * whenever the list changes and asks it for the quirks of each new window.
+ *
+ * The result is the same as trying every rule in order and letting later
+ * matches win, but patterns without regex syntax are compared as strings,
+ * rules are indexed by the literal text or prefix of their class pattern, the
+ * candidates are tried last to first and the search stops as soon as the
+ * answer is known.  Answers are cached per (class, instance, name).
+ */
+
+#ifndef SWM_QUIRK_H
+#define SWM_QUIRK_H
+
+#include <sys/types.h>
+
+#include <regex.h>
+#include <stdint.h>
+
+#define SWM_QUIRK_CLASS		(0)
+#define SWM_QUIRK_INSTANCE	(1)
+#define SWM_QUIRK_NAME		(2)
+#define SWM_QUIRK_FIELDS	(3)
+
+struct swm_quirk_rule {
+	/* Patterns as configured; regex is the same, anchored with ^ $. */
+	const char		*pattern[SWM_QUIRK_FIELDS];
+	const regex_t		*regex[SWM_QUIRK_FIELDS];
+	uint32_t		quirk;
+	int			ws;		/* initial workspace or -1 */
+};
+
+struct swm_quirk_result {
+	uint32_t		quirk;		/* of the last matching rule */
+	int			ws;		/* of the last one with a ws */
+	int			rule;		/* last matching rule or -1 */
+};
+
+struct swm_quirk_matcher;
+
+/*
+ * Compile n rules, in order of precedence (last wins).  Strings and regexes
+ * are borrowed and must outlive the matcher.  Returns NULL on ENOMEM.
+ */
+struct swm_quirk_matcher *quirk_matcher_new(const struct swm_quirk_rule *,
+	    int);
+void	quirk_matcher_free(struct swm_quirk_matcher *);
+/* Only ws in [0, ws_limit) count. */
+void	quirk_match(struct swm_quirk_matcher *, const char *, const char *,
+	    const char *, int, struct swm_quirk_result *);
+
+#endif /* SWM_QUIRK_H */
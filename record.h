@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2011-2017 Reginald Kennedy <rk@rejii.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * On-disk format of the event recording written with event_record, read by
+ * bench/swmrec.c.  Host byte order; a file is only meant to be analyzed on
+ * the machine that wrote it.
+ *
+ * A header is followed by fixed size records.  No window contents, titles or
+ * other property values are stored: windows are numbered in order of
+ * appearance, starting over in each file, and properties are identified by
+ * atom only.  SWM_REC_ATOM
+ * records name the atoms spectrwm itself knows about; the name follows the
+ * record, NUL terminated and padded to a multiple of the record size.
+ */
+
+#ifndef SWM_RECORD_H
+#define SWM_RECORD_H
+
+#include <stdint.h>
+
+#define SWM_REC_MAGIC		"SWMREC1"
+#define SWM_REC_VERSION		(1)
+#define SWM_REC_ATOM		(0xff)	/* not an X event type */
+#define SWM_REC_F_SENT		(0x01)	/* SendEvent */
+
+struct swm_rec_header {
+	char			magic[8];
+	uint32_t		version;
+	uint32_t		rec_size;
+	uint64_t		start;		/* monotonic usec at open */
+	int64_t			wall;		/* time(3) at open */
+};
+
+struct swm_rec {
+	uint64_t		start;		/* monotonic usec */
+	uint32_t		usec;		/* handler time */
+	uint32_t		win;		/* window index, 0 if none */
+	uint32_t		atom;		/* property/message atom */
+	uint16_t		rtt;		/* ATOM: name length */
+	uint8_t			type;		/* X event type or ATOM */
+	uint8_t			flags;
+};
+
+#endif /* SWM_RECORD_H */
@@ -36,6 +36,12 @@
 #endif
 #include <sys/param.h>
 #include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
 #if defined(__linux__)
 #include "tree.h"
 #elif defined(__OpenBSD__)
@@ -57,6 +63,7 @@
 #include <pwd.h>
 #include <regex.h>
 #include <signal.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -77,8 +84,12 @@
 #include <xcb/xcb_keysyms.h>
 #include <xcb/xtest.h>
 #include <xcb/randr.h>
+#include <xcb/res.h>
 
 /* local includes */
+#include "layout.h"
+#include "quirk.h"
+#include "record.h"
 #include "version.h"
 #ifdef __OSX__
 #include <osx.h>
@@ -99,6 +110,9 @@ static const char	*buildstr = SPECTRWM_VERSION;
 #    if RANDR_MINOR >= 2
 #      define SWM_XRR_HAS_CRTC
 #    endif
+#    if defined(XCB_RANDR_MINOR_VERSION) && XCB_RANDR_MINOR_VERSION >= 5
+#      define SWM_XRR_HAS_MONITORS
+#    endif
 #  endif
 #endif /* __CYGWIN__ */
 
@@ -133,6 +147,89 @@ static const char	*buildstr = SPECTRWM_VERSION;
 #define xcb_icccm_wm_hints_t			xcb_wm_hints_t
 #endif
 
+/*
+ * Static tracepoints for bpftrace and perf, see bench/usdt.  They need
+ * <sys/sdt.h> and -DSWM_USDT; otherwise they compile to nothing.
+ */
+#ifdef SWM_USDT
+#include <sys/sdt.h>
+#define SWM_PROBE0(n)		DTRACE_PROBE(spectrwm, n)
+#define SWM_PROBE1(n, a)	DTRACE_PROBE1(spectrwm, n, a)
+#define SWM_PROBE2(n, a, b)	DTRACE_PROBE2(spectrwm, n, a, b)
+#define SWM_PROBE3(n, a, b, c)	DTRACE_PROBE3(spectrwm, n, a, b, c)
+#else
+#define SWM_PROBE0(n)		do { } while (0)
+#define SWM_PROBE1(n, a)	do { } while (0)
+#define SWM_PROBE2(n, a, b)	do { } while (0)
+#define SWM_PROBE3(n, a, b, c)	do { } while (0)
+#endif
+
+/*
+ * Round trip accounting: every call below blocks on the server.  Wrapping
+ * them here keeps the count in stat_rtt and the time spent waiting in
+ * stat_blocked_usec exact without touching call sites.  The replies are
+ * pointers, except for the icccm calls, which return a uint8_t.
+ */
+uint64_t		stat_rtt = 0;
+uint64_t		stat_blocked_usec = 0;
+uint64_t		stat_flush = 0;
+void			rtt_begin(int);
+void			*rtt_end(void *);
+uint8_t			rtt_end8(uint8_t);
+#define SWM_RTT(call)	(rtt_begin(__LINE__), rtt_end(call))
+#define SWM_RTT8(call)	(rtt_begin(__LINE__), rtt_end8(call))
+#define xcb_aux_sync(...)						\
+	(rtt_begin(__LINE__), xcb_aux_sync(__VA_ARGS__), (void)rtt_end(NULL))
+#define xcb_flush(c)		(stat_flush++, xcb_flush(c))
+#define xcb_alloc_color_reply(...)					\
+	SWM_RTT(xcb_alloc_color_reply(__VA_ARGS__))
+#define xcb_alloc_named_color_reply(...)				\
+	SWM_RTT(xcb_alloc_named_color_reply(__VA_ARGS__))
+#define xcb_get_atom_name_reply(...)					\
+	SWM_RTT(xcb_get_atom_name_reply(__VA_ARGS__))
+#define xcb_get_geometry_reply(...)					\
+	SWM_RTT(xcb_get_geometry_reply(__VA_ARGS__))
+#define xcb_get_input_focus_reply(...)					\
+	SWM_RTT(xcb_get_input_focus_reply(__VA_ARGS__))
+#define xcb_get_modifier_mapping_reply(...)				\
+	SWM_RTT(xcb_get_modifier_mapping_reply(__VA_ARGS__))
+#define xcb_get_property_reply(...)					\
+	SWM_RTT(xcb_get_property_reply(__VA_ARGS__))
+#define xcb_get_window_attributes_reply(...)				\
+	SWM_RTT(xcb_get_window_attributes_reply(__VA_ARGS__))
+#define xcb_intern_atom_reply(...)					\
+	SWM_RTT(xcb_intern_atom_reply(__VA_ARGS__))
+#define xcb_query_pointer_reply(...)					\
+	SWM_RTT(xcb_query_pointer_reply(__VA_ARGS__))
+#define xcb_query_tree_reply(...)					\
+	SWM_RTT(xcb_query_tree_reply(__VA_ARGS__))
+#define xcb_randr_get_crtc_info_reply(...)				\
+	SWM_RTT(xcb_randr_get_crtc_info_reply(__VA_ARGS__))
+#define xcb_randr_get_monitors_reply(...)				\
+	SWM_RTT(xcb_randr_get_monitors_reply(__VA_ARGS__))
+#define xcb_randr_get_screen_resources_current_reply(...)		\
+	SWM_RTT(xcb_randr_get_screen_resources_current_reply(__VA_ARGS__))
+#define xcb_randr_query_version_reply(...)				\
+	SWM_RTT(xcb_randr_query_version_reply(__VA_ARGS__))
+#define xcb_res_query_client_ids_reply(...)				\
+	SWM_RTT(xcb_res_query_client_ids_reply(__VA_ARGS__))
+#define xcb_res_query_version_reply(...)				\
+	SWM_RTT(xcb_res_query_version_reply(__VA_ARGS__))
+#ifndef xcb_icccm_get_wm_class_reply
+#define xcb_icccm_get_wm_class_reply(...)				\
+	SWM_RTT8(xcb_icccm_get_wm_class_reply(__VA_ARGS__))
+#define xcb_icccm_get_wm_hints_reply(...)				\
+	SWM_RTT8(xcb_icccm_get_wm_hints_reply(__VA_ARGS__))
+#define xcb_icccm_get_wm_name_reply(...)				\
+	SWM_RTT8(xcb_icccm_get_wm_name_reply(__VA_ARGS__))
+#define xcb_icccm_get_wm_normal_hints_reply(...)			\
+	SWM_RTT8(xcb_icccm_get_wm_normal_hints_reply(__VA_ARGS__))
+#define xcb_icccm_get_wm_protocols_reply(...)				\
+	SWM_RTT8(xcb_icccm_get_wm_protocols_reply(__VA_ARGS__))
+#define xcb_icccm_get_wm_transient_for_reply(...)			\
+	SWM_RTT8(xcb_icccm_get_wm_transient_for_reply(__VA_ARGS__))
+#endif
+
 /*#define SWM_DEBUG*/
 #ifdef SWM_DEBUG
 #define DPRINTF(x...) do {							\
@@ -287,11 +384,16 @@ xcb_atom_t		a_net_supported;
 xcb_atom_t		a_takefocus;
 xcb_atom_t		a_utf8_string;
 xcb_atom_t		a_swm_ws;
+xcb_atom_t		a_swm_session;
+xcb_atom_t		a_swm_pid;
+xcb_atom_t		a_net_wm_pid;
 volatile sig_atomic_t   running = 1;
 volatile sig_atomic_t   restart_wm = 0;
 xcb_timestamp_t		last_event_time = 0;
 int			outputs = 0;
 bool			randr_support;
+bool			randr_monitors;		/* RandR 1.5 GetMonitors */
+bool			xres_support;
 int			randr_eventbase;
 unsigned int		numlockmask = 0;
 
@@ -408,15 +510,12 @@ XftColor	 bar_font_color;
 XftColor	 search_font_color;
 char		*startup_exception = NULL;
 unsigned int	 nr_exceptions = 0;
+char		*conf_path = NULL;	/* file loaded at startup */
+bool		 conf_reloading = false;
+bool		 conf_checking = false;	/* reload: check, apply nothing */
+bool		 conf_restack = false;	/* reload changed a workspace */
 
 /* layout manager data */
-struct swm_geometry {
-	int			x;
-	int			y;
-	int			w;
-	int			h;
-};
-
 struct swm_screen;
 struct workspace;
 
@@ -436,9 +535,18 @@ struct swm_region {
 	struct workspace	*ws_prior; /* prior workspace on this region */
 	struct swm_screen	*s;	/* screen idx */
 	struct swm_bar		*bar;
+	uint32_t		rrid;	/* RandR CRTC or monitor name, or 0 */
+	bool			stack_pending; /* restack after ctl batch/RandR */
 };
 TAILQ_HEAD(swm_region_list, swm_region);
 
+/* A region scan_randr() wants, in the order RandR lists them. */
+struct swm_output {
+	struct swm_geometry	g;
+	uint32_t		rrid;
+	struct swm_region	*r;	/* matched region */
+};
+
 enum {
 	SWM_WIN_STATE_REPARENTING,
 	SWM_WIN_STATE_REPARENTED,
@@ -471,7 +579,9 @@ struct ws_win {
 	struct workspace	*ws;	/* always valid */
 	struct swm_screen	*s;	/* always valid, never changes */
 	xcb_size_hints_t	sh;
-	xcb_icccm_get_wm_class_reply_t	ch;
+	const char		*class;		/* interned; NULL if unset */
+	const char		*instance;	/* interned; NULL if unset */
+	const char		*title;		/* interned */
 	xcb_icccm_wm_hints_t	hints;
 #ifdef SWM_DEBUG
 	xcb_window_t		debug;
@@ -480,13 +590,62 @@ struct ws_win {
 TAILQ_HEAD(ws_win_list, ws_win);
 TAILQ_HEAD(ws_win_stack, ws_win);
 
+/*
+ * Requests manage_window() needs answered for a new window, sent in one go so
+ * that it waits once rather than once per property.  A cookie is zeroed when
+ * its reply is taken; prefetch_discard() drops the rest.
+ */
+struct swm_prefetch {
+	xcb_get_window_attributes_cookie_t	attributes;
+	xcb_get_property_cookie_t		wm_state;
+	xcb_get_geometry_cookie_t		geometry;
+	xcb_get_property_cookie_t		normal_hints;
+	xcb_get_property_cookie_t		hints;
+	xcb_get_property_cookie_t		transient_for;
+	xcb_get_property_cookie_t		protocols;
+	xcb_get_property_cookie_t		window_type;
+	xcb_get_property_cookie_t		class;
+	xcb_get_property_cookie_t		net_name;
+	xcb_get_property_cookie_t		name;
+	xcb_get_property_cookie_t		desktop;
+	xcb_get_property_cookie_t		swm_ws;
+	xcb_get_property_cookie_t		net_wm_state;
+};
+/* The prefetched cookie f if there is a pf, else the result of req. */
+#define PREFETCH(pf, f, req)	((pf) ? prefetch_take(&(pf)->f) : (req))
+
+/*
+ * Window strings are interned: each distinct class, instance or title is kept
+ * once, refcounted, so equal strings have equal pointers.  The text follows
+ * the struct.
+ */
+struct swm_str {
+	RB_ENTRY(swm_str)	entry;
+	char			*s;
+	size_t			len;
+	unsigned int		refs;
+};
+RB_HEAD(str_tree, swm_str) strings = RB_INITIALIZER(&strings);
+
 /* pid goo */
+#define SWM_PID_HASH_SIZE	(256)	/* must be a power of 2 */
+#define SWM_PID_HASH(p)		((unsigned int)(p) & (SWM_PID_HASH_SIZE - 1))
+#define SWM_PID_TTL		(60)	/* seconds to keep entries of dead pids */
+#define SWM_PID_MAX_DEPTH	(16)	/* ancestors searched for a tracked pid */
+#define SWM_PPID_CACHE_TTL	(5)
 struct pid_e {
 	TAILQ_ENTRY(pid_e)	entry;
 	pid_t			pid;
 	int			ws;
+	int			pidfd;	/* -1 if not watched */
+	time_t			expire;	/* 0 while the process is alive */
 };
-TAILQ_HEAD(pid_list, pid_e) pidlist = TAILQ_HEAD_INITIALIZER(pidlist);
+TAILQ_HEAD(pid_list, pid_e);
+struct pid_list		pidhash[SWM_PID_HASH_SIZE];
+int			pid_count = 0;
+int			pidfd_count = 0;
+struct pid_e		**pidfd_watch = NULL;
+int			pidfd_watch_size = 0;
 
 /* layout handlers */
 void	stack(struct swm_region *);
@@ -519,8 +678,6 @@ struct layout {
 #define SWM_H_STACK		(1)
 #define SWM_MAX_STACK		(2)
 
-#define SWM_H_SLICE		(32)
-#define SWM_V_SLICE		(32)
 
 /* define work spaces */
 struct workspace {
@@ -672,6 +829,11 @@ struct quirk {
 #define SWM_Q_MINIMALBORDER	(1<<12)	/* No border when floating/unfocused. */
 };
 TAILQ_HEAD(quirk_list, quirk) quirks = TAILQ_HEAD_INITIALIZER(quirks);
+/* Quirks of the previous load, reused by quirk_insert during a reload. */
+struct quirk_list	quirks_old = TAILQ_HEAD_INITIALIZER(quirks_old);
+/* Compiled from quirks; rebuilt on first use after the list changes. */
+struct swm_quirk_matcher	*quirk_matcher = NULL;
+bool			 quirks_dirty = true;
 
 /*
  * Supported EWMH hints should be added to
@@ -805,8 +967,19 @@ struct spawn_prog {
 };
 TAILQ_HEAD(spawn_list, spawn_prog) spawns = TAILQ_HEAD_INITIALIZER(spawns);
 
+/* Last config value of options that are also changed at runtime. */
+struct conf_value {
+	TAILQ_ENTRY(conf_value)	entry;
+	char			*key;		/* option[selector] */
+	char			*value;
+	bool			seen;		/* set by the current load */
+};
+TAILQ_HEAD(conf_value_list, conf_value) conf_values =
+    TAILQ_HEAD_INITIALIZER(conf_values);
+
 enum {
 	FN_F_NOREPLAY = 0x1,
+	FN_F_NOCTL = 0x2,	/* interactive; not available on ctl socket */
 };
 
 /* User callable function IDs. */
@@ -873,6 +1046,7 @@ enum actionid {
 	FN_QUIT,
 	FN_RAISE,
 	FN_RAISE_TOGGLE,
+	FN_RELOAD,
 	FN_RESIZE,
 	FN_RESIZE_CENTERED,
 	FN_RESTART,
@@ -964,6 +1138,240 @@ struct binding {
 };
 RB_HEAD(binding_tree, binding) bindings = RB_INITIALIZER(&bindings);
 
+/* Passive key grabs in place, sorted, so grabkeys() only sends changes. */
+struct key_grab {
+	xcb_window_t		root;
+	xcb_keycode_t		code;
+	uint16_t		mod;
+};
+struct key_grab		*key_grabs = NULL;
+size_t			key_grabs_len = 0;
+
+/* Keycodes by the keysym keypress() looks them up as. */
+struct key_code {
+	xcb_keysym_t		sym;
+	xcb_keycode_t		code;
+};
+
+/*
+ * Key dispatch, by keycode and then CLEANMASK() of the event state; a catch-all
+ * fills the states no other binding of the key claims.  Rebuilt by grabkeys()
+ * along with the grabs, so it always matches the keymap and bindings.
+ */
+#define SWM_KEY_CODES		(256)
+#define SWM_KEY_STATES		(256)
+struct binding		**key_table[SWM_KEY_CODES];	/* NULL if unbound */
+bool			bindings_changed = true;	/* since last grabkeys */
+
+/* control socket */
+#define SWM_CTL_CLIENTS_MAX	(8)
+#define SWM_CTL_BUFLEN		(1024)
+#define SWM_CTL_BATCH_MAX	(256)
+struct ctl_cmd {
+	enum actionid		action;
+	char			*spawn_name;
+};
+struct ctl_client {
+	int			fd;
+	size_t			len;
+	char			buf[SWM_CTL_BUFLEN];
+	bool			batch;		/* between begin and commit */
+	bool			batch_failed;
+	int			ncmds;
+	struct ctl_cmd		cmds[SWM_CTL_BATCH_MAX];
+};
+char			*ctl_path = NULL;
+int			ctl_fd = -1;
+struct ctl_client	*ctl_clients[SWM_CTL_CLIENTS_MAX];
+bool			ctl_batch = false;	/* defer stack() and flush */
+
+/* main loop poll set layout */
+#define SWM_POLL_X		(0)
+#define SWM_POLL_STDIN		(1)
+#define SWM_POLL_CTL		(2)
+#define SWM_POLL_PIDFD		(SWM_POLL_CTL + SWM_CTL_CLIENTS_MAX + 1)
+
+/* handler latency statistics, cheap enough to be always on */
+#define SWM_HIST_BUCKETS	(24)	/* bucket i counts < 2^i usec */
+#define SWM_STAT_EVENTS		(XCB_GE_GENERIC + 1) /* last slot: other */
+#define SWM_TRACE_LEN		(256)
+struct swm_stat {
+	uint64_t		count;
+	uint64_t		usec;		/* total */
+	uint64_t		usec_max;
+	uint64_t		rtt;		/* blocking round trips */
+	uint64_t		rtt_max;
+	uint64_t		rtt_over;	/* calls over rtt_budget */
+	uint32_t		rtt_budget;
+	bool			rtt_budgeted;
+	uint32_t		hist[SWM_HIST_BUCKETS];
+};
+enum {
+	SWM_TRACE_EVENT,
+	SWM_TRACE_ACTION,
+	SWM_TRACE_FUNC,		/* accounted, but not traced */
+};
+/* functions called from many handlers that get their own round trip count */
+enum {
+	SWM_STAT_BAR_DRAW,
+	SWM_STAT_SCAN_RANDR,
+	SWM_STAT_SCREENCHANGE,
+	SWM_STAT_FUNCS,
+};
+const char		*stat_func_names[SWM_STAT_FUNCS] = {
+	"bar_draw",
+	"scan_randr",
+	"screenchange",
+};
+struct swm_trace {
+	uint64_t		start;		/* usec, monotonic */
+	uint32_t		usec;
+	uint16_t		rtt;
+	uint8_t			kind;
+	uint8_t			id;		/* event type or action */
+};
+struct swm_stat		stat_events[SWM_STAT_EVENTS + 1];
+struct swm_stat		stat_actions[FN_INVALID + 1];
+struct swm_stat		stat_funcs[SWM_STAT_FUNCS];
+bool			rtt_budget_fatal = false;
+struct swm_trace	trace_ring[SWM_TRACE_LEN];
+unsigned int		trace_next = 0;
+volatile sig_atomic_t	stats_dump_pending = 0;
+uint64_t		stat_stack = 0;		/* stack() calls */
+uint64_t		stat_poll_usec = 0;	/* idle in poll(2) */
+uint64_t		stat_requests = 0;
+uint32_t		stat_seq = 0;		/* of the last stats_write() no-op */
+char			*stats_file = NULL;
+
+/* live heap use of long-lived objects, by owner; see mem_malloc() */
+enum {
+	SWM_MEM_WINDOWS,
+	SWM_MEM_QUIRKS,
+	SWM_MEM_BINDINGS,
+	SWM_MEM_SPAWN,
+	SWM_MEM_EVENTS,
+	SWM_MEM_BAR,
+	SWM_MEM_SEARCH,
+	SWM_MEM_PIDS,
+	SWM_MEM_STRINGS,
+	SWM_MEM_TAGS,
+};
+const char		*mem_tag_names[SWM_MEM_TAGS] = {
+	"windows",
+	"quirks",
+	"bindings",
+	"spawn",
+	"events",
+	"bar",
+	"search",
+	"pids",
+	"strings",
+};
+struct swm_mem_stat {
+	uint64_t		allocs;		/* total */
+	uint64_t		live;
+	uint64_t		bytes;		/* live */
+	uint64_t		bytes_max;
+};
+/* Precedes each tagged block; the union keeps the payload aligned. */
+union swm_mem_hdr {
+	struct {
+		size_t		size;
+		int		tag;
+	}			h;
+	long double		align_ld;
+	long long		align_ll;
+	void			*align_p;
+};
+struct swm_mem_stat	mem_stats[SWM_MEM_TAGS];
+
+/*
+ * Restart handoff: the parts of the model that cannot be read back from the
+ * server, passed to the new process in a sealed memfd named by SWM_STATE_FD.
+ * Host byte order; workspaces, then regions, then windows in winlist order.
+ * The same snapshot is kept in session_file for recovery after a crash.
+ */
+#define SWM_STATE_MAGIC		"SWMSTAT1"
+#define SWM_STATE_VERSION	(2)
+#define SWM_STATE_NAMELEN	(64)
+struct swm_state_hdr {
+	char			magic[8];
+	uint32_t		version;
+	uint32_t		session;	/* _SWM_SESSION of the X server */
+	uint32_t		nws;
+	uint32_t		nregions;
+	uint32_t		nwins;
+};
+struct swm_state_ws {
+	int32_t			screen;
+	int32_t			idx;
+	int32_t			layout;		/* index into layouts[] */
+	uint32_t		focus;		/* window ids, 0 if none */
+	uint32_t		focus_prev;
+	int32_t			msize[2];	/* vertical, horizontal */
+	int32_t			mwin[2];
+	int32_t			stacks[2];
+	uint8_t			flip[2];
+	uint8_t			always_raise;
+	uint8_t			bar_enabled;
+	char			name[SWM_STATE_NAMELEN];
+};
+struct swm_state_region {
+	int32_t			screen;
+	struct swm_geometry	g;
+	int32_t			ws;
+	int32_t			ws_prior;	/* -1 if none */
+	uint32_t		focused;
+};
+struct swm_state_win {
+	uint32_t		id;
+	int32_t			screen;
+	int32_t			ws;
+	int32_t			stack_pos;	/* position in ws->stack */
+	struct swm_geometry	g_float;
+	uint32_t		g_floatvalid;
+};
+char			*state_buf = NULL;	/* loaded snapshot, if any */
+struct swm_state_hdr	*state_hdr;
+struct swm_state_ws	*state_ws;
+struct swm_state_region	*state_regions;
+struct swm_state_win	*state_wins;
+int			state_focus = -1;	/* region of screen 0 to focus */
+
+/* session_file is rewritten this long after the first change to the model */
+#define SWM_SESSION_DELAY	(2000000)	/* usec */
+char			*session_file = NULL;
+uint32_t		session_id = 0;
+uint64_t		session_due = 0;	/* 0 if up to date */
+
+/* startup phase profile, reported once the desktop is usable */
+#define SWM_PHASE_MAX		(48)
+struct swm_phase {
+	const char		*name;
+	uint64_t		usec;
+	uint64_t		rtt;
+};
+struct swm_phase	phases[SWM_PHASE_MAX];
+int			nphases = 0;
+uint64_t		phase_last, phase_rtt, startup_begin;
+uint64_t		grab_begin, grab_usec;
+uint64_t		restart_usec;		/* restart action until exec */
+char			*startup_profile = NULL;
+
+/* event recorder, see record.h */
+#define SWM_REC_SIZE_DEFAULT	(32)	/* MiB, per file */
+struct swm_rec_win {
+	xcb_window_t		id;
+	uint32_t		idx;
+};
+char			*rec_path = NULL;
+off_t			rec_limit = SWM_REC_SIZE_DEFAULT * 1024 * 1024;
+off_t			rec_written;
+FILE			*rec_file = NULL;
+bool			rec_dirty = false;
+struct swm_rec_win	*rec_wins = NULL;	/* open addressing, id 0 free */
+uint32_t		rec_wins_size, rec_nwins;
+
 /* function prototypes */
 void	 adjust_font(struct ws_win *);
 char	*argsep(char **);
@@ -979,6 +1387,7 @@ void	 bar_print_legacy(struct swm_region *, const char *);
 void	 bar_replace(char *, char *, struct swm_region *, size_t);
 void	 bar_replace_pad(char *, int *, size_t);
 char	*bar_replace_seq(char *, char *, struct swm_region *, size_t *, size_t);
+void	 bar_resize(struct swm_region *);
 void	 bar_setup(struct swm_region *);
 void	 bar_toggle(struct binding *, struct swm_region *, union arg *);
 void	 bar_urgent(char *, size_t);
@@ -990,6 +1399,8 @@ void	 bar_window_name(char *, size_t, struct swm_region *);
 void	 bar_window_state(char *, size_t, struct swm_region *);
 void	 bar_workspace_name(char *, size_t, struct swm_region *);
 int	 binding_cmp(struct binding *, struct binding *);
+bool	 bindings_differ(struct binding_tree *, struct binding_tree *,
+	     enum binding_type);
 void	 binding_insert(uint16_t, enum binding_type, uint32_t, enum actionid,
 	     uint32_t, const char *);
 struct binding	*binding_lookup(uint16_t, enum binding_type, uint32_t);
@@ -1001,16 +1412,31 @@ void	 check_conn(void);
 void	 clear_bindings(void);
 void	 clear_keybindings(void);
 int	 clear_maximized(struct workspace *);
+void	 clear_pids(void);
 void	 clear_quirks(void);
 void	 clear_spawns(void);
 void	 clientmessage(xcb_client_message_event_t *);
 void	 client_msg(struct ws_win *, xcb_atom_t, xcb_timestamp_t);
+bool	 conf_changed(const char *, const char *, const char *);
 int	 conf_load(const char *, int);
 void	 configurenotify(xcb_configure_notify_event_t *);
 void	 configurerequest(xcb_configure_request_event_t *);
 void	 config_win(struct ws_win *, xcb_configure_request_event_t *);
 void	 constrain_window(struct ws_win *, struct swm_geometry *, int *);
 int	 count_win(struct workspace *, bool);
+void	 ctl_accept(void);
+void	 ctl_check(struct pollfd *);
+void	 ctl_cleanup(void);
+void	 ctl_close(struct ctl_client *);
+void	 ctl_command(struct ctl_client *, char *);
+int	 ctl_parse(char *, struct ctl_cmd *, const char **);
+void	 ctl_pollfds(struct pollfd *);
+void	 ctl_read(struct ctl_client *);
+void	 ctl_reply(struct ctl_client *, const char *, ...);
+void	 ctl_run(struct ctl_cmd *, int);
+void	 ctl_setup(void);
+void	 ctl_state(char *, size_t);
+void	 ctl_stats(struct ctl_client *);
 void	 cursors_cleanup(void);
 void	 cursors_load(void);
 void	 custom_region(const char *);
@@ -1030,9 +1456,9 @@ void	 event_drain(uint8_t);
 void	 event_error(xcb_generic_error_t *);
 void	 event_handle(xcb_generic_event_t *);
 void	 ewmh_apply_flags(struct ws_win *, uint32_t);
-void	 ewmh_autoquirk(struct ws_win *);
+void	 ewmh_autoquirk(struct ws_win *, struct swm_prefetch *);
 void	 ewmh_get_desktop_names(void);
-void	 ewmh_get_wm_state(struct ws_win *);
+void	 ewmh_get_wm_state(struct ws_win *, struct swm_prefetch *);
 void	 ewmh_update_actions(struct ws_win *);
 void	 ewmh_update_client_list(void);
 void	 ewmh_update_current_desktop(void);
@@ -1046,6 +1472,7 @@ void	 fake_keypress(struct ws_win *, xcb_keysym_t, uint16_t);
 struct swm_bar	*find_bar(xcb_window_t);
 struct ws_win	*find_frame_window(xcb_window_t);
 struct pid_e	*find_pid(pid_t);
+struct pid_e	*find_pid_ancestor(pid_t);
 struct swm_region	*find_region(xcb_window_t);
 struct ws_win	*find_unmanaged_window(xcb_window_t);
 struct ws_win	*find_window(xcb_window_t);
@@ -1084,24 +1511,27 @@ char	*get_source_type_label(uint32_t);
 char	*get_stack_mode_name(uint8_t);
 char	*get_state_mask_label(uint16_t);
 #endif
-int32_t	 get_swm_ws(xcb_window_t);
+int32_t	 get_swm_ws(xcb_window_t, struct swm_prefetch *);
 bool	 get_urgent(struct ws_win *);
 #ifdef SWM_DEBUG
 char	*get_win_input_model(struct ws_win *);
 #endif
-char	*get_win_name(xcb_window_t);
-uint8_t	 get_win_state(xcb_window_t);
-void	 get_wm_protocols(struct ws_win *);
+uint8_t	 get_win_state(xcb_window_t, struct swm_prefetch *);
+void	 get_wm_protocols(struct ws_win *, struct swm_prefetch *);
 #ifdef SWM_DEBUG
 char	*get_wm_state_label(uint8_t);
 #endif
-int	 get_ws_idx(struct ws_win *);
+int	 get_ws_idx(struct ws_win *, struct swm_prefetch *);
 void	 grab_windows(void);
 void	 grabbuttons(void);
 void	 grabkeys(void);
 void	 iconify(struct binding *, struct swm_region *, union arg *);
 bool	 isxlfd(char *);
 bool	 keybindreleased(struct binding *, xcb_key_release_event_t *);
+int	 key_code_cmp(const void *, const void *);
+int	 key_grab_cmp(const void *, const void *);
+struct binding	*key_lookup(xcb_keycode_t, uint16_t);
+void	 key_table_clear(void);
 void	 keypress(xcb_key_press_event_t *);
 void	 keyrelease(xcb_key_release_event_t *);
 bool	 keyrepeating(xcb_key_release_event_t *);
@@ -1112,13 +1542,19 @@ void	 leavenotify(xcb_leave_notify_event_t *);
 #endif
 void	 load_float_geom(struct ws_win *);
 void	 lower_window(struct ws_win *);
-struct ws_win	*manage_window(xcb_window_t, int, bool);
+struct ws_win	*manage_window(xcb_window_t, int, bool, struct swm_prefetch *);
 void	 map_window(struct ws_win *);
 void	 mapnotify(xcb_map_notify_event_t *);
 void	 mappingnotify(xcb_mapping_notify_event_t *);
 void	 maprequest(xcb_map_request_event_t *);
 void	 maximize_toggle(struct binding *, struct swm_region *, union arg *);
 void	 motionnotify(xcb_motion_notify_event_t *);
+void	*mem_calloc(int, size_t, size_t);
+void	 mem_free(void *);
+void	*mem_malloc(int, size_t);
+void	*mem_realloc(int, void *, size_t);
+char	*mem_strdup(int, const char *);
+uint64_t	 monotonic_usec(void);
 void	 move(struct binding *, struct swm_region *, union arg *);
 void	 move_win(struct ws_win *, struct binding *, int);
 uint32_t name_to_pixel(int, const char *);
@@ -1128,6 +1564,21 @@ int	 parse_rgb(const char *, uint16_t *, uint16_t *, uint16_t *);
 int	 parsebinding(const char *, uint16_t *, enum binding_type *, uint32_t *,
 	     uint32_t *);
 int	 parsequirks(const char *, uint32_t *, int *);
+void	 phase_begin(void);
+void	 phase_mark(const char *);
+void	 phase_report(FILE *);
+void	 phase_write(void);
+void	 pid_exited(struct pid_e *);
+void	 pid_expire(void);
+struct pid_e	*pid_insert(pid_t, int);
+pid_t	 pid_get_ppid(pid_t);
+time_t	 pid_now(void);
+int	 pid_pollfds(struct pollfd **, int *, int);
+void	 pid_pollfds_check(struct pollfd *, int);
+void	 pid_remove(struct pid_e *);
+void	 prefetch_discard(struct swm_prefetch *);
+xcb_get_property_cookie_t prefetch_take(xcb_get_property_cookie_t *);
+void	 prefetch_window(xcb_window_t, struct swm_prefetch *);
 void	 pressbutton(struct binding *, struct swm_region *, union arg *);
 void	 priorws(struct binding *, struct swm_region *, union arg *);
 #ifdef SWM_DEBUG
@@ -1135,8 +1586,10 @@ void	 print_win_geom(xcb_window_t);
 #endif
 void	 propertynotify(xcb_property_notify_event_t *);
 void	 put_back_event(xcb_generic_event_t *);
+void	 quirk_check(const char *, const char *, const char *);
 void	 quirk_free(struct quirk *);
 void	 quirk_insert(const char *, const char *, const char *, uint32_t, int);
+void	 quirk_matcher_update(void);
 void	 quirk_remove(struct quirk *);
 void	 quirk_replace(struct quirk *, const char *, const char *, const char *,
 	     uint32_t, int);
@@ -1144,6 +1597,13 @@ void	 quit(struct binding *, struct swm_region *, union arg *);
 void	 raise_focus(struct binding *, struct swm_region *, union arg *);
 void	 raise_toggle(struct binding *, struct swm_region *, union arg *);
 void	 raise_window(struct ws_win *);
+void	 rec_atom(xcb_atom_t, const char *);
+void	 rec_close(void);
+void	 rec_event(xcb_generic_event_t *, uint8_t, uint64_t, uint64_t);
+void	 rec_flush(void);
+void	 rec_open(void);
+uint32_t rec_win(xcb_window_t);
+void	 reload(struct binding *, struct swm_region *, union arg *);
 void	 region_containment(struct ws_win *, struct swm_region *, int);
 struct swm_region	*region_under(struct swm_screen *, int, int);
 void	 regionize(struct ws_win *, int, int);
@@ -1153,8 +1613,11 @@ void	 resize(struct binding *, struct swm_region *, union arg *);
 void	 resize_win(struct ws_win *, struct binding *, int);
 void	 restart(struct binding *, struct swm_region *, union arg *);
 struct swm_region	*root_to_region(xcb_window_t, int);
+void	 rtt_budget_exceeded(int, int, uint64_t, uint32_t);
 void	 screenchange(xcb_randr_screen_change_notify_event_t *);
 void	 scan_randr(int);
+void	 scan_randr_add(struct swm_output *, int *, int, int, int, int,
+	     uint32_t);
 void	 search_do_resp(void);
 void	 search_resp_name_workspace(const char *, size_t);
 void	 search_resp_search_window(const char *);
@@ -1166,6 +1629,10 @@ void	 search_workspace(struct binding *, struct swm_region *, union arg *);
 void	 send_to_rg(struct binding *, struct swm_region *, union arg *);
 void	 send_to_rg_relative(struct binding *, struct swm_region *, union arg *);
 void	 send_to_ws(struct binding *, struct swm_region *, union arg *);
+void	 session_init(void);
+int	 session_timeout(void);
+void	 session_touch(void);
+void	 session_write(void);
 void	 set_region(struct swm_region *);
 int	 setautorun(const char *, const char *, int);
 void	 setbinding(uint16_t, enum binding_type, uint32_t, enum actionid,
@@ -1175,6 +1642,7 @@ int	 setconfcolor(const char *, const char *, int);
 int	 setconfmodkey(const char *, const char *, int);
 int	 setconfquirk(const char *, const char *, int);
 int	 setconfregion(const char *, const char *, int);
+int	 setconfrttbudget(const char *, const char *, int);
 int	 setconfspawn(const char *, const char *, int);
 int	 setconfvalue(const char *, const char *, int);
 int	 setkeymapping(const char *, const char *, int);
@@ -1186,6 +1654,7 @@ void	 setup_btnbindings(void);
 void	 setup_ewmh(void);
 void	 setup_globals(void);
 void	 setup_keybindings(void);
+void	 setup_pids(void);
 void	 setup_quirks(void);
 void	 setup_screens(void);
 void	 setup_spawn(void);
@@ -1200,13 +1669,30 @@ void	 spawn_custom(struct swm_region *, union arg *, const char *);
 int	 spawn_expand(struct swm_region *, union arg *, const char *, char ***);
 void	 spawn_insert(const char *, const char *, int);
 struct spawn_prog	*spawn_find(const char *);
+void	 spawn_free(struct spawn_prog *);
 void	 spawn_remove(struct spawn_prog *);
 void	 spawn_replace(struct spawn_prog *, const char *, const char *, int);
 void	 spawn_select(struct swm_region *, union arg *, const char *, int *);
 void	 stack_config(struct binding *, struct swm_region *, union arg *);
 void	 stack_master(struct workspace *, struct swm_geometry *, int, bool);
+const char	*stat_name(int, int);
+void	 stat_print(const char *, struct swm_stat *);
+void	 stat_record(struct swm_stat *, int, int, uint64_t, uint64_t);
+void	 state_adopt(int);
+char	*state_build(size_t *);
+void	 state_free(void);
+void	 state_load(void);
+int	 state_read(int);
+void	 state_restore(void);
+void	 state_save(void);
+int	 state_win_cmp(const void *, const void *);
+void	 stats_dump(void);
+void	 stats_file_write(void);
+void	 stats_write(FILE *);
 void	 store_float_geom(struct ws_win *);
-char	*strdupsafe(const char *);
+int	 str_cmp(struct swm_str *, struct swm_str *);
+const char	*str_intern(const char *, size_t);
+void	 str_release(const char *);
 void	 swapwin(struct binding *, struct swm_region *, union arg *);
 void	 switchws(struct binding *, struct swm_region *, union arg *);
 void	 teardown_ewmh(void);
@@ -1220,6 +1706,8 @@ void	 unmapnotify(xcb_unmap_notify_event_t *);
 void	 unparent_window(struct ws_win *);
 void	 update_floater(struct ws_win *);
 void	 update_modkey(uint16_t);
+void	 update_win_class(struct ws_win *, struct swm_prefetch *);
+void	 update_win_name(struct ws_win *, struct swm_prefetch *);
 void	 update_win_stacking(struct ws_win *);
 void	 update_window(struct ws_win *);
 void	 draw_frame(struct ws_win *);
@@ -1230,7 +1718,9 @@ int	 validate_win(struct ws_win *);
 int	 validate_ws(struct workspace *);
 void	 version(struct binding *, struct swm_region *, union arg *);
 void	 win_to_ws(struct ws_win *, int, bool);
+struct pid_e	*window_find_pid(xcb_window_t);
 pid_t	 window_get_pid(xcb_window_t);
+pid_t	 window_get_swm_pid(xcb_window_t);
 void	 wkill(struct binding *, struct swm_region *, union arg *);
 void	 update_ws_stack(struct workspace *);
 void	 xft_init(struct swm_region *);
@@ -1241,6 +1731,10 @@ RB_PROTOTYPE(binding_tree, binding, entry, binding_cmp);
 #ifndef __clang_analyzer__ /* Suppress false warnings. */
 RB_GENERATE(binding_tree, binding, entry, binding_cmp);
 #endif
+RB_PROTOTYPE(str_tree, swm_str, entry, str_cmp);
+#ifndef __clang_analyzer__ /* Suppress false warnings. */
+RB_GENERATE(str_tree, swm_str, entry, str_cmp);
+#endif
 
 void
 cursors_load(void)
@@ -1398,6 +1892,9 @@ get_region_index(struct swm_region *r)
 void
 focus_flush(void)
 {
+	if (ctl_batch)
+		return;
+
 	if (focus_mode == SWM_FOCUS_DEFAULT)
 		event_drain(XCB_ENTER_NOTIFY);
 	else
@@ -1424,12 +1921,12 @@ get_atom_from_string(const char *str)
 }
 
 void
-get_wm_protocols(struct ws_win *win) {
+get_wm_protocols(struct ws_win *win, struct swm_prefetch *pf) {
 	int				i;
 	xcb_icccm_get_wm_protocols_reply_t	wpr;
 
-	if (xcb_icccm_get_wm_protocols_reply(conn,
-	    xcb_icccm_get_wm_protocols(conn, win->id, a_prot),
+	if (xcb_icccm_get_wm_protocols_reply(conn, PREFETCH(pf, protocols,
+	    xcb_icccm_get_wm_protocols(conn, win->id, a_prot)),
 	    &wpr, NULL)) {
 		for (i = 0; i < (int)wpr.atoms_len; i++) {
 			if (wpr.atoms[i] == a_takefocus)
@@ -1513,15 +2010,15 @@ teardown_ewmh(void)
 }
 
 void
-ewmh_autoquirk(struct ws_win *win)
+ewmh_autoquirk(struct ws_win *win, struct swm_prefetch *pf)
 {
 	xcb_get_property_reply_t	*r;
 	xcb_get_property_cookie_t	c;
 	xcb_atom_t			*type;
 	int				i, n;
 
-	c = xcb_get_property(conn, 0, win->id,
-	    ewmh[_NET_WM_WINDOW_TYPE].atom, XCB_ATOM_ATOM, 0, UINT32_MAX);
+	c = PREFETCH(pf, window_type, xcb_get_property(conn, 0, win->id,
+	    ewmh[_NET_WM_WINDOW_TYPE].atom, XCB_ATOM_ATOM, 0, UINT32_MAX));
 	r = xcb_get_property_reply(conn, c, NULL);
 	if (r == NULL)
 		return;
@@ -1750,7 +2247,7 @@ ewmh_update_wm_state(struct  ws_win *win) {
 }
 
 void
-ewmh_get_wm_state(struct ws_win *win)
+ewmh_get_wm_state(struct ws_win *win, struct swm_prefetch *pf)
 {
 	xcb_atom_t			*states;
 	xcb_get_property_cookie_t	c;
@@ -1762,8 +2259,8 @@ ewmh_get_wm_state(struct ws_win *win)
 
 	win->ewmh_flags = 0;
 
-	c = xcb_get_property(conn, 0, win->id, ewmh[_NET_WM_STATE].atom,
-	    XCB_ATOM_ATOM, 0, UINT32_MAX);
+	c = PREFETCH(pf, net_wm_state, xcb_get_property(conn, 0, win->id,
+	    ewmh[_NET_WM_STATE].atom, XCB_ATOM_ATOM, 0, UINT32_MAX));
 	r = xcb_get_property_reply(conn, c, NULL);
 	if (r == NULL)
 		return;
@@ -1798,7 +2295,7 @@ dumpwins(struct binding *bp, struct swm_region *r, union arg *args)
 
 	DPRINTF("=== managed window list ws %02d ===\n", r->ws->idx);
 	TAILQ_FOREACH(w, &r->ws->winlist, entry) {
-		state = get_win_state(w->id);
+		state = get_win_state(w->id, NULL);
 		c = xcb_get_window_attributes(conn, w->id);
 		wa = xcb_get_window_attributes_reply(conn, c, NULL);
 		if (wa) {
@@ -1820,7 +2317,7 @@ dumpwins(struct binding *bp, struct swm_region *r, union arg *args)
 
 	DPRINTF("===== unmanaged window list =====\n");
 	TAILQ_FOREACH(w, &r->ws->unmanagedlist, entry) {
-		state = get_win_state(w->id);
+		state = get_win_state(w->id, NULL);
 		c = xcb_get_window_attributes(conn, w->id);
 		wa = xcb_get_window_attributes_reply(conn, c, NULL);
 		if (wa) {
@@ -1834,6 +2331,8 @@ dumpwins(struct binding *bp, struct swm_region *r, union arg *args)
 	}
 
 	DPRINTF("=================================\n");
+
+	stats_dump();
 }
 
 void
@@ -2002,6 +2501,302 @@ debug_toggle(struct binding *b, struct swm_region *r, union arg *s)
 }
 #endif /* SWM_DEBUG */
 
+uint64_t
+monotonic_usec(void)
+{
+	struct timespec		ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+		return (0);
+
+	return ((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+/*
+ * Allocations charged to a subsystem.  The size and tag are kept in a header
+ * in front of the block, so anything obtained here must go to mem_free().
+ */
+void *
+mem_malloc(int tag, size_t size)
+{
+	union swm_mem_hdr	*hdr;
+	struct swm_mem_stat	*ms = &mem_stats[tag];
+
+	if (size > SIZE_MAX - sizeof *hdr) {
+		errno = ENOMEM;
+		return (NULL);
+	}
+	if ((hdr = malloc(sizeof *hdr + size)) == NULL)
+		return (NULL);
+	hdr->h.size = size;
+	hdr->h.tag = tag;
+
+	ms->allocs++;
+	ms->live++;
+	ms->bytes += size;
+	if (ms->bytes > ms->bytes_max)
+		ms->bytes_max = ms->bytes;
+
+	return (hdr + 1);
+}
+
+void *
+mem_calloc(int tag, size_t nmemb, size_t size)
+{
+	void			*p;
+
+	if (size && nmemb > SIZE_MAX / size) {
+		errno = ENOMEM;
+		return (NULL);
+	}
+	if ((p = mem_malloc(tag, nmemb * size)) != NULL)
+		memset(p, 0, nmemb * size);
+
+	return (p);
+}
+
+void *
+mem_realloc(int tag, void *p, size_t size)
+{
+	union swm_mem_hdr	*hdr, *nhdr;
+	struct swm_mem_stat	*ms = &mem_stats[tag];
+
+	if (p == NULL)
+		return (mem_malloc(tag, size));
+
+	hdr = (union swm_mem_hdr *)p - 1;
+	if (size > SIZE_MAX - sizeof *hdr) {
+		errno = ENOMEM;
+		return (NULL);
+	}
+	if ((nhdr = realloc(hdr, sizeof *nhdr + size)) == NULL)
+		return (NULL);
+
+	ms->allocs++;
+	ms->bytes += size - nhdr->h.size;
+	if (ms->bytes > ms->bytes_max)
+		ms->bytes_max = ms->bytes;
+	nhdr->h.size = size;
+
+	return (nhdr + 1);
+}
+
+char *
+mem_strdup(int tag, const char *str)
+{
+	char			*p;
+	size_t			len;
+
+	if (str == NULL)
+		return (NULL);
+
+	len = strlen(str) + 1;
+	if ((p = mem_malloc(tag, len)) != NULL)
+		memcpy(p, str, len);
+
+	return (p);
+}
+
+void
+mem_free(void *p)
+{
+	union swm_mem_hdr	*hdr;
+	struct swm_mem_stat	*ms;
+
+	if (p == NULL)
+		return;
+
+	hdr = (union swm_mem_hdr *)p - 1;
+	ms = &mem_stats[hdr->h.tag];
+	ms->live--;
+	ms->bytes -= hdr->h.size;
+	free(hdr);
+}
+
+uint64_t		rtt_start_usec = 0;
+
+/* Count a round trip and tell tracers which call site is about to block. */
+void
+rtt_begin(int line)
+{
+	/* suppress unused warning since var is needed */
+	(void)line;
+
+	stat_rtt++;
+	SWM_PROBE1(reply, line);
+	/* Two clock reads per reply; only time them if they can be read. */
+	if (stats_file != NULL || ctl_path != NULL)
+		rtt_start_usec = monotonic_usec();
+}
+
+/* Account the wait since rtt_begin(); returns reply. */
+void *
+rtt_end(void *reply)
+{
+	if (rtt_start_usec) {
+		stat_blocked_usec += monotonic_usec() - rtt_start_usec;
+		rtt_start_usec = 0;
+	}
+	return (reply);
+}
+
+uint8_t
+rtt_end8(uint8_t reply)
+{
+	rtt_end(NULL);
+	return (reply);
+}
+
+/* Account a handler that began at start with stat_rtt at rtt_start. */
+void
+stat_record(struct swm_stat *st, int kind, int id, uint64_t start,
+    uint64_t rtt_start)
+{
+	struct swm_trace	*t;
+	uint64_t		usec, rtt;
+	int			b;
+
+	usec = monotonic_usec() - start;
+	rtt = stat_rtt - rtt_start;
+
+	/* Complain about each new maximum over budget, not every call. */
+	if (st->rtt_budgeted && rtt > st->rtt_budget) {
+		st->rtt_over++;
+		if (rtt > st->rtt_max)
+			rtt_budget_exceeded(kind, id, rtt, st->rtt_budget);
+	}
+
+	st->count++;
+	st->usec += usec;
+	st->rtt += rtt;
+	if (usec > st->usec_max)
+		st->usec_max = usec;
+	if (rtt > st->rtt_max)
+		st->rtt_max = rtt;
+	for (b = 0; b < SWM_HIST_BUCKETS - 1 && usec >= (1ULL << b); b++)
+		;
+	st->hist[b]++;
+
+	if (kind == SWM_TRACE_FUNC)
+		return;
+
+	t = &trace_ring[trace_next++ % SWM_TRACE_LEN];
+	t->start = start;
+	t->usec = usec > UINT32_MAX ? UINT32_MAX : usec;
+	t->rtt = rtt > UINT16_MAX ? UINT16_MAX : rtt;
+	t->kind = kind;
+	t->id = id;
+}
+
+void
+stat_print(const char *name, struct swm_stat *st)
+{
+	int			b;
+
+	if (st->count == 0)
+		return;
+
+	fprintf(stderr, "%-24s n %8llu avg %6llu max %8llu us rtt/n %4.1f "
+	    "max %3llu", name, (unsigned long long)st->count,
+	    (unsigned long long)(st->usec / st->count),
+	    (unsigned long long)st->usec_max,
+	    (double)st->rtt / st->count, (unsigned long long)st->rtt_max);
+	if (st->rtt_budgeted)
+		fprintf(stderr, " budget %u over %llu", st->rtt_budget,
+		    (unsigned long long)st->rtt_over);
+	fprintf(stderr, " |");
+	for (b = 0; b < SWM_HIST_BUCKETS; b++)
+		if (st->hist[b])
+			fprintf(stderr, " <%llu:%u", 1ULL << b, st->hist[b]);
+	fprintf(stderr, "\n");
+}
+
+void
+phase_begin(void)
+{
+	const char		*v, *errstr;
+	uint64_t		requested;
+
+	startup_begin = phase_last = monotonic_usec();
+	phase_rtt = stat_rtt;
+
+	/* Set by restart() in the process we replaced. */
+	if ((v = getenv("SWM_RESTART_USEC"))) {
+		requested = strtonum(v, 0, LLONG_MAX, &errstr);
+		if (errstr == NULL && requested <= startup_begin)
+			restart_usec = startup_begin - requested;
+		unsetenv("SWM_RESTART_USEC");
+	}
+}
+
+/* Account everything since the previous mark to phase name. */
+void
+phase_mark(const char *name)
+{
+	uint64_t		now = monotonic_usec();
+
+	if (nphases < SWM_PHASE_MAX) {
+		phases[nphases].name = name;
+		phases[nphases].usec = now - phase_last;
+		phases[nphases].rtt = stat_rtt - phase_rtt;
+		nphases++;
+	}
+	phase_last = now;
+	phase_rtt = stat_rtt;
+}
+
+void
+phase_report(FILE *f)
+{
+	uint64_t		rtt = 0;
+	int			i;
+
+	if (nphases == 0)
+		return;
+
+	for (i = 0; i < nphases; i++)
+		rtt += phases[i].rtt;
+
+	fprintf(f, "=== spectrwm %s: %llu.%03llu ms, %llu round trips, server "
+	    "grabbed %llu.%03llu ms ===\n", restart_usec ? "restart" : "startup",
+	    (unsigned long long)((phase_last - startup_begin) / 1000),
+	    (unsigned long long)((phase_last - startup_begin) % 1000),
+	    (unsigned long long)rtt,
+	    (unsigned long long)(grab_usec / 1000),
+	    (unsigned long long)(grab_usec % 1000));
+	if (restart_usec)
+		fprintf(f, "%-20s %8llu.%03llu ms\n", "shutdown+exec",
+		    (unsigned long long)(restart_usec / 1000),
+		    (unsigned long long)(restart_usec % 1000));
+	for (i = 0; i < nphases; i++)
+		fprintf(f, "%-20s %8llu.%03llu ms rtt %llu\n", phases[i].name,
+		    (unsigned long long)(phases[i].usec / 1000),
+		    (unsigned long long)(phases[i].usec % 1000),
+		    (unsigned long long)phases[i].rtt);
+}
+
+/* Write the startup profile to startup_profile, "-" meaning stderr. */
+void
+phase_write(void)
+{
+	FILE			*f;
+
+	if (startup_profile == NULL)
+		return;
+
+	if (strcmp(startup_profile, "-") == 0) {
+		phase_report(stderr);
+		return;
+	}
+
+	if ((f = fopen(startup_profile, "a")) == NULL) {
+		warn("startup_profile: %s", startup_profile);
+		return;
+	}
+	phase_report(f);
+	fclose(f);
+}
+
 void
 sighdlr(int sig)
 {
@@ -2040,6 +2835,9 @@ sighdlr(int sig)
 	case SIGHUP:
 		restart_wm = 1;
 		break;
+	case SIGUSR1:
+		stats_dump_pending = 1;
+		break;
 	case SIGINT:
 	case SIGTERM:
 	case SIGQUIT:
@@ -2060,7 +2858,7 @@ find_pid(pid_t pid)
 	if (pid == 0)
 		return (NULL);
 
-	TAILQ_FOREACH(p, &pidlist, entry) {
+	TAILQ_FOREACH(p, &pidhash[SWM_PID_HASH(pid)], entry) {
 		if (p->pid == pid)
 			return (p);
 	}
@@ -2068,67 +2866,326 @@ find_pid(pid_t pid)
 	return (NULL);
 }
 
-uint32_t
-name_to_pixel(int sidx, const char *colorname)
+time_t
+pid_now(void)
 {
-	uint32_t			result = 0;
-	char				cname[32] = "#";
-	xcb_screen_t			*screen;
-	xcb_colormap_t			cmap;
-	xcb_alloc_color_reply_t		*cr;
-	xcb_alloc_named_color_reply_t	*nr;
-	uint16_t			rr, gg, bb;
+	struct timespec		ts;
 
-	screen = get_screen(sidx);
-	cmap = screen->default_colormap;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+		return (time(NULL));
 
-	/* color is in format rgb://rr/gg/bb */
-	if (strncmp(colorname, "rgb:", 4) == 0) {
-		if (parse_rgb(colorname, &rr, &gg, &bb) == -1)
-			warnx("could not parse rgb %s", colorname);
-		else {
-			cr = xcb_alloc_color_reply(conn,
-			    xcb_alloc_color(conn, cmap, rr, gg, bb),
-			    NULL);
-			if (cr) {
-				result = cr->pixel;
-				free(cr);
-			} else
-				warnx("color '%s' not found", colorname);
-		}
-	} else {
-		nr = xcb_alloc_named_color_reply(conn,
-			xcb_alloc_named_color(conn, cmap, strlen(colorname),
-			    colorname), NULL);
-		if (nr == NULL) {
-			strlcat(cname, colorname + 2, sizeof cname - 1);
-			nr = xcb_alloc_named_color_reply(conn,
-			    xcb_alloc_named_color(conn, cmap, strlen(cname),
-			    cname), NULL);
+	return (ts.tv_sec);
+}
+
+/*
+ * Track pid so windows it maps later land on workspace ws.  Where the kernel
+ * supports it a pidfd is opened so the main loop is told when pid exits;
+ * elsewhere pid_expire() notices via kill(2).
+ */
+struct pid_e *
+pid_insert(pid_t pid, int ws)
+{
+	struct pid_e		*p;
+
+	if (pid <= 0)
+		return (NULL);
+
+	if ((p = find_pid(pid)) == NULL) {
+		if ((p = mem_calloc(SWM_MEM_PIDS, 1, sizeof *p)) == NULL) {
+			warn("pid_insert: calloc");
+			return (NULL);
 		}
-		if (nr) {
-			result = nr->pixel;
-			free(nr);
-		} else
-			warnx("color '%s' not found", colorname);
+		p->pid = pid;
+		p->pidfd = -1;
+		TAILQ_INSERT_TAIL(&pidhash[SWM_PID_HASH(pid)], p, entry);
+		pid_count++;
 	}
 
-	return (result);
+	p->ws = ws;
+	p->expire = 0;
+
+#if defined(__linux__) && defined(SYS_pidfd_open)
+	if (p->pidfd == -1) {
+		p->pidfd = syscall(SYS_pidfd_open, pid, 0);
+		if (p->pidfd != -1)
+			pidfd_count++;
+		else if (errno == ESRCH)
+			/* Already reaped by sighdlr. */
+			pid_exited(p);
+	}
+#endif
+
+	DNPRINTF(SWM_D_MISC, "pid: %d, ws: %d, pidfd: %d\n", pid, ws,
+	    p->pidfd);
+
+	return (p);
 }
 
 void
-setscreencolor(const char *val, int i, int c)
+pid_remove(struct pid_e *p)
 {
-	if (i < 0 || i >= get_screen_count())
+	if (p == NULL)
 		return;
 
-	screens[i].c[c].pixel = name_to_pixel(i, val);
-	free(screens[i].c[c].name);
-	if ((screens[i].c[c].name = strdup(val)) == NULL)
-		err(1, "strdup");
-}
+	DNPRINTF(SWM_D_MISC, "pid: %d\n", p->pid);
 
-void
+	if (p->pidfd != -1) {
+		close(p->pidfd);
+		pidfd_count--;
+	}
+
+	TAILQ_REMOVE(&pidhash[SWM_PID_HASH(p->pid)], p, entry);
+	pid_count--;
+	mem_free(p);
+}
+
+/*
+ * The process is gone but its children may still map windows carrying its
+ * _SWM_PID, e.g. when a shell script backgrounds a client and exits.  Keep the
+ * entry around for a grace period instead of dropping it right away.
+ */
+void
+pid_exited(struct pid_e *p)
+{
+	DNPRINTF(SWM_D_MISC, "pid: %d\n", p->pid);
+
+	if (p->pidfd != -1) {
+		close(p->pidfd);
+		p->pidfd = -1;
+		pidfd_count--;
+	}
+
+	p->expire = pid_now() + SWM_PID_TTL;
+}
+
+/* Drop entries whose grace period has run out; runs at most once a second. */
+void
+pid_expire(void)
+{
+	struct pid_e		*p, *tmp;
+	static time_t		last = 0;
+	time_t			now;
+	int			i;
+
+	now = pid_now();
+	if (now == last)
+		return;
+	last = now;
+
+	for (i = 0; i < SWM_PID_HASH_SIZE; i++)
+		TAILQ_FOREACH_SAFE(p, &pidhash[i], entry, tmp) {
+			if (p->expire == 0 && p->pidfd == -1 &&
+			    kill(p->pid, 0) == -1 && errno == ESRCH)
+				pid_exited(p);
+			else if (p->expire && now >= p->expire)
+				pid_remove(p);
+		}
+}
+
+/*
+ * Parent pid of pid, read from /proc/<pid>/stat.  Lookups are cached for a few
+ * seconds since a client and its siblings tend to map several windows at once.
+ */
+pid_t
+pid_get_ppid(pid_t pid)
+{
+#ifdef __linux__
+	static struct ppid_cache {
+		pid_t			pid;
+		pid_t			ppid;
+		time_t			stamp;
+	}			cache[SWM_PID_HASH_SIZE];
+	struct ppid_cache	*c;
+	char			path[64], buf[256], *p;
+	int			fd, ppid = 0;
+	ssize_t			len;
+	time_t			now;
+
+	if (pid <= 1)
+		return (0);
+
+	now = pid_now();
+	c = &cache[SWM_PID_HASH(pid)];
+	if (c->pid == pid && now - c->stamp < SWM_PPID_CACHE_TTL)
+		return (c->ppid);
+
+	snprintf(path, sizeof path, "/proc/%d/stat", pid);
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return (0);
+	len = read(fd, buf, sizeof buf - 1);
+	close(fd);
+	if (len <= 0)
+		return (0);
+	buf[len] = '\0';
+
+	/* comm may contain anything, skip to the last ')' */
+	if ((p = strrchr(buf, ')')) == NULL ||
+	    sscanf(p + 1, " %*c %d", &ppid) != 1)
+		return (0);
+
+	c->pid = pid;
+	c->ppid = ppid;
+	c->stamp = now;
+
+	return (ppid);
+#else
+	/* suppress unused warning since var is needed */
+	(void)pid;
+
+	return (0);
+#endif
+}
+
+/* Nearest tracked process among pid and its ancestors. */
+struct pid_e *
+find_pid_ancestor(pid_t pid)
+{
+	struct pid_e		*p;
+	int			depth;
+
+	for (depth = 0; pid > 1 && depth < SWM_PID_MAX_DEPTH; depth++) {
+		if ((p = find_pid(pid)) != NULL)
+			return (p);
+		pid = pid_get_ppid(pid);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Append a pollfd for each watched pid to pfd starting at idx, growing pfd as
+ * needed.  Returns the total number of pollfds.
+ */
+int
+pid_pollfds(struct pollfd **pfd, int *pfd_size, int idx)
+{
+	struct pid_e		*p;
+	int			i, n;
+
+	n = idx + pidfd_count;
+	if (n > *pfd_size) {
+		if ((*pfd = realloc(*pfd, n * sizeof **pfd)) == NULL)
+			err(1, "pid_pollfds: realloc");
+		*pfd_size = n;
+	}
+	if (pidfd_count > pidfd_watch_size) {
+		if ((pidfd_watch = realloc(pidfd_watch, pidfd_count *
+		    sizeof *pidfd_watch)) == NULL)
+			err(1, "pid_pollfds: realloc");
+		pidfd_watch_size = pidfd_count;
+	}
+
+	n = idx;
+	for (i = 0; i < SWM_PID_HASH_SIZE; i++)
+		TAILQ_FOREACH(p, &pidhash[i], entry) {
+			if (p->pidfd == -1)
+				continue;
+			pidfd_watch[n - idx] = p;
+			(*pfd)[n].fd = p->pidfd;
+			(*pfd)[n].events = POLLIN;
+			(*pfd)[n].revents = 0;
+			n++;
+		}
+
+	return (n);
+}
+
+/* pfd must be the pidfd part of the poll set built by pid_pollfds(). */
+void
+pid_pollfds_check(struct pollfd *pfd, int npfd)
+{
+	int			i;
+
+	for (i = 0; i < npfd; i++)
+		if (pfd[i].revents & (POLLIN | POLLHUP | POLLERR))
+			pid_exited(pidfd_watch[i]);
+}
+
+void
+setup_pids(void)
+{
+	int			i;
+
+	for (i = 0; i < SWM_PID_HASH_SIZE; i++)
+		TAILQ_INIT(&pidhash[i]);
+}
+
+void
+clear_pids(void)
+{
+	struct pid_e		*p;
+	int			i;
+
+	for (i = 0; i < SWM_PID_HASH_SIZE; i++)
+		while ((p = TAILQ_FIRST(&pidhash[i])) != NULL)
+			pid_remove(p);
+
+	free(pidfd_watch);
+	pidfd_watch = NULL;
+	pidfd_watch_size = 0;
+}
+
+uint32_t
+name_to_pixel(int sidx, const char *colorname)
+{
+	uint32_t			result = 0;
+	char				cname[32] = "#";
+	xcb_screen_t			*screen;
+	xcb_colormap_t			cmap;
+	xcb_alloc_color_reply_t		*cr;
+	xcb_alloc_named_color_reply_t	*nr;
+	uint16_t			rr, gg, bb;
+
+	screen = get_screen(sidx);
+	cmap = screen->default_colormap;
+
+	/* color is in format rgb://rr/gg/bb */
+	if (strncmp(colorname, "rgb:", 4) == 0) {
+		if (parse_rgb(colorname, &rr, &gg, &bb) == -1)
+			warnx("could not parse rgb %s", colorname);
+		else {
+			cr = xcb_alloc_color_reply(conn,
+			    xcb_alloc_color(conn, cmap, rr, gg, bb),
+			    NULL);
+			if (cr) {
+				result = cr->pixel;
+				free(cr);
+			} else
+				warnx("color '%s' not found", colorname);
+		}
+	} else {
+		nr = xcb_alloc_named_color_reply(conn,
+			xcb_alloc_named_color(conn, cmap, strlen(colorname),
+			    colorname), NULL);
+		if (nr == NULL) {
+			strlcat(cname, colorname + 2, sizeof cname - 1);
+			nr = xcb_alloc_named_color_reply(conn,
+			    xcb_alloc_named_color(conn, cmap, strlen(cname),
+			    cname), NULL);
+		}
+		if (nr) {
+			result = nr->pixel;
+			free(nr);
+		} else
+			warnx("color '%s' not found", colorname);
+	}
+
+	return (result);
+}
+
+void
+setscreencolor(const char *val, int i, int c)
+{
+	if (i < 0 || i >= get_screen_count())
+		return;
+
+	screens[i].c[c].pixel = name_to_pixel(i, val);
+	free(screens[i].c[c].name);
+	if ((screens[i].c[c].name = strdup(val)) == NULL)
+		err(1, "strdup");
+}
+
+void
 fancy_stacker(struct workspace *ws)
 {
 	strlcpy(ws->stacker, "[   ]", sizeof ws->stacker);
@@ -2331,8 +3388,8 @@ bar_window_class(char *s, size_t sz, struct swm_region *r)
 {
 	if (r == NULL || r->ws == NULL || r->ws->focus == NULL)
 		return;
-	if (r->ws->focus->ch.class_name != NULL)
-		strlcat(s, r->ws->focus->ch.class_name, sz);
+	if (r->ws->focus->class != NULL)
+		strlcat(s, r->ws->focus->class, sz);
 }
 
 void
@@ -2340,8 +3397,8 @@ bar_window_instance(char *s, size_t sz, struct swm_region *r)
 {
 	if (r == NULL || r->ws == NULL || r->ws->focus == NULL)
 		return;
-	if (r->ws->focus->ch.instance_name != NULL)
-		strlcat(s, r->ws->focus->ch.instance_name, sz);
+	if (r->ws->focus->instance != NULL)
+		strlcat(s, r->ws->focus->instance, sz);
 }
 
 void
@@ -2369,14 +3426,10 @@ bar_window_state(char *s, size_t sz, struct swm_region *r)
 void
 bar_window_name(char *s, size_t sz, struct swm_region *r)
 {
-	char		*title;
-
 	if (r == NULL || r->ws == NULL || r->ws->focus == NULL)
 		return;
 
-	title = get_win_name(r->ws->focus->id);
-	strlcat(s, title, sz);
-	free(title);
+	strlcat(s, r->ws->focus->title, sz);
 }
 
 bool
@@ -2713,6 +3766,7 @@ bar_draw(struct swm_bar *bar)
 	struct swm_region	*r;
 	char			fmtexp[SWM_BAR_MAX], fmtnew[SWM_BAR_MAX];
 	char			fmtrep[SWM_BAR_MAX];
+	uint64_t		start, rtt_start;
 
 	/* expand the format by first passing it through strftime(3) */
 	bar_fmt_expand(fmtexp, sizeof fmtexp);
@@ -2729,6 +3783,10 @@ bar_draw(struct swm_bar *bar)
 		return;
 	}
 
+	start = monotonic_usec();
+	rtt_start = stat_rtt;
+	SWM_PROBE1(bar_draw_start, r->id);
+
 	if (startup_exception)
 		snprintf(fmtrep, sizeof fmtrep, "total "
 		    "exceptions: %d, first exception: %s",
@@ -2743,6 +3801,10 @@ bar_draw(struct swm_bar *bar)
 		bar_print_legacy(r, fmtrep);
 	else
 		bar_print(r, fmtrep);
+
+	stat_record(&stat_funcs[SWM_STAT_BAR_DRAW], SWM_TRACE_FUNC,
+	    SWM_STAT_BAR_DRAW, start, rtt_start);
+	SWM_PROBE1(bar_draw_done, r->id);
 }
 
 /*
@@ -3021,7 +4083,8 @@ bar_setup(struct swm_region *r)
 	if (r->bar != NULL)
 		return;
 
-	if ((r->bar = calloc(1, sizeof(struct swm_bar))) == NULL)
+	if ((r->bar = mem_calloc(SWM_MEM_BAR, 1,
+	    sizeof(struct swm_bar))) == NULL)
 		err(1, "bar_setup: calloc: failed to allocate memory.");
 
 	if (bar_font_legacy)
@@ -3072,6 +4135,43 @@ bar_setup(struct swm_region *r)
 	bar_extra_setup();
 }
 
+/* Follow a change of region geometry, keeping the bar window. */
+void
+bar_resize(struct swm_region *r)
+{
+	xcb_screen_t	*screen;
+	uint32_t	 wa[4];
+	int		 w;
+
+	if (r->bar == NULL)
+		return;
+
+	if ((screen = get_screen(r->s->idx)) == NULL)
+		errx(1, "ERROR: can't get screen %d.", r->s->idx);
+
+	X(r->bar) = X(r);
+	Y(r->bar) = bar_at_bottom ? (Y(r) + HEIGHT(r) - bar_height) : Y(r);
+	w = WIDTH(r) - 2 * bar_border_width;
+	if (w != WIDTH(r->bar)) {
+		WIDTH(r->bar) = w;
+		xcb_free_pixmap(conn, r->bar->buffer);
+		r->bar->buffer = xcb_generate_id(conn);
+		xcb_create_pixmap(conn, screen->root_depth, r->bar->buffer,
+		    r->bar->id, WIDTH(r->bar), HEIGHT(r->bar));
+	}
+
+	wa[0] = X(r->bar);
+	wa[1] = Y(r->bar);
+	wa[2] = WIDTH(r->bar);
+	wa[3] = HEIGHT(r->bar);
+	xcb_configure_window(conn, r->bar->id, XCB_CONFIG_WINDOW_X |
+	    XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH |
+	    XCB_CONFIG_WINDOW_HEIGHT, wa);
+
+	DNPRINTF(SWM_D_BAR, "win %#x, (x,y) w x h: (%d,%d) %d x %d\n",
+	    WINID(r->bar), X(r->bar), Y(r->bar), WIDTH(r->bar), HEIGHT(r->bar));
+}
+
 void
 bar_cleanup(struct swm_region *r)
 {
@@ -3079,7 +4179,7 @@ bar_cleanup(struct swm_region *r)
 		return;
 	xcb_destroy_window(conn, r->bar->id);
 	xcb_free_pixmap(conn, r->bar->buffer);
-	free(r->bar);
+	mem_free(r->bar);
 	r->bar = NULL;
 }
 
@@ -3099,13 +4199,14 @@ set_win_state(struct ws_win *win, uint8_t state)
 }
 
 uint8_t
-get_win_state(xcb_window_t w)
+get_win_state(xcb_window_t w, struct swm_prefetch *pf)
 {
 	xcb_get_property_reply_t	*r;
 	xcb_get_property_cookie_t	c;
 	uint32_t			result = 0;
 
-	c = xcb_get_property(conn, 0, w, a_state, a_state, 0L, 2L);
+	c = PREFETCH(pf, wm_state, xcb_get_property(conn, 0, w, a_state,
+	    a_state, 0L, 2L));
 	r = xcb_get_property_reply(conn, c, NULL);
 	if (r) {
 		if (r->type == a_state && r->format == 32 && r->length == 2)
@@ -3283,6 +4384,11 @@ quit(struct binding *bp, struct swm_region *r, union arg *args)
 
 	DNPRINTF(SWM_D_MISC, "shutting down...\n");
 	running = 0;
+
+	/* Nothing to recover from. */
+	session_due = 0;
+	if (session_file)
+		unlink(session_file);
 }
 
 void
@@ -3535,6 +4641,8 @@ fake_keypress(struct ws_win *win, xcb_keysym_t keysym, uint16_t modifiers)
 void
 restart(struct binding *bp, struct swm_region *r, union arg *args)
 {
+	char			usec[32];
+
 	/* suppress unused warning since var is needed */
 	(void)bp;
 	(void)r;
@@ -3542,6 +4650,12 @@ restart(struct binding *bp, struct swm_region *r, union arg *args)
 
 	DNPRINTF(SWM_D_MISC, "%s\n", start_argv[0]);
 
+	/* Let the new process report how long the restart took. */
+	snprintf(usec, sizeof usec, "%llu",
+	    (unsigned long long)monotonic_usec());
+	setenv("SWM_RESTART_USEC", usec, 1);
+
+	state_save();
 	shutdown_cleanup();
 
 	execvp(start_argv[0], start_argv);
@@ -3549,6 +4663,253 @@ restart(struct binding *bp, struct swm_region *r, union arg *args)
 	quit(NULL, NULL, NULL);
 }
 
+/*
+ * Re-read the config file in place and redo only what it changed.  Bindings,
+ * quirks and programs are rebuilt from their defaults, as at startup; other
+ * options keep their current value unless the file sets them.  The whole file
+ * is checked first; if it has errors, the running configuration is kept and
+ * the first error is shown in the bar.
+ */
+void
+reload(struct binding *bp, struct swm_region *r, union arg *args)
+{
+	struct binding_tree	old_bindings, new_bindings;
+	struct quirk		*qp;
+	struct spawn_list	old_spawns;
+	struct spawn_prog	*sp;
+	struct conf_value	*cv, *cvtmp;
+	struct swm_region	*tr;
+	struct workspace	*ws;
+	struct ws_win		*win;
+	struct stat		sb;
+	uint32_t		*pixel, wa[2];
+	char			*old_fonts, *old_action = NULL, *str;
+	int			i, j, num_screens;
+	int			old_border_width, old_tile_gap, old_padding;
+	int			old_bar_border, old_hide_bar;
+	bool			old_disable_border, old_bar_enabled;
+	bool			old_bar_bottom, old_legacy;
+	bool			frames, bars, new_bars, restack;
+
+	/* suppress unused warning since var is needed */
+	(void)bp;
+	(void)r;
+	(void)args;
+
+	if (conf_path == NULL || stat(conf_path, &sb) == -1 ||
+	    !S_ISREG(sb.st_mode)) {
+		warnx("reload: no config file");
+		return;
+	}
+
+	DNPRINTF(SWM_D_CONF, "%s\n", conf_path);
+
+	/*
+	 * Check the whole file before anything is applied.  Programs are staged
+	 * for real since bindings refer to them; the rest is only parsed.
+	 */
+	TAILQ_INIT(&old_spawns);
+	while ((sp = TAILQ_FIRST(&spawns)) != NULL) {
+		TAILQ_REMOVE(&spawns, sp, entry);
+		TAILQ_INSERT_TAIL(&old_spawns, sp, entry);
+	}
+	setup_spawn();
+
+	free(startup_exception);
+	startup_exception = NULL;
+	nr_exceptions = 0;
+	old_bar_enabled = bar_enabled;
+
+	conf_reloading = conf_checking = true;
+	conf_load(conf_path, SWM_CONF_DEFAULT);
+	conf_reloading = conf_checking = false;
+
+	num_screens = get_screen_count();
+	if (nr_exceptions) {
+		clear_spawns();
+		while ((sp = TAILQ_FIRST(&old_spawns)) != NULL) {
+			TAILQ_REMOVE(&old_spawns, sp, entry);
+			TAILQ_INSERT_TAIL(&spawns, sp, entry);
+		}
+
+		if (startup_exception) {
+			if (asprintf(&str, "reload failed, old configuration "
+			    "kept: %s", startup_exception) == -1)
+				err(1, "reload: asprintf");
+			free(startup_exception);
+			startup_exception = str;
+			warnx("%s", startup_exception);
+		}
+
+		/* The exception forces the bar on. */
+		for (i = 0; i < num_screens; i++)
+			TAILQ_FOREACH(tr, &screens[i].rl, entry) {
+				if (old_bar_enabled != bar_enabled)
+					stack(tr);
+				bar_draw(tr->bar);
+			}
+		focus_flush();
+		return;
+	}
+
+	while ((sp = TAILQ_FIRST(&old_spawns)) != NULL) {
+		TAILQ_REMOVE(&old_spawns, sp, entry);
+		spawn_free(sp);
+	}
+
+	/* Keep what decides the X requests needed afterwards. */
+	if ((pixel = calloc(num_screens * SWM_S_COLOR_MAX,
+	    sizeof *pixel)) == NULL)
+		err(1, "reload: calloc");
+	for (i = 0; i < num_screens; i++)
+		for (j = 0; j < SWM_S_COLOR_MAX; j++)
+			pixel[i * SWM_S_COLOR_MAX + j] = screens[i].c[j].pixel;
+
+	old_border_width = border_width;
+	old_tile_gap = tile_gap;
+	old_padding = region_padding;
+	old_bar_border = bar_border_width;
+	old_hide_bar = maximize_hide_bar;
+	old_disable_border = disable_border;
+	old_bar_bottom = bar_at_bottom;
+	old_legacy = bar_font_legacy;
+
+	/* bar_font accumulates, so start over from the default. */
+	old_fonts = bar_fonts;
+	if ((bar_fonts = strdup(SWM_BAR_FONTS)) == NULL)
+		err(1, "reload: strdup");
+	bar_font_legacy = true;
+	if (bar_argv[0] && (old_action = strdup(bar_argv[0])) == NULL)
+		err(1, "reload: strdup");
+
+	/* Stage bindings and quirks, starting from the defaults. */
+	old_bindings = bindings;
+	RB_INIT(&bindings);
+	while ((qp = TAILQ_FIRST(&quirks)) != NULL) {
+		TAILQ_REMOVE(&quirks, qp, entry);
+		TAILQ_INSERT_TAIL(&quirks_old, qp, entry);
+	}
+	quirks_dirty = true;
+	setup_keybindings();
+	setup_btnbindings();
+	setup_quirks();
+
+	TAILQ_FOREACH(cv, &conf_values, entry)
+		cv->seen = false;
+	conf_restack = false;
+
+	conf_reloading = true;
+	conf_load(conf_path, SWM_CONF_DEFAULT);
+	conf_reloading = false;
+	validate_spawns();
+
+	/* Forget entries that are gone from the file. */
+	TAILQ_FOREACH_SAFE(cv, &conf_values, entry, cvtmp) {
+		if (cv->seen)
+			continue;
+		TAILQ_REMOVE(&conf_values, cv, entry);
+		free(cv->key);
+		free(cv->value);
+		free(cv);
+	}
+
+	/* Quirks that were not defined again. */
+	while ((qp = TAILQ_FIRST(&quirks_old)) != NULL) {
+		TAILQ_REMOVE(&quirks_old, qp, entry);
+		quirk_free(qp);
+	}
+
+	/*
+	 * The key table must point into the new tree, so grabkeys() always
+	 * runs; it sends nothing if the grabs are the same.  Buttons are only
+	 * regrabbed if their bindings changed.
+	 */
+	grabkeys();
+	if (bindings_differ(&old_bindings, &bindings, BTNBIND))
+		grabbuttons();
+	new_bindings = bindings;
+	bindings = old_bindings;
+	clear_bindings();
+	bindings = new_bindings;
+
+	if ((old_action == NULL) != (bar_argv[0] == NULL) ||
+	    (old_action && strcmp(old_action, bar_argv[0]))) {
+		bar_extra_stop();
+		bar_extra_setup();
+	}
+	free(old_action);
+
+	/* A new font or bar height needs new bars. */
+	new_bars = (strcmp(old_fonts, bar_fonts) ||
+	    old_legacy != bar_font_legacy ||
+	    old_bar_border != bar_border_width ||
+	    old_bar_bottom != bar_at_bottom);
+	free(old_fonts);
+	if (new_bars && bar_font) {
+		XftFontClose(display, bar_font);
+		bar_font = NULL;
+	}
+
+	restack = (new_bars || conf_restack ||
+	    old_border_width != border_width ||
+	    old_tile_gap != tile_gap ||
+	    old_padding != region_padding ||
+	    old_hide_bar != maximize_hide_bar ||
+	    old_disable_border != disable_border ||
+	    old_bar_enabled != bar_enabled);
+
+	for (i = 0; i < num_screens; i++) {
+		frames = bars = false;
+		for (j = 0; j < SWM_S_COLOR_MAX; j++) {
+			if (pixel[i * SWM_S_COLOR_MAX + j] ==
+			    screens[i].c[j].pixel)
+				continue;
+			if (j >= SWM_S_COLOR_FOCUS)
+				frames = true;
+			else
+				bars = true;
+		}
+
+		TAILQ_FOREACH(tr, &screens[i].rl, entry) {
+			if (new_bars) {
+				bar_cleanup(tr);
+				bar_setup(tr);
+			} else if (bars && !bar_font_legacy)
+				xft_init(tr);
+
+			if (new_bars || bars) {
+				wa[0] = tr->s->c[SWM_S_COLOR_BAR].pixel;
+				wa[1] = tr->s->c[tr == tr->s->r_focus ?
+				    SWM_S_COLOR_BAR_BORDER :
+				    SWM_S_COLOR_BAR_BORDER_UNFOCUS].pixel;
+				xcb_change_window_attributes(conn, tr->bar->id,
+				    XCB_CW_BACK_PIXEL | XCB_CW_BORDER_PIXEL,
+				    wa);
+			}
+
+			if (restack)
+				stack(tr);
+			else
+				tr->ws->cur_layout->l_string(tr->ws);
+			bar_draw(tr->bar);
+		}
+
+		/* Repaint frames in place. */
+		if (frames)
+			for (j = 0; j < workspace_limit; j++) {
+				ws = &screens[i].ws[j];
+				TAILQ_FOREACH(win, &ws->winlist, entry)
+					draw_frame(win);
+			}
+	}
+	free(pixel);
+
+	focus_flush();
+
+	DNPRINTF(SWM_D_CONF, "bars: %s, stack: %s\n", YESNO(new_bars),
+	    YESNO(restack));
+}
+
 struct ws_win *
 get_pointer_win(xcb_window_t root)
 {
@@ -3808,6 +5169,7 @@ spawn(int ws_idx, union arg *args, bool close_fd)
 	if (signal(SIGPIPE, SIG_DFL) == SIG_ERR)
 		err(1, "could not reset SIGPIPE");
 
+	SWM_PROBE2(spawn, ws_idx, args->argv[0]);
 	execvp(args->argv[0], args->argv);
 
 	warn("spawn: execvp");
@@ -3967,6 +5329,7 @@ focus_win(struct ws_win *win)
 	xcb_get_window_attributes_reply_t	*war = NULL;
 
 	DNPRINTF(SWM_D_FOCUS, "win %#x\n", WINID(win));
+	SWM_PROBE1(focus_win, WINID(win));
 
 	if (win == NULL || win->ws == NULL || !win->mapped)
 		goto out;
@@ -4256,6 +5619,8 @@ switchws(struct binding *bp, struct swm_region *r, union arg *args)
 	if (new_ws == old_ws)
 		return;
 
+	SWM_PROBE2(switchws, old_ws->idx, wsid);
+
 	other_r = new_ws->r;
 	if (other_r && workspace_clamp &&
 	    bp->action != FN_RG_MOVE_NEXT && bp->action != FN_RG_MOVE_PREV) {
@@ -4977,6 +6342,16 @@ stack(struct swm_region *r) {
 	if (r == NULL)
 		return;
 
+	stat_stack++;
+	session_touch();
+
+	/* Batched ctl commands restack each region once at the end. */
+	if (ctl_batch) {
+		r->stack_pending = true;
+		return;
+	}
+	r->stack_pending = false;
+
 	DNPRINTF(SWM_D_STACK, "begin\n");
 
 	/* Adjust stack area for region bar and padding. */
@@ -5015,6 +6390,7 @@ stack(struct swm_region *r) {
 		    XCB_CONFIG_WINDOW_STACK_MODE, val);
 	}
 
+	SWM_PROBE2(stack_start, r->ws->idx, count_win(r->ws, false));
 	r->ws->cur_layout->l_stack(r->ws, &g);
 	r->ws->cur_layout->l_string(r->ws);
 	/* save r so we can track region changes */
@@ -5023,6 +6399,7 @@ stack(struct swm_region *r) {
 	if (font_adjusted)
 		font_adjusted--;
 
+	SWM_PROBE2(stack_done, r->ws->idx, count_win(r->ws, false));
 	DNPRINTF(SWM_D_STACK, "end\n");
 }
 
@@ -5037,6 +6414,7 @@ store_float_geom(struct ws_win *win)
 	win->g_float.x -= X(win->ws->r);
 	win->g_float.y -= Y(win->ws->r);
 	win->g_floatvalid = true;
+	session_touch();
 	DNPRINTF(SWM_D_MISC, "win %#x, g: (%d,%d) %d x %d, g_float: (%d,%d) "
 	    "%d x %d\n", win->id, X(win), Y(win), WIDTH(win), HEIGHT(win),
 	    win->g_float.x, win->g_float.y, win->g_float.w, win->g_float.h);
@@ -5173,101 +6551,64 @@ adjust_font(struct ws_win *win)
 	}
 }
 
-#define SWAPXY(g)	do {				\
-	int tmp;					\
-	tmp = (g)->y; (g)->y = (g)->x; (g)->x = tmp;	\
-	tmp = (g)->h; (g)->h = (g)->w; (g)->w = tmp;	\
-} while (0)
 void
 stack_master(struct workspace *ws, struct swm_geometry *g, int rot, bool flip)
 {
-	struct swm_geometry	cell, r_g = *g;
-	struct ws_win		*win;
-	int			i = 0, j = 0, s = 0, stacks = 0;
-	int			w_inc = 1, h_inc, w_base = 1, h_base;
-	int			hrh = 0, extra = 0, h_slice = 0, last_h = 0;
-	int			split = 0, colno = 0;
-	int			winno, mwin = 0, msize = 0;
-	int			remain, missing, v_slice, mscale;
-	bool			bordered = true, reconfigure = false;
-
-	/*
-	 * cell: geometry for window, including frame.
-	 * mwin: # of windows in master area.
-	 * mscale: size increment of master area.
-	 * stacks: # of stack columns
-	 */
+	static struct swm_layout_hints	*sh;
+	static struct swm_geometry	*cells;
+	static int			ncells;
+	struct swm_layout_params	lp;
+	struct ws_win			*win;
+	int				i, winno;
 
 	DNPRINTF(SWM_D_STACK, "workspace: %d, rot: %s, flip: %s\n", ws->idx,
 	    YESNO(rot), YESNO(flip));
 
-	memset(&cell, 0, sizeof(cell));
-
-	/* Prepare tiling variables, if needed. */
+	/* Compute the tiled geometry, see layout.c. */
 	if ((winno = count_win(ws, false)) > 0) {
-		/* Find first tiled window. */
-		TAILQ_FOREACH(win, &ws->winlist, entry)
-			if (!FLOATING(win) && !ICONIC(win))
-				break;
+		if (winno > ncells) {
+			free(sh);
+			free(cells);
+			sh = calloc(winno, sizeof *sh);
+			cells = calloc(winno, sizeof *cells);
+			if (sh == NULL || cells == NULL)
+				err(1, "stack_master: calloc");
+			ncells = winno;
+		}
+
+		i = 0;
+		TAILQ_FOREACH(win, &ws->winlist, entry) {
+			if (FLOATING(win) || ICONIC(win))
+				continue;
+			sh[i].width_inc = win->sh.width_inc;
+			sh[i].height_inc = win->sh.height_inc;
+			sh[i].base_width = win->sh.base_width;
+			sh[i].base_height = win->sh.base_height;
+			i++;
+		}
 
-		/* Take into account size hints of first tiled window. */
 		if (rot) {
-			w_inc = win->sh.width_inc;
-			w_base = win->sh.base_width;
-			mwin = ws->l_state.horizontal_mwin;
-			mscale = ws->l_state.horizontal_msize;
-			stacks = ws->l_state.horizontal_stacks;
-			SWAPXY(&r_g);
-		} else {
-			w_inc = win->sh.height_inc;
-			w_base = win->sh.base_height;
-			mwin = ws->l_state.vertical_mwin;
-			mscale = ws->l_state.vertical_msize;
-			stacks = ws->l_state.vertical_stacks;
-		}
-
-		cell = r_g;
-		cell.x += border_width;
-		cell.y += border_width;
-
-		if (stacks > winno - mwin)
-			stacks = winno - mwin;
-		if (stacks < 1)
-			stacks = 1;
-
-		h_slice = r_g.h / SWM_H_SLICE;
-		if (mwin && winno > mwin) {
-			v_slice = r_g.w / SWM_V_SLICE;
-
-			split = mwin;
-			colno = split;
-			cell.w = v_slice * mscale;
-
-			if (w_inc > 1 && w_inc < v_slice) {
-				/* Adjust for requested size increment. */
-				remain = (cell.w - w_base) % w_inc;
-				cell.w -= remain;
-			}
-
-			msize = cell.w;
-			if (flip)
-				cell.x += r_g.w - msize;
-			s = stacks;
+			lp.mwin = ws->l_state.horizontal_mwin;
+			lp.msize = ws->l_state.horizontal_msize;
+			lp.stacks = ws->l_state.horizontal_stacks;
 		} else {
-			msize = - 2 * border_width;
-			colno = split = winno / stacks;
-			cell.w = ((r_g.w - (stacks * 2 * border_width) +
-			    2 * border_width) / stacks);
-			s = stacks - 1;
+			lp.mwin = ws->l_state.vertical_mwin;
+			lp.msize = ws->l_state.vertical_msize;
+			lp.stacks = ws->l_state.vertical_stacks;
 		}
+		lp.rot = rot;
+		lp.flip = flip;
+		lp.bordered = (winno > 1 || !disable_border ||
+		    (bar_enabled && ws->bar_enabled));
+		lp.border_width = border_width;
+		lp.tile_gap = tile_gap;
 
-		hrh = r_g.h / colno;
-		extra = r_g.h - (colno * hrh);
-		cell.h = hrh - 2 * border_width;
-		i = j = 0;
+		layout_master(g, &lp, sh, winno, cells);
 	}
+	SWM_PROBE2(layout, ws->idx, winno);
 
 	/* Update window geometry. */
+	i = 0;
 	TAILQ_FOREACH(win, &ws->winlist, entry) {
 		if (ICONIC(win))
 			continue;
@@ -5277,112 +6618,16 @@ stack_master(struct workspace *ws, struct swm_geometry *g, int rot, bool flip)
 			continue;
 		}
 
-		/* Tiled. */
-		if (split && i == split) {
-			colno = (winno - mwin) / stacks;
-			if (s <= (winno - mwin) % stacks)
-				colno++;
-			split += colno;
-			hrh = r_g.h / colno;
-			extra = r_g.h - (colno * hrh);
-
-			if (!flip)
-				cell.x += cell.w + 2 * border_width + tile_gap;
-
-			cell.w = (r_g.w - msize -
-			    (stacks * (2 * border_width + tile_gap))) / stacks;
-			if (s == 1)
-				cell.w += (r_g.w - msize -
-				    (stacks * (2 * border_width + tile_gap))) %
-				    stacks;
-
-			if (flip)
-				cell.x -= cell.w + 2 * border_width +
-				    tile_gap;
-			s--;
-			j = 0;
-		}
-
-		cell.h = hrh - 2 * border_width - tile_gap;
-
-		if (rot) {
-			h_inc = win->sh.width_inc;
-			h_base = win->sh.base_width;
-		} else {
-			h_inc =	win->sh.height_inc;
-			h_base = win->sh.base_height;
-		}
-
-		if (j == colno - 1) {
-			cell.h = hrh + extra;
-		} else if (h_inc > 1 && h_inc < h_slice) {
-			/* adjust for window's requested size increment */
-			remain = (cell.h - h_base) % h_inc;
-			missing = h_inc - remain;
-
-			if (missing <= extra || j == 0) {
-				extra -= missing;
-				cell.h += missing;
-			} else {
-				cell.h -= remain;
-				extra += remain;
-			}
-		}
-
-		if (j == 0)
-			cell.y = r_g.y + border_width;
-		else
-			cell.y += last_h + 2 * border_width + tile_gap;
-
-		/* Window coordinates exclude frame. */
-
-		if (winno > 1 || !disable_border ||
-		    (bar_enabled && ws->bar_enabled)) {
-			bordered = true;
-		} else {
-			bordered = false;
-		}
-
-		if (rot) {
-			if (X(win) != cell.y || Y(win) != cell.x ||
-			    WIDTH(win) != cell.h || HEIGHT(win) != cell.w) {
-				reconfigure = true;
-				X(win) = cell.y;
-				Y(win) = cell.x;
-				WIDTH(win) = cell.h;
-				HEIGHT(win) = cell.w;
-			}
-		} else {
-			if (X(win) != cell.x || Y(win) != cell.y ||
-			    WIDTH(win) != cell.w || HEIGHT(win) != cell.h) {
-				reconfigure = true;
-				X(win) = cell.x;
-				Y(win) = cell.y;
-				WIDTH(win) = cell.w;
-				HEIGHT(win) = cell.h;
-			}
-		}
-
-		if (!bordered) {
-			X(win) -= border_width;
-			Y(win) -= border_width;
-			WIDTH(win) += 2 * border_width;
-			HEIGHT(win) += 2 * border_width;
-		}
-
-		if (bordered != win->bordered) {
-			reconfigure = true;
-			win->bordered = bordered;
-		}
-
-		if (reconfigure) {
+		/* Only reconfigure if necessary. */
+		if (X(win) != cells[i].x || Y(win) != cells[i].y ||
+		    WIDTH(win) != cells[i].w || HEIGHT(win) != cells[i].h ||
+		    win->bordered != lp.bordered) {
+			win->g = cells[i];
+			win->bordered = lp.bordered;
 			adjust_font(win);
 			update_window(win);
 		}
-
-		last_h = cell.h;
 		i++;
-		j++;
 	}
 
 	/* Stack all windows from bottom up. */
@@ -5508,9 +6753,10 @@ horizontal_stack(struct workspace *ws, struct swm_geometry *g)
 void
 max_stack(struct workspace *ws, struct swm_geometry *g)
 {
-	struct swm_geometry	gg = *g;
+	struct swm_geometry	gg;
 	struct ws_win		*w, *win = NULL, *parent = NULL, *tmpw;
 	int			winno;
+	bool			bordered;
 
 	DNPRINTF(SWM_D_STACK, "workspace: %d\n", ws->idx);
 
@@ -5518,6 +6764,7 @@ max_stack(struct workspace *ws, struct swm_geometry *g)
 		return;
 
 	winno = count_win(ws, false);
+	SWM_PROBE2(layout, ws->idx, winno);
 	if (winno == 0 && count_win(ws, true) == 0)
 		return;
 
@@ -5536,6 +6783,9 @@ max_stack(struct workspace *ws, struct swm_geometry *g)
 	    WINID(ws->focus), WINID(ws->focus_prev),
 	    WINID(TAILQ_FIRST(&ws->winlist)), win->id);
 
+	bordered = !disable_border || (bar_enabled && ws->bar_enabled);
+	layout_max(g, bordered, border_width, &gg);
+
 	/* Update window geometry. */
 	TAILQ_FOREACH(w, &ws->winlist, entry) {
 		if (ICONIC(w))
@@ -5558,19 +6808,9 @@ max_stack(struct workspace *ws, struct swm_geometry *g)
 
 		/* Only reconfigure if necessary. */
 		if (X(w) != gg.x || Y(w) != gg.y || WIDTH(w) != gg.w ||
-		    HEIGHT(w) != gg.h) {
+		    HEIGHT(w) != gg.h || w->bordered != bordered) {
 			w->g = gg;
-
-			if (disable_border && !(bar_enabled && ws->bar_enabled)) {
-				w->bordered = false;
-				WIDTH(w) += 2 * border_width;
-				HEIGHT(w) += 2 * border_width;
-			} else {
-				w->bordered = true;
-				X(w) += border_width;
-				Y(w) += border_width;
-			}
-
+			w->bordered = bordered;
 			update_window(w);
 		}
 	}
@@ -5906,37 +7146,109 @@ iconify(struct binding *bp, struct swm_region *r, union arg *args)
 	focus_flush();
 }
 
-char *
-get_win_name(xcb_window_t win)
+int
+str_cmp(struct swm_str *a, struct swm_str *b)
 {
-	char				*name = NULL;
+	if (a->len != b->len)
+		return (a->len < b->len ? -1 : 1);
+	return (memcmp(a->s, b->s, a->len));
+}
+
+/* Returns the shared copy of s[0..len), with a reference held. */
+const char *
+str_intern(const char *s, size_t len)
+{
+	struct swm_str		key, *sp;
+
+	key.s = (char *)s;
+	key.len = len;
+	if ((sp = RB_FIND(str_tree, &strings, &key)) != NULL) {
+		sp->refs++;
+		return (sp->s);
+	}
+
+	if ((sp = mem_malloc(SWM_MEM_STRINGS, sizeof *sp + len + 1)) == NULL)
+		err(1, "str_intern: malloc");
+	sp->s = (char *)(sp + 1);
+	memcpy(sp->s, s, len);
+	sp->s[len] = '\0';
+	sp->len = len;
+	sp->refs = 1;
+	RB_INSERT(str_tree, &strings, sp);
+
+	return (sp->s);
+}
+
+void
+str_release(const char *s)
+{
+	struct swm_str		*sp;
+
+	if (s == NULL)
+		return;
+
+	sp = (struct swm_str *)s - 1;
+	if (--sp->refs > 0)
+		return;
+
+	RB_REMOVE(str_tree, &strings, sp);
+	mem_free(sp);
+}
+
+void
+update_win_class(struct ws_win *win, struct swm_prefetch *pf)
+{
+	xcb_icccm_get_wm_class_reply_t	ch;
+	const char			*class = NULL, *instance = NULL;
+
+	if (xcb_icccm_get_wm_class_reply(conn, PREFETCH(pf, class,
+	    xcb_icccm_get_wm_class(conn, win->id)), &ch, NULL)) {
+		if (ch.class_name)
+			class = str_intern(ch.class_name,
+			    strlen(ch.class_name));
+		if (ch.instance_name)
+			instance = str_intern(ch.instance_name,
+			    strlen(ch.instance_name));
+		xcb_icccm_get_wm_class_reply_wipe(&ch);
+	}
+
+	str_release(win->class);
+	str_release(win->instance);
+	win->class = class;
+	win->instance = instance;
+}
+
+void
+update_win_name(struct ws_win *win, struct swm_prefetch *pf)
+{
+	const char			*title;
 	xcb_get_property_cookie_t	c;
 	xcb_get_property_reply_t	*r;
 
 	/* First try _NET_WM_NAME for UTF-8. */
-	c = xcb_get_property(conn, 0, win, ewmh[_NET_WM_NAME].atom,
-	    XCB_GET_PROPERTY_TYPE_ANY, 0, UINT_MAX);
+	c = PREFETCH(pf, net_name, xcb_get_property(conn, 0, win->id,
+	    ewmh[_NET_WM_NAME].atom, XCB_GET_PROPERTY_TYPE_ANY, 0, UINT_MAX));
 	r = xcb_get_property_reply(conn, c, NULL);
 	if (r && r->type == XCB_NONE) {
 		free(r);
 		/* Use WM_NAME instead; no UTF-8. */
-		c = xcb_get_property(conn, 0, win, XCB_ATOM_WM_NAME,
-		    XCB_GET_PROPERTY_TYPE_ANY, 0, UINT_MAX);
+		c = PREFETCH(pf, name, xcb_get_property(conn, 0, win->id,
+		    XCB_ATOM_WM_NAME, XCB_GET_PROPERTY_TYPE_ANY, 0, UINT_MAX));
 		r = xcb_get_property_reply(conn, c, NULL);
 	}
 
+	/* Up to the first NUL, as strndup would have it. */
 	if (r && r->type != XCB_NONE && r->length > 0)
-		name = strndup(xcb_get_property_value(r),
-		    xcb_get_property_value_length(r));
+		title = str_intern(xcb_get_property_value(r),
+		    strnlen(xcb_get_property_value(r),
+		    xcb_get_property_value_length(r)));
 	else
-		name = strdup("");
-
-	if (name == NULL)
-		err(1, "get_win_name: failed to allocate memory.");
+		title = str_intern("", 0);
 
 	free(r);
 
-	return (name);
+	str_release(win->title);
+	win->title = title;
 }
 
 void
@@ -5944,7 +7256,6 @@ uniconify(struct binding *bp, struct swm_region *r, union arg *args)
 {
 	struct ws_win		*win;
 	FILE			*lfile;
-	char			*name;
 	int			count = 0;
 
 	(void)bp;
@@ -5982,9 +7293,7 @@ uniconify(struct binding *bp, struct swm_region *r, union arg *args)
 		if (!ICONIC(win))
 			continue;
 
-		name = get_win_name(win->id);
-		fprintf(lfile, "%s.%u\n", name, win->id);
-		free(name);
+		fprintf(lfile, "%s.%u\n", win->title, win->id);
 	}
 
 	fclose(lfile);
@@ -6055,7 +7364,7 @@ search_win_cleanup(void)
 	while ((sw = TAILQ_FIRST(&search_wl)) != NULL) {
 		xcb_destroy_window(conn, sw->indicator);
 		TAILQ_REMOVE(&search_wl, sw, entry);
-		free(sw);
+		mem_free(sw);
 	}
 #endif
 }
@@ -6098,7 +7407,8 @@ search_win(struct binding *bp, struct swm_region *r, union arg *args)
 		if (ICONIC(win))
 			continue;
 
-		sw = calloc(1, sizeof(struct search_window));
+		sw = mem_calloc(SWM_MEM_SEARCH, 1,
+		    sizeof(struct search_window));
 		if (sw == NULL) {
 			warn("search_win: calloc");
 			fclose(lfile);
@@ -6176,7 +7486,6 @@ search_win(struct binding *bp, struct swm_region *r, union arg *args)
 void
 search_resp_uniconify(const char *resp, size_t len)
 {
-	char			*name;
 	struct ws_win		*win;
 	char			*s;
 
@@ -6185,12 +7494,8 @@ search_resp_uniconify(const char *resp, size_t len)
 	TAILQ_FOREACH(win, &search_r->ws->winlist, entry) {
 		if (!ICONIC(win))
 			continue;
-		name = get_win_name(win->id);
-		if (asprintf(&s, "%s.%u", name, win->id) == -1) {
-			free(name);
+		if (asprintf(&s, "%s.%u", win->title, win->id) == -1)
 			continue;
-		}
-		free(name);
 		if (strncmp(s, resp, len) == 0) {
 			/* XXX this should be a callback to generalize */
 			ewmh_apply_flags(win, win->ewmh_flags & ~EWMH_F_HIDDEN);
@@ -6237,6 +7542,8 @@ ewmh_update_desktop_names(void)
 	char			*name_list = NULL, *p;
 	int			num_screens, i, j, len = 0, tot = 0;
 
+	session_touch();
+
 	num_screens = get_screen_count();
 	for (i = 0; i < num_screens; ++i) {
 		for (j = 0; j < workspace_limit; ++j) {
@@ -6349,6 +7656,8 @@ ewmh_update_current_desktop(void)
 {
 	int			num_screens, i;
 
+	session_touch();
+
 	num_screens = get_screen_count();
 	for (i = 0; i < num_screens; ++i) {
 		if (screens[i].r_focus)
@@ -6854,7 +8163,7 @@ get_next_event(bool dowait)
 	if ((ep = SIMPLEQ_FIRST(&events))) {
 		evt = ep->ev;
 		SIMPLEQ_REMOVE_HEAD(&events, entry);
-		free(ep);
+		mem_free(ep);
 	} else if (dowait)
 		evt = xcb_wait_for_event(conn);
 	else
@@ -6867,7 +8176,7 @@ void
 put_back_event(xcb_generic_event_t *evt)
 {
 	struct event	*ep;
-	if ((ep = malloc(sizeof (struct event))) == NULL)
+	if ((ep = mem_malloc(SWM_MEM_EVENTS, sizeof (struct event))) == NULL)
 		err(1, "put_back_event: failed to allocate memory.");
 	ep->ev = evt;
 	SIMPLEQ_INSERT_HEAD(&events, ep, entry);
@@ -7435,7 +8744,7 @@ struct action {
 	{ "master_grow",	stack_config,	0, {.id = SWM_ARG_ID_MASTERGROW} },
 	{ "master_add",		stack_config,	0, {.id = SWM_ARG_ID_MASTERADD} },
 	{ "master_del",		stack_config,	0, {.id = SWM_ARG_ID_MASTERDEL} },
-	{ "move",		move,		FN_F_NOREPLAY, {0} },
+	{ "move",		move,		FN_F_NOREPLAY | FN_F_NOCTL, {0} },
 	{ "move_down",		move,		0, {.id = SWM_ARG_ID_MOVEDOWN} },
 	{ "move_left",		move,		0, {.id = SWM_ARG_ID_MOVELEFT} },
 	{ "move_right",		move,		0, {.id = SWM_ARG_ID_MOVERIGHT} },
@@ -7477,8 +8786,9 @@ struct action {
 	{ "quit",		quit,		0, {0} },
 	{ "raise",		raise_focus,	0, {0} },
 	{ "raise_toggle",	raise_toggle,	0, {0} },
-	{ "resize",		resize, FN_F_NOREPLAY, {.id = SWM_ARG_ID_DONTCENTER} },
-	{ "resize_centered",	resize, FN_F_NOREPLAY, {.id = SWM_ARG_ID_CENTER} },
+	{ "reload",		reload,		0, {0} },
+	{ "resize",		resize, FN_F_NOREPLAY | FN_F_NOCTL, {.id = SWM_ARG_ID_DONTCENTER} },
+	{ "resize_centered",	resize, FN_F_NOREPLAY | FN_F_NOCTL, {.id = SWM_ARG_ID_CENTER} },
 	{ "restart",		restart,	0, {0} },
 	{ "rg_1",		focusrg,	0, {.id = 0} },
 	{ "rg_2",		focusrg,	0, {.id = 1} },
@@ -7548,6 +8858,200 @@ struct action {
 	{ "invalid action",	NULL,		0, {0} },
 };
 
+const char *
+stat_name(int kind, int id)
+{
+	switch (kind) {
+	case SWM_TRACE_EVENT:
+		if (id == 0)
+			return ("Error");
+		return (id < SWM_STAT_EVENTS ? xcb_event_get_label(id) :
+		    "other");
+	case SWM_TRACE_ACTION:
+		return (actions[id].name);
+	default:
+		return (stat_func_names[id]);
+	}
+}
+
+void
+rtt_budget_exceeded(int kind, int id, uint64_t rtt, uint32_t budget)
+{
+	warnx("%s: %llu round trips, budget %u", stat_name(kind, id),
+	    (unsigned long long)rtt, budget);
+	if (rtt_budget_fatal)
+		abort();
+}
+
+/* Write histograms and the trace ring to stderr; on SIGUSR1 or dumpwins. */
+void
+stats_dump(void)
+{
+	struct swm_trace	*t;
+	unsigned int		i, n;
+	int			type;
+
+	stats_dump_pending = 0;
+
+	fprintf(stderr, "=== spectrwm handler latency, %llu round trips, "
+	    "%llu ms blocked ===\n", (unsigned long long)stat_rtt,
+	    (unsigned long long)(stat_blocked_usec / 1000));
+	for (type = 0; type < SWM_STAT_EVENTS; type++)
+		stat_print(type == 0 ? "Error" : xcb_event_get_label(type),
+		    &stat_events[type]);
+	stat_print("other", &stat_events[SWM_STAT_EVENTS]);
+	for (type = 0; type <= FN_INVALID; type++)
+		stat_print(actions[type].name, &stat_actions[type]);
+	for (type = 0; type < SWM_STAT_FUNCS; type++)
+		stat_print(stat_func_names[type], &stat_funcs[type]);
+	phase_report(stderr);
+	stats_file_write();
+
+	fprintf(stderr, "=== memory: live objects, bytes (max), allocations "
+	    "===\n");
+	for (type = 0; type < SWM_MEM_TAGS; type++)
+		fprintf(stderr, "%-24s %8llu %10llu (%llu) %10llu\n",
+		    mem_tag_names[type],
+		    (unsigned long long)mem_stats[type].live,
+		    (unsigned long long)mem_stats[type].bytes,
+		    (unsigned long long)mem_stats[type].bytes_max,
+		    (unsigned long long)mem_stats[type].allocs);
+
+	n = trace_next < SWM_TRACE_LEN ? trace_next : SWM_TRACE_LEN;
+	fprintf(stderr, "=== last %u handlers (oldest first) ===\n", n);
+	for (i = trace_next - n; i != trace_next; i++) {
+		t = &trace_ring[i % SWM_TRACE_LEN];
+		fprintf(stderr, "%llu.%06llu %-6s %-24s %8u us rtt %u\n",
+		    (unsigned long long)(t->start / 1000000),
+		    (unsigned long long)(t->start % 1000000),
+		    t->kind == SWM_TRACE_EVENT ? "event" : "action",
+		    stat_name(t->kind, t->id), t->usec, t->rtt);
+	}
+	fprintf(stderr, "=================================\n");
+}
+
+/*
+ * Counters and gauges in the Prometheus text format, for the control socket
+ * "stats" command and stats_file.  Everything here is kept in every build.
+ */
+void
+stats_write(FILE *f)
+{
+	struct ws_win		*win;
+	struct workspace	*ws;
+	xcb_void_cookie_t	c;
+	uint64_t		usec;
+	int			i, j, type, managed = 0, unmanaged = 0;
+
+	for (i = 0; i < get_screen_count(); i++)
+		for (j = 0; j < workspace_limit; j++) {
+			ws = &screens[i].ws[j];
+			TAILQ_FOREACH(win, &ws->winlist, entry)
+				managed++;
+			TAILQ_FOREACH(win, &ws->unmanagedlist, entry)
+				unmanaged++;
+		}
+
+	fprintf(f, "# TYPE spectrwm_events_total counter\n");
+	for (type = 0; type <= SWM_STAT_EVENTS; type++)
+		if (stat_events[type].count)
+			fprintf(f, "spectrwm_events_total{type=\"%s\"} %llu\n",
+			    stat_name(SWM_TRACE_EVENT, type),
+			    (unsigned long long)stat_events[type].count);
+	fprintf(f, "# TYPE spectrwm_event_seconds_total counter\n");
+	for (type = 0; type <= SWM_STAT_EVENTS; type++)
+		if ((usec = stat_events[type].usec))
+			fprintf(f, "spectrwm_event_seconds_total{type=\"%s\"} "
+			    "%llu.%06llu\n", stat_name(SWM_TRACE_EVENT, type),
+			    (unsigned long long)(usec / 1000000),
+			    (unsigned long long)(usec % 1000000));
+	fprintf(f, "# TYPE spectrwm_actions_total counter\n");
+	for (type = 0; type < FN_INVALID; type++)
+		if (stat_actions[type].count)
+			fprintf(f, "spectrwm_actions_total{action=\"%s\"} "
+			    "%llu\n", actions[type].name,
+			    (unsigned long long)stat_actions[type].count);
+
+	/*
+	 * The sequence number of a no-op tells how many requests were sent;
+	 * libxcb has no call for it.  It is 32 bits wide, so add up the
+	 * requests since the previous no-op, leaving out the no-ops.
+	 */
+	c = xcb_no_operation(conn);
+	stat_requests += c.sequence - stat_seq - 1;
+	stat_seq = c.sequence;
+	fprintf(f, "# TYPE spectrwm_requests_total counter\n"
+	    "spectrwm_requests_total %llu\n",
+	    (unsigned long long)stat_requests);
+	fprintf(f, "# TYPE spectrwm_round_trips_total counter\n"
+	    "spectrwm_round_trips_total %llu\n",
+	    (unsigned long long)stat_rtt);
+	fprintf(f, "# TYPE spectrwm_flushes_total counter\n"
+	    "spectrwm_flushes_total %llu\n", (unsigned long long)stat_flush);
+	fprintf(f, "# TYPE spectrwm_stack_total counter\n"
+	    "spectrwm_stack_total %llu\n", (unsigned long long)stat_stack);
+	fprintf(f, "# TYPE spectrwm_bar_draws_total counter\n"
+	    "spectrwm_bar_draws_total %llu\n",
+	    (unsigned long long)stat_funcs[SWM_STAT_BAR_DRAW].count);
+	fprintf(f, "# TYPE spectrwm_blocked_seconds_total counter\n"
+	    "spectrwm_blocked_seconds_total %llu.%06llu\n",
+	    (unsigned long long)(stat_blocked_usec / 1000000),
+	    (unsigned long long)(stat_blocked_usec % 1000000));
+	fprintf(f, "# TYPE spectrwm_idle_seconds_total counter\n"
+	    "spectrwm_idle_seconds_total %llu.%06llu\n",
+	    (unsigned long long)(stat_poll_usec / 1000000),
+	    (unsigned long long)(stat_poll_usec % 1000000));
+
+	fprintf(f, "# TYPE spectrwm_windows_managed gauge\n"
+	    "spectrwm_windows_managed %d\n", managed);
+	fprintf(f, "# TYPE spectrwm_windows_unmanaged gauge\n"
+	    "spectrwm_windows_unmanaged %d\n", unmanaged);
+	fprintf(f, "# TYPE spectrwm_pids gauge\n"
+	    "spectrwm_pids %d\n", pid_count);
+	fprintf(f, "# TYPE spectrwm_pidfds gauge\n"
+	    "spectrwm_pidfds %d\n", pidfd_count);
+
+	fprintf(f, "# TYPE spectrwm_mem_objects gauge\n");
+	for (i = 0; i < SWM_MEM_TAGS; i++)
+		fprintf(f, "spectrwm_mem_objects{subsystem=\"%s\"} %llu\n",
+		    mem_tag_names[i], (unsigned long long)mem_stats[i].live);
+	fprintf(f, "# TYPE spectrwm_mem_bytes gauge\n");
+	for (i = 0; i < SWM_MEM_TAGS; i++)
+		fprintf(f, "spectrwm_mem_bytes{subsystem=\"%s\"} %llu\n",
+		    mem_tag_names[i], (unsigned long long)mem_stats[i].bytes);
+	fprintf(f, "# TYPE spectrwm_mem_allocs_total counter\n");
+	for (i = 0; i < SWM_MEM_TAGS; i++)
+		fprintf(f, "spectrwm_mem_allocs_total{subsystem=\"%s\"} %llu\n",
+		    mem_tag_names[i], (unsigned long long)mem_stats[i].allocs);
+}
+
+/* Replace stats_file, e.g. for the node_exporter textfile collector. */
+void
+stats_file_write(void)
+{
+	FILE			*f;
+	char			*tmp;
+
+	if (stats_file == NULL)
+		return;
+
+	if (asprintf(&tmp, "%s.tmp", stats_file) == -1) {
+		warn("stats_file_write: asprintf");
+		return;
+	}
+	if ((f = fopen(tmp, "w")) == NULL) {
+		warn("stats_file: %s", tmp);
+		free(tmp);
+		return;
+	}
+	stats_write(f);
+	if (fclose(f) == EOF || rename(tmp, stats_file) == -1) {
+		warn("stats_file: %s", stats_file);
+		unlink(tmp);
+	}
+	free(tmp);
+}
+
 void
 update_modkey(uint16_t mod)
 {
@@ -7789,9 +9293,9 @@ spawn_insert(const char *name, const char *args, int flags)
 	if (args == NULL || *args == '\0')
 		return;
 
-	if ((sp = calloc(1, sizeof *sp)) == NULL)
+	if ((sp = mem_calloc(SWM_MEM_SPAWN, 1, sizeof *sp)) == NULL)
 		err(1, "spawn_insert: calloc");
-	if ((sp->name = strdup(name)) == NULL)
+	if ((sp->name = mem_strdup(SWM_MEM_SPAWN, name)) == NULL)
 		err(1, "spawn_insert: strdup");
 
 	/* Convert the arguments to an argument list. */
@@ -7803,10 +9307,11 @@ spawn_insert(const char *name, const char *args, int flags)
 			continue;
 
 		sp->argc++;
-		if ((sp->argv = realloc(sp->argv, sp->argc *
-		    sizeof *sp->argv)) == NULL)
+		if ((sp->argv = mem_realloc(SWM_MEM_SPAWN, sp->argv,
+		    sp->argc * sizeof *sp->argv)) == NULL)
 			err(1, "spawn_insert: realloc");
-		if ((sp->argv[sp->argc - 1] = strdup(arg)) == NULL)
+		if ((sp->argv[sp->argc - 1] = mem_strdup(SWM_MEM_SPAWN,
+		    arg)) == NULL)
 			err(1, "spawn_insert: strdup");
 	}
 	free(cp);
@@ -7819,18 +9324,24 @@ spawn_insert(const char *name, const char *args, int flags)
 }
 
 void
-spawn_remove(struct spawn_prog *sp)
+spawn_free(struct spawn_prog *sp)
 {
 	int			i;
 
+	for (i = 0; i < sp->argc; i++)
+		mem_free(sp->argv[i]);
+	mem_free(sp->argv);
+	mem_free(sp->name);
+	mem_free(sp);
+}
+
+void
+spawn_remove(struct spawn_prog *sp)
+{
 	DNPRINTF(SWM_D_SPAWN, "name: %s\n", sp->name);
 
 	TAILQ_REMOVE(&spawns, sp, entry);
-	for (i = 0; i < sp->argc; i++)
-		free(sp->argv[i]);
-	free(sp->argv);
-	free(sp->name);
-	free(sp);
+	spawn_free(sp);
 
 	DNPRINTF(SWM_D_SPAWN, "leave\n");
 }
@@ -8052,15 +9563,6 @@ parsebinding(const char *bindstr, uint16_t *mod, enum binding_type *type,
 	return (0);
 }
 
-char *
-strdupsafe(const char *str)
-{
-	if (str == NULL)
-		return (NULL);
-	else
-		return (strdup(str));
-}
-
 int
 binding_cmp(struct binding *bp1, struct binding *bp2)
 {
@@ -8092,7 +9594,7 @@ binding_insert(uint16_t mod, enum binding_type type, uint32_t val,
 	    "spawn_name: %s\n", mod, type, val, actions[aid].name, aid,
 	    spawn_name);
 
-	if ((bp = malloc(sizeof *bp)) == NULL)
+	if ((bp = mem_malloc(SWM_MEM_BINDINGS, sizeof *bp)) == NULL)
 		err(1, "binding_insert: malloc");
 
 	bp->mod = mod;
@@ -8100,7 +9602,7 @@ binding_insert(uint16_t mod, enum binding_type type, uint32_t val,
 	bp->value = val;
 	bp->action = aid;
 	bp->flags = flags;
-	bp->spawn_name = strdupsafe(spawn_name);
+	bp->spawn_name = mem_strdup(SWM_MEM_BINDINGS, spawn_name);
 	RB_INSERT(binding_tree, &bindings, bp);
 
 	DNPRINTF(SWM_D_KEY, "leave\n");
@@ -8126,12 +9628,38 @@ binding_remove(struct binding *bp)
 	    actions[bp->action].name, bp->action, bp->spawn_name);
 
 	RB_REMOVE(binding_tree, &bindings, bp);
-	free(bp->spawn_name);
-	free(bp);
+	mem_free(bp->spawn_name);
+	mem_free(bp);
 
 	DNPRINTF(SWM_D_KEY, "leave\n");
 }
 
+/* Whether the bindings of a type differ in anything that affects grabs. */
+bool
+bindings_differ(struct binding_tree *a, struct binding_tree *b,
+    enum binding_type type)
+{
+	struct binding		*ba, *bb;
+
+	ba = RB_MIN(binding_tree, a);
+	bb = RB_MIN(binding_tree, b);
+	for (;;) {
+		while (ba && ba->type != type)
+			ba = RB_NEXT(binding_tree, a, ba);
+		while (bb && bb->type != type)
+			bb = RB_NEXT(binding_tree, b, bb);
+		if (ba == NULL || bb == NULL)
+			return (ba != bb);
+
+		if (binding_cmp(ba, bb) || ba->action != bb->action ||
+		    ba->flags != bb->flags)
+			return (true);
+
+		ba = RB_NEXT(binding_tree, a, ba);
+		bb = RB_NEXT(binding_tree, b, bb);
+	}
+}
+
 void
 setbinding(uint16_t mod, enum binding_type type, uint32_t val,
     enum actionid aid, uint32_t flags, const char *spawn_name)
@@ -8140,6 +9668,13 @@ setbinding(uint16_t mod, enum binding_type type, uint32_t val,
 
 	DNPRINTF(SWM_D_KEY, "enter %s [%s]\n", actions[aid].name, spawn_name);
 
+	/* The check pass of a reload only parses bindings. */
+	if (conf_checking)
+		return;
+
+	if (type == KEYBIND)
+		bindings_changed = true;
+
 	/* Unbind any existing. Loop is to handle MOD_MASK_ANY. */
 	while ((bp = binding_lookup(mod, type, val)))
 		binding_remove(bp);
@@ -8381,9 +9916,11 @@ setkeymapping(const char *selector, const char *value, int flags)
 
 	keymapping_file = expand_tilde(value);
 
-	clear_keybindings();
+	if (!conf_checking)
+		clear_keybindings();
 	/* load new key bindings; if it fails, revert to default bindings */
-	if (conf_load(keymapping_file, SWM_CONF_KEYMAPPING)) {
+	if (conf_load(keymapping_file, SWM_CONF_KEYMAPPING) &&
+	    !conf_checking) {
 		clear_keybindings();
 		setup_keybindings();
 	}
@@ -8406,95 +9943,245 @@ updatenumlockmask(void)
 	modmap_r = xcb_get_modifier_mapping_reply(conn,
 	    xcb_get_modifier_mapping(conn),
 	    NULL);
-	if (modmap_r) {
+	keycode = xcb_key_symbols_get_keycode(syms, XK_Num_Lock);
+	if (modmap_r && keycode) {
 		modmap = xcb_get_modifier_mapping_keycodes(modmap_r);
 		for (i = 0; i < 8; i++) {
 			for (j = 0; j < modmap_r->keycodes_per_modifier; j++) {
 				kc = modmap[i * modmap_r->keycodes_per_modifier
 				    + j];
-				keycode = xcb_key_symbols_get_keycode(syms,
-						XK_Num_Lock);
-				if (keycode) {
-					if (kc == *keycode)
-						numlockmask = (1 << i);
-					free(keycode);
-				}
+				if (kc == *keycode)
+					numlockmask = (1 << i);
 			}
 		}
-		free(modmap_r);
 	}
+	free(keycode);
+	free(modmap_r);
 	DNPRINTF(SWM_D_MISC, "numlockmask: %#x\n", numlockmask);
 }
 
+int
+key_code_cmp(const void *a, const void *b)
+{
+	const struct key_code	*ka = a, *kb = b;
+
+	if (ka->sym != kb->sym)
+		return (ka->sym < kb->sym ? -1 : 1);
+	return (ka->code - kb->code);
+}
+
+int
+key_grab_cmp(const void *a, const void *b)
+{
+	const struct key_grab	*ga = a, *gb = b;
+
+	if (ga->root != gb->root)
+		return (ga->root < gb->root ? -1 : 1);
+	if (ga->code != gb->code)
+		return (ga->code - gb->code);
+	return (ga->mod - gb->mod);
+}
+
+struct binding *
+key_lookup(xcb_keycode_t code, uint16_t state)
+{
+	if (key_table[code] == NULL)
+		return (NULL);
+	return (key_table[code][CLEANMASK(state)]);
+}
+
+void
+key_table_clear(void)
+{
+	int			i;
+
+	for (i = 0; i < SWM_KEY_CODES; i++) {
+		mem_free(key_table[i]);
+		key_table[i] = NULL;
+	}
+}
+
+/*
+ * Rebuild the dispatch table and work out the grabs the key bindings need, on
+ * every keycode that produces a bound keysym, then send only the difference
+ * from the grabs in place.  All ungrabs go first: releasing an AnyModifier
+ * grab releases every modifier.  After the bindings changed, report the ones
+ * that can never fire.
+ */
 void
 grabkeys(void)
 {
-	struct binding		*bp;
-	int			num_screens, k, j;
+	const xcb_setup_t	*setup;
+	struct binding		*bp, **slot;
+	struct key_code		*kcs;
+	struct key_grab		*want = NULL, *g;
+	size_t			nkcs = 0, nwant = 0, cap = 0, i, j, lo, hi;
+	int			num_screens, k, m, c, pass;
 	uint16_t		modifiers[4];
-	xcb_keycode_t		*code;
+	bool			report, grab;
+	const char		*name;
 
 	DNPRINTF(SWM_D_MISC, "begin\n");
 	updatenumlockmask();
+	report = bindings_changed;
+	bindings_changed = false;
 
 	modifiers[0] = 0;
 	modifiers[1] = numlockmask;
 	modifiers[2] = XCB_MOD_MASK_LOCK;
 	modifiers[3] = numlockmask | XCB_MOD_MASK_LOCK;
 
+	/* One pass over the keymap instead of a lookup per binding. */
+	setup = xcb_get_setup(conn);
+	if ((kcs = calloc(setup->max_keycode - setup->min_keycode + 1,
+	    sizeof *kcs)) == NULL)
+		err(1, "grabkeys: calloc");
+	for (c = setup->min_keycode; c <= setup->max_keycode; c++) {
+		kcs[nkcs].sym = xcb_key_symbols_get_keysym(syms, c, 0);
+		if (kcs[nkcs].sym != XCB_NO_SYMBOL)
+			kcs[nkcs++].code = c;
+	}
+	qsort(kcs, nkcs, sizeof *kcs, key_code_cmp);
+
+	key_table_clear();
 	num_screens = get_screen_count();
-	for (k = 0; k < num_screens; k++) {
-		if (TAILQ_EMPTY(&screens[k].rl))
+	RB_FOREACH(bp, binding_tree, &bindings) {
+		if (bp->type != KEYBIND)
 			continue;
-		xcb_ungrab_key(conn, XCB_GRAB_ANY, screens[k].root,
-			XCB_MOD_MASK_ANY);
-		RB_FOREACH(bp, binding_tree, &bindings) {
-			if (bp->type != KEYBIND)
-				continue;
 
-			/* If there is a catch-all, only bind that. */
-			if ((binding_lookup(ANYMOD, KEYBIND, bp->value)) &&
-			    bp->mod != ANYMOD)
-				continue;
+		/* CLEANMASK() drops these, so the binding cannot match. */
+		if (bp->mod != ANYMOD && (bp->mod != CLEANMASK(bp->mod) ||
+		    bp->mod >= SWM_KEY_STATES)) {
+			if (report) {
+				name = XKeysymToString(bp->value);
+				add_startup_exception("%s binding for %s "
+				    "uses Lock or NumLock and never fires",
+				    actions[bp->action].name,
+				    name ? name : "unknown key");
+			}
+			continue;
+		}
 
-			/* Skip unused ws binds. */
-			if ((int)bp->action > FN_WS_1 + workspace_limit - 1 &&
-			    bp->action <= FN_WS_22)
-				continue;
+		/*
+		 * Grab only the catch-all if there is one; dispatch still
+		 * prefers an exact match.
+		 */
+		grab = bp->mod == ANYMOD ||
+		    binding_lookup(ANYMOD, KEYBIND, bp->value) == NULL;
+
+		/* Skip unused ws binds. */
+		if ((int)bp->action > FN_WS_1 + workspace_limit - 1 &&
+		    bp->action <= FN_WS_22)
+			grab = false;
+
+		/* Skip unused mvws binds. */
+		if ((int)bp->action > FN_MVWS_1 + workspace_limit - 1 &&
+		    bp->action <= FN_MVWS_22)
+			grab = false;
+
+		/* First keycode with this keysym. */
+		lo = 0;
+		hi = nkcs;
+		while (lo < hi) {
+			i = (lo + hi) / 2;
+			if (kcs[i].sym < bp->value)
+				lo = i + 1;
+			else
+				hi = i;
+		}
+
+		for (i = lo; i < nkcs && kcs[i].sym == bp->value; i++) {
+			if (key_table[kcs[i].code] == NULL &&
+			    (key_table[kcs[i].code] = mem_calloc(
+			    SWM_MEM_BINDINGS, SWM_KEY_STATES,
+			    sizeof **key_table)) == NULL)
+				err(1, "grabkeys: calloc");
+			slot = key_table[kcs[i].code];
+			if (bp->mod == ANYMOD) {
+				for (c = 0; c < SWM_KEY_STATES; c++)
+					if (slot[c] == NULL)
+						slot[c] = bp;
+			} else
+				slot[bp->mod] = bp;
 
-			/* Skip unused mvws binds. */
-			if ((int)bp->action > FN_MVWS_1 + workspace_limit - 1 &&
-			    bp->action <= FN_MVWS_22)
+			if (!grab)
 				continue;
 
-			if ((code = xcb_key_symbols_get_keycode(syms,
-			    bp->value)) == NULL)
-				continue;
+			/* AnyModifier covers every permutation. */
+			for (m = 0; m < (bp->mod == ANYMOD ? 1 :
+			    LENGTH(modifiers)); m++) {
+				for (k = 0; k < num_screens; k++) {
+					if (TAILQ_EMPTY(&screens[k].rl))
+						continue;
+					if (nwant == cap) {
+						cap = cap ? cap * 2 : 64;
+						if ((want = realloc(want, cap *
+						    sizeof *want)) == NULL)
+							err(1, "grabkeys: "
+							    "realloc");
+					}
+					g = &want[nwant++];
+					g->root = screens[k].root;
+					g->code = kcs[i].code;
+					g->mod = bp->mod;
+					if (bp->mod != ANYMOD)
+						g->mod |= modifiers[m];
+				}
+			}
+		}
+		if (i == lo) {
+			DNPRINTF(SWM_D_KEY, "%s: no key produces keysym %#x\n",
+			    actions[bp->action].name, bp->value);
+		}
+	}
+	free(kcs);
 
-			if (bp->mod == XCB_MOD_MASK_ANY) {
-				/* All modifiers are grabbed in one pass. */
-				DNPRINTF(SWM_D_MOUSE, "grab key: %u, "
-				    "modmask: %d\n", bp->value, bp->mod);
-				xcb_grab_key(conn, 1, screens[k].root,
-				    bp->mod, *code, XCB_GRAB_MODE_ASYNC,
-				    XCB_GRAB_MODE_SYNC);
-			} else {
-				/* Need to grab each modifier permutation. */
-				for (j = 0; j < LENGTH(modifiers); j++) {
+	/* Without numlock, some permutations are the same. */
+	qsort(want, nwant, sizeof *want, key_grab_cmp);
+	for (i = j = 0; i < nwant; i++)
+		if (j == 0 || key_grab_cmp(&want[j - 1], &want[i]))
+			want[j++] = want[i];
+	nwant = j;
+
+	for (pass = 0; pass < 2; pass++) {
+		i = j = 0;
+		while (i < key_grabs_len || j < nwant) {
+			if (i == key_grabs_len)
+				c = 1;
+			else if (j == nwant)
+				c = -1;
+			else
+				c = key_grab_cmp(&key_grabs[i], &want[j]);
+
+			if (c < 0) {
+				g = &key_grabs[i++];
+				if (pass == 0) {
+					DNPRINTF(SWM_D_MOUSE, "ungrab key: %u, "
+					    "modmask: %#x\n", g->code, g->mod);
+					xcb_ungrab_key(conn, g->code, g->root,
+					    g->mod);
+				}
+			} else if (c > 0) {
+				g = &want[j++];
+				if (pass == 1) {
 					DNPRINTF(SWM_D_MOUSE, "grab key: %u, "
-					    "modmask: %d\n",
-					    bp->value, bp->mod | modifiers[j]);
-					xcb_grab_key(conn, 1,
-					    screens[k].root,
-					    bp->mod | modifiers[j],
-					    *code, XCB_GRAB_MODE_ASYNC,
+					    "modmask: %#x\n", g->code, g->mod);
+					xcb_grab_key(conn, 1, g->root, g->mod,
+					    g->code, XCB_GRAB_MODE_ASYNC,
 					    XCB_GRAB_MODE_SYNC);
 				}
+			} else {
+				i++;
+				j++;
 			}
-			free(code);
 		}
 	}
-	DNPRINTF(SWM_D_MISC, "done\n");
+
+	free(key_grabs);
+	key_grabs = want;
+	key_grabs_len = nwant;
+
+	DNPRINTF(SWM_D_MISC, "done; %zu grabs\n", key_grabs_len);
 }
 
 void
@@ -8642,14 +10329,28 @@ quirk_insert(const char *class, const char *instance, const char *name,
 	DNPRINTF(SWM_D_QUIRK, "class: %s, instance: %s, name: %s, value: %u, "
 	    "ws: %d\n", class, instance, name, quirk, ws);
 
-	if ((qp = malloc(sizeof *qp)) == NULL)
+	/* On reload, keep the compiled regexes of an unchanged quirk. */
+	TAILQ_FOREACH(qp, &quirks_old, entry)
+		if (strcmp(qp->class, class) == 0 &&
+		    strcmp(qp->instance, instance) == 0 &&
+		    strcmp(qp->name, name) == 0) {
+			TAILQ_REMOVE(&quirks_old, qp, entry);
+			qp->quirk = quirk;
+			qp->ws = ws;
+			TAILQ_INSERT_TAIL(&quirks, qp, entry);
+			quirks_dirty = true;
+			DNPRINTF(SWM_D_QUIRK, "reused\n");
+			return;
+		}
+
+	if ((qp = mem_malloc(SWM_MEM_QUIRKS, sizeof *qp)) == NULL)
 		err(1, "quirk_insert: malloc");
 
-	if ((qp->class = strdup(class)) == NULL)
+	if ((qp->class = mem_strdup(SWM_MEM_QUIRKS, class)) == NULL)
 		err(1, "quirk_insert: strdup");
-	if ((qp->instance = strdup(instance)) == NULL)
+	if ((qp->instance = mem_strdup(SWM_MEM_QUIRKS, instance)) == NULL)
 		err(1, "quirk_insert: strdup");
-	if ((qp->name = strdup(name)) == NULL)
+	if ((qp->name = mem_strdup(SWM_MEM_QUIRKS, name)) == NULL)
 		err(1, "quirk_insert: strdup");
 
 	if (asprintf(&str, "^%s$", class) == -1)
@@ -8689,10 +10390,48 @@ quirk_insert(const char *class, const char *instance, const char *name,
 		qp->quirk = quirk;
 		qp->ws = ws;
 		TAILQ_INSERT_TAIL(&quirks, qp, entry);
+		quirks_dirty = true;
 	}
 	DNPRINTF(SWM_D_QUIRK, "leave\n");
 }
 
+void
+quirk_matcher_update(void)
+{
+	struct swm_quirk_rule	*rules;
+	struct quirk		*qp;
+	int			n = 0;
+
+	if (!quirks_dirty)
+		return;
+
+	TAILQ_FOREACH(qp, &quirks, entry)
+		n++;
+	if ((rules = calloc(n ? n : 1, sizeof *rules)) == NULL)
+		err(1, "quirk_matcher_update: calloc");
+
+	n = 0;
+	TAILQ_FOREACH(qp, &quirks, entry) {
+		rules[n].pattern[SWM_QUIRK_CLASS] = qp->class;
+		rules[n].pattern[SWM_QUIRK_INSTANCE] = qp->instance;
+		rules[n].pattern[SWM_QUIRK_NAME] = qp->name;
+		rules[n].regex[SWM_QUIRK_CLASS] = &qp->regex_class;
+		rules[n].regex[SWM_QUIRK_INSTANCE] = &qp->regex_instance;
+		rules[n].regex[SWM_QUIRK_NAME] = &qp->regex_name;
+		rules[n].quirk = qp->quirk;
+		rules[n].ws = qp->ws;
+		n++;
+	}
+
+	quirk_matcher_free(quirk_matcher);
+	if ((quirk_matcher = quirk_matcher_new(rules, n)) == NULL)
+		err(1, "quirk_matcher_update: quirk_matcher_new");
+	free(rules);
+	quirks_dirty = false;
+
+	DNPRINTF(SWM_D_QUIRK, "%d quirks\n", n);
+}
+
 void
 quirk_remove(struct quirk *qp)
 {
@@ -8700,6 +10439,7 @@ quirk_remove(struct quirk *qp)
 
 	TAILQ_REMOVE(&quirks, qp, entry);
 	quirk_free(qp);
+	quirks_dirty = true;
 
 	DNPRINTF(SWM_D_QUIRK, "leave\n");
 }
@@ -8710,10 +10450,10 @@ quirk_free(struct quirk *qp)
 	regfree(&qp->regex_class);
 	regfree(&qp->regex_instance);
 	regfree(&qp->regex_name);
-	free(qp->class);
-	free(qp->instance);
-	free(qp->name);
-	free(qp);
+	mem_free(qp->class);
+	mem_free(qp->instance);
+	mem_free(qp->name);
+	mem_free(qp);
 }
 
 void
@@ -8727,11 +10467,41 @@ clear_quirks(void)
 #endif
 }
 
+/* Report the patterns quirk_insert() would fail to compile. */
 void
-quirk_replace(struct quirk *qp, const char *class, const char *instance,
-    const char *name, uint32_t quirk, int ws)
+quirk_check(const char *class, const char *instance, const char *name)
 {
-	DNPRINTF(SWM_D_QUIRK, "%s:%s:%s [%u], ws: %d\n", qp->class,
+	struct quirk		*qp;
+	const char		*field[] = { "class", "instance", "name" };
+	const char		*pat[] = { class, instance, name };
+	regex_t			re;
+	char			*str;
+	int			i;
+
+	/* A quirk that is already in use compiled before. */
+	TAILQ_FOREACH(qp, &quirks, entry)
+		if (strcmp(qp->class, class) == 0 &&
+		    strcmp(qp->instance, instance) == 0 &&
+		    strcmp(qp->name, name) == 0)
+			return;
+
+	for (i = 0; i < LENGTH(pat); i++) {
+		if (asprintf(&str, "^%s$", pat[i]) == -1)
+			err(1, "quirk_check: asprintf");
+		if (regcomp(&re, str, REG_EXTENDED | REG_NOSUB))
+			add_startup_exception("regex failed to compile quirk "
+			    "'%s' field: %s", field[i], pat[i]);
+		else
+			regfree(&re);
+		free(str);
+	}
+}
+
+void
+quirk_replace(struct quirk *qp, const char *class, const char *instance,
+    const char *name, uint32_t quirk, int ws)
+{
+	DNPRINTF(SWM_D_QUIRK, "%s:%s:%s [%u], ws: %d\n", qp->class,
 	    qp->instance, qp->name, qp->quirk, qp->ws);
 
 	quirk_remove(qp);
@@ -8835,8 +10605,12 @@ setconfquirk(const char *selector, const char *value, int flags)
 	DNPRINTF(SWM_D_CONF, "class: %s, instance: %s, name: %s\n", class,
 	    instance, name);
 
-	if ((retval = parsequirks(value, &qrks, &ws)) == 0)
-		setquirk(class, instance, name, qrks, ws);
+	if ((retval = parsequirks(value, &qrks, &ws)) == 0) {
+		if (!conf_checking)
+			setquirk(class, instance, name, qrks, ws);
+		else if (qrks || ws != -1)
+			quirk_check(class, instance, name);
+	}
 
 	free(str);
 	return (retval);
@@ -8890,10 +10664,13 @@ enum {
 	SWM_S_BOUNDARY_WIDTH,
 	SWM_S_CLOCK_ENABLED,
 	SWM_S_CLOCK_FORMAT,
+	SWM_S_CONTROL_SOCKET,
 	SWM_S_CYCLE_EMPTY,
 	SWM_S_CYCLE_VISIBLE,
 	SWM_S_DIALOG_RATIO,
 	SWM_S_DISABLE_BORDER,
+	SWM_S_EVENT_RECORD,
+	SWM_S_EVENT_RECORD_SIZE,
 	SWM_S_FOCUS_CLOSE,
 	SWM_S_FOCUS_CLOSE_WRAP,
 	SWM_S_FOCUS_DEFAULT,
@@ -8901,9 +10678,13 @@ enum {
 	SWM_S_ICONIC_ENABLED,
 	SWM_S_MAXIMIZE_HIDE_BAR,
 	SWM_S_REGION_PADDING,
+	SWM_S_RTT_BUDGET_FATAL,
+	SWM_S_SESSION_FILE,
 	SWM_S_SPAWN_ORDER,
 	SWM_S_SPAWN_TERM,
 	SWM_S_STACK_ENABLED,
+	SWM_S_STARTUP_PROFILE,
+	SWM_S_STATS_FILE,
 	SWM_S_TERM_WIDTH,
 	SWM_S_TILE_GAP,
 	SWM_S_URGENT_COLLAPSE,
@@ -8923,9 +10704,25 @@ int
 setconfvalue(const char *selector, const char *value, int flags)
 {
 	struct workspace	*ws;
-	int			i, ws_id, num_screens, n;
+	int			i, ws_id, num_screens, n, val;
 	char			*b, *str, *sp;
 
+	/* The check pass of a reload only validates, but stages programs. */
+	if (conf_checking)
+		switch (flags) {
+		case SWM_S_BAR_ENABLED_WS:
+		case SWM_S_BAR_JUSTIFY:
+		case SWM_S_FOCUS_CLOSE:
+		case SWM_S_FOCUS_DEFAULT:
+		case SWM_S_FOCUS_MODE:
+		case SWM_S_SPAWN_ORDER:
+		case SWM_S_SPAWN_TERM:
+		case SWM_S_WORKSPACE_NAME:
+			break;
+		default:
+			return (0);
+		}
+
 	switch (flags) {
 	case SWM_S_BAR_ACTION:
 		free(bar_argv[0]);
@@ -8941,14 +10738,18 @@ setconfvalue(const char *selector, const char *value, int flags)
 			bar_border_width = 0;
 		break;
 	case SWM_S_BAR_ENABLED:
-		bar_enabled = (atoi(value) != 0);
+		if (conf_changed("bar_enabled", selector, value))
+			bar_enabled = (atoi(value) != 0);
 		break;
 	case SWM_S_BAR_ENABLED_WS:
 		ws_id = atoi(selector) - 1;
 		if (ws_id < 0 || ws_id >= workspace_limit)
-			errx(1, "setconfvalue: bar_enabled_ws: invalid "
-			    "workspace %d.", ws_id + 1);
+			return (1);
 
+		if (conf_checking ||
+		    !conf_changed("bar_enabled_ws", selector, value))
+			break;
+		conf_restack = true;
 		num_screens = get_screen_count();
 		for (i = 0; i < num_screens; i++) {
 			ws = (struct workspace *)&screens[i].ws;
@@ -8988,13 +10789,15 @@ setconfvalue(const char *selector, const char *value, int flags)
 		break;
 	case SWM_S_BAR_JUSTIFY:
 		if (strcmp(value, "left") == 0)
-			bar_justify = SWM_BAR_JUSTIFY_LEFT;
+			val = SWM_BAR_JUSTIFY_LEFT;
 		else if (strcmp(value, "center") == 0)
-			bar_justify = SWM_BAR_JUSTIFY_CENTER;
+			val = SWM_BAR_JUSTIFY_CENTER;
 		else if (strcmp(value, "right") == 0)
-			bar_justify = SWM_BAR_JUSTIFY_RIGHT;
+			val = SWM_BAR_JUSTIFY_RIGHT;
 		else
-			errx(1, "invalid bar_justify");
+			return (1);
+		if (!conf_checking)
+			bar_justify = val;
 		break;
 	case SWM_S_BORDER_WIDTH:
 		border_width = atoi(value);
@@ -9016,6 +10819,14 @@ setconfvalue(const char *selector, const char *value, int flags)
 			err(1, "setconfvalue: clock_format");
 #endif
 		break;
+	case SWM_S_CONTROL_SOCKET:
+		if (conf_reloading)
+			break;
+		free(ctl_path);
+		ctl_path = NULL;
+		if (strlen(value) && (ctl_path = expand_tilde(value)) == NULL)
+			err(1, "setconfvalue: control_socket");
+		break;
 	case SWM_S_CYCLE_EMPTY:
 		cycle_empty = (atoi(value) != 0);
 		break;
@@ -9030,39 +10841,60 @@ setconfvalue(const char *selector, const char *value, int flags)
 	case SWM_S_DISABLE_BORDER:
 		disable_border = (atoi(value) != 0);
 		break;
+	case SWM_S_EVENT_RECORD:
+		if (conf_reloading)
+			break;
+		free(rec_path);
+		rec_path = NULL;
+		if (strlen(value) && (rec_path = expand_tilde(value)) == NULL)
+			err(1, "setconfvalue: event_record");
+		break;
+	case SWM_S_EVENT_RECORD_SIZE:
+		if (conf_reloading)
+			break;
+		rec_limit = (off_t)atoi(value) * 1024 * 1024;
+		if (rec_limit <= 0)
+			rec_limit = SWM_REC_SIZE_DEFAULT * 1024 * 1024;
+		break;
 	case SWM_S_FOCUS_CLOSE:
 		if (strcmp(value, "first") == 0)
-			focus_close = SWM_STACK_BOTTOM;
+			val = SWM_STACK_BOTTOM;
 		else if (strcmp(value, "last") == 0)
-			focus_close = SWM_STACK_TOP;
+			val = SWM_STACK_TOP;
 		else if (strcmp(value, "next") == 0)
-			focus_close = SWM_STACK_ABOVE;
+			val = SWM_STACK_ABOVE;
 		else if (strcmp(value, "previous") == 0)
-			focus_close = SWM_STACK_BELOW;
+			val = SWM_STACK_BELOW;
 		else
-			errx(1, "focus_close");
+			return (1);
+		if (!conf_checking)
+			focus_close = val;
 		break;
 	case SWM_S_FOCUS_CLOSE_WRAP:
 		focus_close_wrap = (atoi(value) != 0);
 		break;
 	case SWM_S_FOCUS_DEFAULT:
 		if (strcmp(value, "last") == 0)
-			focus_default = SWM_STACK_TOP;
+			val = SWM_STACK_TOP;
 		else if (strcmp(value, "first") == 0)
-			focus_default = SWM_STACK_BOTTOM;
+			val = SWM_STACK_BOTTOM;
 		else
-			errx(1, "focus_default");
+			return (1);
+		if (!conf_checking)
+			focus_default = val;
 		break;
 	case SWM_S_FOCUS_MODE:
 		if (strcmp(value, "default") == 0)
-			focus_mode = SWM_FOCUS_DEFAULT;
+			val = SWM_FOCUS_DEFAULT;
 		else if (strcmp(value, "follow") == 0 ||
 		    strcmp(value, "follow_cursor") == 0)
-			focus_mode = SWM_FOCUS_FOLLOW;
+			val = SWM_FOCUS_FOLLOW;
 		else if (strcmp(value, "manual") == 0)
-			focus_mode = SWM_FOCUS_MANUAL;
+			val = SWM_FOCUS_MANUAL;
 		else
-			errx(1, "focus_mode");
+			return (1);
+		if (!conf_checking)
+			focus_mode = val;
 		break;
 	case SWM_S_ICONIC_ENABLED:
 		iconic_enabled = (atoi(value) != 0);
@@ -9075,17 +10907,29 @@ setconfvalue(const char *selector, const char *value, int flags)
 		if (region_padding < 0)
 			region_padding = 0;
 		break;
+	case SWM_S_RTT_BUDGET_FATAL:
+		rtt_budget_fatal = (atoi(value) != 0);
+		break;
+	case SWM_S_SESSION_FILE:
+		free(session_file);
+		session_file = NULL;
+		if (strlen(value) && (session_file = expand_tilde(value)) ==
+		    NULL)
+			err(1, "setconfvalue: session_file");
+		break;
 	case SWM_S_SPAWN_ORDER:
 		if (strcmp(value, "first") == 0)
-			spawn_position = SWM_STACK_BOTTOM;
+			val = SWM_STACK_BOTTOM;
 		else if (strcmp(value, "last") == 0)
-			spawn_position = SWM_STACK_TOP;
+			val = SWM_STACK_TOP;
 		else if (strcmp(value, "next") == 0)
-			spawn_position = SWM_STACK_ABOVE;
+			val = SWM_STACK_ABOVE;
 		else if (strcmp(value, "previous") == 0)
-			spawn_position = SWM_STACK_BELOW;
+			val = SWM_STACK_BELOW;
 		else
-			errx(1, "spawn_position");
+			return (1);
+		if (!conf_checking)
+			spawn_position = val;
 		break;
 	case SWM_S_SPAWN_TERM:
 		setconfspawn("term", value, 0);
@@ -9094,6 +10938,22 @@ setconfvalue(const char *selector, const char *value, int flags)
 	case SWM_S_STACK_ENABLED:
 		stack_enabled = (atoi(value) != 0);
 		break;
+	case SWM_S_STARTUP_PROFILE:
+		free(startup_profile);
+		startup_profile = NULL;
+		if (strcmp(value, "-") == 0)
+			startup_profile = strdup(value);
+		else if (strlen(value))
+			startup_profile = expand_tilde(value);
+		if (strlen(value) && startup_profile == NULL)
+			err(1, "setconfvalue: startup_profile");
+		break;
+	case SWM_S_STATS_FILE:
+		free(stats_file);
+		stats_file = NULL;
+		if (strlen(value) && (stats_file = expand_tilde(value)) == NULL)
+			err(1, "setconfvalue: stats_file");
+		break;
 	case SWM_S_TERM_WIDTH:
 		term_width = atoi(value);
 		if (term_width < 0)
@@ -9136,6 +10996,8 @@ setconfvalue(const char *selector, const char *value, int flags)
 		workspace_clamp = (atoi(value) != 0);
 		break;
 	case SWM_S_WORKSPACE_LIMIT:
+		if (conf_reloading)
+			break;
 		workspace_limit = atoi(value);
 		if (workspace_limit > SWM_WS_MAX)
 			workspace_limit = SWM_WS_MAX;
@@ -9145,18 +11007,17 @@ setconfvalue(const char *selector, const char *value, int flags)
 		ewmh_update_desktops();
 		break;
 	case SWM_S_WORKSPACE_NAME:
-		if (getenv("SWM_STARTED") != NULL)
-			return (0);
-
 		n = 0;
 		if (sscanf(value, "ws[%d]:%n", &ws_id, &n) != 1 || n == 0 ||
 		    value[n] == '\0')
-			errx(1, "invalid entry, should be 'ws[<idx>]:name'");
+			return (1);
 		value += n;
 		ws_id--;
 		if (ws_id < 0 || ws_id >= workspace_limit)
-			errx(1, "setconfvalue: workspace_name: invalid "
-			    "workspace %d.", ws_id + 1);
+			return (1);
+
+		if (conf_checking || getenv("SWM_STARTED") != NULL)
+			return (0);
 
 		num_screens = get_screen_count();
 		for (i = 0; i < num_screens; ++i) {
@@ -9179,22 +11040,27 @@ setconfvalue(const char *selector, const char *value, int flags)
 int
 setconfmodkey(const char *selector, const char *value, int flags)
 {
+	uint16_t	mod;
+
 	/* suppress unused warnings since vars are needed */
 	(void)selector;
 	(void)flags;
 
 	if (strncasecmp(value, "Mod1", strlen("Mod1")) == 0)
-		update_modkey(XCB_MOD_MASK_1);
+		mod = XCB_MOD_MASK_1;
 	else if (strncasecmp(value, "Mod2", strlen("Mod2")) == 0)
-		update_modkey(XCB_MOD_MASK_2);
+		mod = XCB_MOD_MASK_2;
 	else if (strncasecmp(value, "Mod3", strlen("Mod3")) == 0)
-		update_modkey(XCB_MOD_MASK_3);
+		mod = XCB_MOD_MASK_3;
 	else if (strncasecmp(value, "Mod4", strlen("Mod4")) == 0)
-		update_modkey(XCB_MOD_MASK_4);
+		mod = XCB_MOD_MASK_4;
 	else if (strncasecmp(value, "Mod5", strlen("Mod5")) == 0)
-		update_modkey(XCB_MOD_MASK_5);
+		mod = XCB_MOD_MASK_5;
 	else
 		return (1);
+
+	if (!conf_checking)
+		update_modkey(mod);
 	return (0);
 }
 
@@ -9220,6 +11086,9 @@ setconfcolor(const char *selector, const char *value, int flags)
 		return (1);
 	}
 
+	if (conf_checking)
+		return (0);
+
 	for (i = first; i <= last; ++i) {
 		setscreencolor(value, i, flags);
 
@@ -9263,10 +11132,59 @@ setconfregion(const char *selector, const char *value, int flags)
 	(void)selector;
 	(void)flags;
 
+	/* Regions are only set up at startup. */
+	if (conf_reloading)
+		return (0);
+
 	custom_region(value);
 	return (0);
 }
 
+/* rtt_budget[<action|event|function>] = <round trips>, empty to clear. */
+int
+setconfrttbudget(const char *selector, const char *value, int flags)
+{
+	struct swm_stat		*st = NULL;
+	const char		*errstr, *label;
+	long long		budget = 0;
+	int			i;
+
+	/* suppress unused warning since var is needed */
+	(void)flags;
+
+	if (selector == NULL || strlen(selector) == 0)
+		return (1);
+
+	for (i = 0; i < FN_INVALID && st == NULL; i++)
+		if (strncasecmp(selector, actions[i].name,
+		    SWM_FUNCNAME_LEN) == 0)
+			st = &stat_actions[i];
+	for (i = 1; i < SWM_STAT_EVENTS && st == NULL; i++)
+		if ((label = xcb_event_get_label(i)) &&
+		    strcasecmp(selector, label) == 0)
+			st = &stat_events[i];
+	for (i = 0; i < SWM_STAT_FUNCS && st == NULL; i++)
+		if (strcasecmp(selector, stat_func_names[i]) == 0)
+			st = &stat_funcs[i];
+	if (st == NULL)
+		return (1);
+
+	if (strlen(value)) {
+		budget = strtonum(value, 0, UINT32_MAX, &errstr);
+		if (errstr)
+			return (1);
+	}
+
+	if (conf_checking)
+		return (0);
+
+	DNPRINTF(SWM_D_CONF, "%s: %s\n", selector, strlen(value) ? value :
+	    "none");
+	st->rtt_budget = budget;
+	st->rtt_budgeted = (strlen(value) != 0);
+	return (0);
+}
+
 int
 setautorun(const char *selector, const char *value, int flags)
 {
@@ -9275,23 +11193,22 @@ setautorun(const char *selector, const char *value, int flags)
 	union arg		a;
 	int			argc = 0, n;
 	pid_t			pid;
-	struct pid_e		*p;
 
 	/* suppress unused warnings since vars are needed */
 	(void)selector;
 	(void)flags;
 
-	if (getenv("SWM_STARTED"))
-		return (0);
-
 	n = 0;
 	if (sscanf(value, "ws[%d]:%n", &ws_id, &n) != 1 || n == 0 ||
 	    value[n] == '\0')
-		errx(1, "invalid autorun entry, should be 'ws[<idx>]:command'");
+		return (1);
 	value += n;
 	ws_id--;
 	if (ws_id < 0 || ws_id >= workspace_limit)
-		errx(1, "autorun: invalid workspace %d", ws_id + 1);
+		return (1);
+
+	if (conf_checking || getenv("SWM_STARTED"))
+		return (0);
 
 	sp = str = expand_tilde(value);
 
@@ -9326,16 +11243,8 @@ setautorun(const char *selector, const char *value, int flags)
 	free(str);
 
 	/* parent */
-	p = find_pid(pid);
-	if (p == NULL) {
-		p = calloc(1, sizeof *p);
-		if (p == NULL)
-			return (1);
-		TAILQ_INSERT_TAIL(&pidlist, p, entry);
-	}
-
-	p->pid = pid;
-	p->ws = ws_id;
+	if (pid_insert(pid, ws_id) == NULL)
+		return (1);
 
 	return (0);
 }
@@ -9344,6 +11253,8 @@ int
 setlayout(const char *selector, const char *value, int flags)
 {
 	struct workspace	*ws;
+	const char		*conf_value = value;
+	char			ws_sel[8];
 	int			ws_id, i, x, mg, ma, si, ar, n;
 	int			st = SWM_V_STACK, num_screens;
 	bool			f = false;
@@ -9352,19 +11263,14 @@ setlayout(const char *selector, const char *value, int flags)
 	(void)selector;
 	(void)flags;
 
-	if (getenv("SWM_STARTED"))
-		return (0);
-
 	n = 0;
 	if (sscanf(value, "ws[%d]:%d:%d:%d:%d:%n",
 	    &ws_id, &mg, &ma, &si, &ar, &n) != 5 || n == 0 || value[n] == '\0')
-		errx(1, "invalid layout entry, should be 'ws[<idx>]:"
-		    "<master_grow>:<master_add>:<stack_inc>:<always_raise>:"
-		    "<type>'");
+		return (1);
 	value += n;
 	ws_id--;
 	if (ws_id < 0 || ws_id >= workspace_limit)
-		errx(1, "layout: invalid workspace %d", ws_id + 1);
+		return (1);
 
 	if (strcasecmp(value, "vertical") == 0)
 		st = SWM_V_STACK;
@@ -9379,9 +11285,17 @@ setlayout(const char *selector, const char *value, int flags)
 	} else if (strcasecmp(value, "fullscreen") == 0)
 		st = SWM_MAX_STACK;
 	else
-		errx(1, "invalid layout entry, should be 'ws[<idx>]:"
-		    "<master_grow>:<master_add>:<stack_inc>:<always_raise>:"
-		    "<type>'");
+		return (1);
+
+	if (conf_checking)
+		return (0);
+
+	/* Once started, only a reload that changed the entry applies it. */
+	snprintf(ws_sel, sizeof ws_sel, "%d", ws_id + 1);
+	if (!conf_changed("layout", ws_sel, conf_value) ||
+	    (getenv("SWM_STARTED") && !conf_reloading))
+		return (0);
+	conf_restack = true;
 
 	num_screens = get_screen_count();
 	for (i = 0; i < num_screens; i++) {
@@ -9392,6 +11306,14 @@ setlayout(const char *selector, const char *value, int flags)
 		if (st == SWM_MAX_STACK)
 			continue;
 
+		/* Start from the defaults, as at startup. */
+		if (conf_reloading) {
+			ws[ws_id].cur_layout->l_config(&ws[ws_id],
+			    SWM_ARG_ID_STACKRESET);
+			ws[ws_id].l_state.vertical_flip = false;
+			ws[ws_id].l_state.horizontal_flip = false;
+		}
+
 		/* master grow */
 		for (x = 0; x < abs(mg); x++) {
 			ws[ws_id].cur_layout->l_config(&ws[ws_id],
@@ -9452,10 +11374,13 @@ struct config_option configopt[] = {
 	{ "color_focus_maximized",	setconfcolor,	SWM_S_COLOR_FOCUS_MAXIMIZED },
 	{ "color_unfocus",		setconfcolor,	SWM_S_COLOR_UNFOCUS },
 	{ "color_unfocus_maximized",	setconfcolor,	SWM_S_COLOR_UNFOCUS_MAXIMIZED },
+	{ "control_socket",		setconfvalue,	SWM_S_CONTROL_SOCKET },
 	{ "cycle_empty",		setconfvalue,	SWM_S_CYCLE_EMPTY },
 	{ "cycle_visible",		setconfvalue,	SWM_S_CYCLE_VISIBLE },
 	{ "dialog_ratio",		setconfvalue,	SWM_S_DIALOG_RATIO },
 	{ "disable_border",		setconfvalue,	SWM_S_DISABLE_BORDER },
+	{ "event_record",		setconfvalue,	SWM_S_EVENT_RECORD },
+	{ "event_record_size",		setconfvalue,	SWM_S_EVENT_RECORD_SIZE },
 	{ "focus_close",		setconfvalue,	SWM_S_FOCUS_CLOSE },
 	{ "focus_close_wrap",		setconfvalue,	SWM_S_FOCUS_CLOSE_WRAP },
 	{ "focus_default",		setconfvalue,	SWM_S_FOCUS_DEFAULT },
@@ -9470,11 +11395,16 @@ struct config_option configopt[] = {
 	{ "quirk",			setconfquirk,	0 },
 	{ "region",			setconfregion,	0 },
 	{ "region_padding",		setconfvalue,	SWM_S_REGION_PADDING },
+	{ "rtt_budget",			setconfrttbudget, 0 },
+	{ "rtt_budget_fatal",		setconfvalue,	SWM_S_RTT_BUDGET_FATAL },
 	{ "screenshot_app",		NULL,		0 }, /* dummy */
 	{ "screenshot_enabled",		NULL,		0 }, /* dummy */
+	{ "session_file",		setconfvalue,	SWM_S_SESSION_FILE },
 	{ "spawn_position",		setconfvalue,	SWM_S_SPAWN_ORDER },
 	{ "spawn_term",			setconfvalue,	SWM_S_SPAWN_TERM },
 	{ "stack_enabled",		setconfvalue,	SWM_S_STACK_ENABLED },
+	{ "startup_profile",		setconfvalue,	SWM_S_STARTUP_PROFILE },
+	{ "stats_file",			setconfvalue,	SWM_S_STATS_FILE },
 	{ "term_width",			setconfvalue,	SWM_S_TERM_WIDTH },
 	{ "tile_gap",			setconfvalue,	SWM_S_TILE_GAP },
 	{ "title_class_enabled",	setconfvalue,	SWM_S_WINDOW_CLASS_ENABLED }, /* For backwards compat. */
@@ -9517,6 +11447,46 @@ add_startup_exception(const char *fmt, ...)
 	va_end(ap);
 }
 
+/*
+ * Record the value an option has in the config file and return whether it
+ * differs from the previous load; always true outside of a reload.  Used for
+ * options the user can also change at runtime, so that a reload does not undo
+ * those changes unless the file asks for something new.
+ */
+bool
+conf_changed(const char *name, const char *selector, const char *value)
+{
+	struct conf_value	*cv;
+	char			*key;
+
+	if (asprintf(&key, "%s[%s]", name, selector ? selector : "") == -1)
+		err(1, "conf_changed: asprintf");
+
+	TAILQ_FOREACH(cv, &conf_values, entry)
+		if (strcmp(cv->key, key) == 0)
+			break;
+
+	if (cv == NULL) {
+		if ((cv = calloc(1, sizeof *cv)) == NULL)
+			err(1, "conf_changed: calloc");
+		cv->key = key;
+		TAILQ_INSERT_TAIL(&conf_values, cv, entry);
+	} else {
+		free(key);
+		if (conf_reloading && strcmp(cv->value, value) == 0) {
+			cv->seen = true;
+			return (false);
+		}
+		free(cv->value);
+	}
+
+	cv->seen = true;
+	if ((cv->value = strdup(value)) == NULL)
+		err(1, "conf_changed: strdup");
+
+	return (true);
+}
+
 int
 conf_load(const char *filename, int keymapping)
 {
@@ -9681,54 +11651,109 @@ set_child_transient(struct ws_win *win, xcb_window_t *trans)
 	}
 }
 
+/* Client pid of win from _NET_WM_PID or, failing that, the X-Resource ext. */
 pid_t
 window_get_pid(xcb_window_t win)
 {
-	pid_t				ret = 0;
-	const char			*errstr;
-	xcb_atom_t			apid;
-	xcb_get_property_cookie_t	pc;
-	xcb_get_property_reply_t	*pr;
+	pid_t					ret = 0;
+	xcb_get_property_cookie_t		pc;
+	xcb_get_property_reply_t		*pr;
+	xcb_res_client_id_spec_t		spec;
+	xcb_res_query_client_ids_cookie_t	qc;
+	xcb_res_query_client_ids_reply_t	*qr;
+	xcb_res_client_id_value_iterator_t	iter;
 
-	apid = get_atom_from_string("_NET_WM_PID");
-	if (apid == XCB_ATOM_NONE)
-		goto tryharder;
-
-	pc = xcb_get_property(conn, 0, win, apid, XCB_ATOM_CARDINAL, 0, 1);
+	pc = xcb_get_property(conn, 0, win, a_net_wm_pid, XCB_ATOM_CARDINAL,
+	    0, 1);
 	pr = xcb_get_property_reply(conn, pc, NULL);
-	if (pr == NULL)
-		goto tryharder;
-	if (pr->type != XCB_ATOM_CARDINAL) {
+	if (pr) {
+		if (pr->type == XCB_ATOM_CARDINAL && pr->format == 32 &&
+		    xcb_get_property_value_length(pr) == sizeof(uint32_t))
+			ret = *((uint32_t *)xcb_get_property_value(pr));
 		free(pr);
-		goto tryharder;
+		if (ret > 0)
+			return (ret);
 	}
 
-	if (pr->type == apid && pr->format == 32)
-		ret = *((pid_t *)xcb_get_property_value(pr));
-	free(pr);
+	/* No _NET_WM_PID, ask the server which local client owns win. */
+	if (!xres_support)
+		return (0);
+
+	spec.client = win;
+	spec.mask = XCB_RES_CLIENT_ID_MASK_LOCAL_CLIENT_PID;
+	qc = xcb_res_query_client_ids(conn, 1, &spec);
+	qr = xcb_res_query_client_ids_reply(conn, qc, NULL);
+	if (qr == NULL)
+		return (0);
+
+	for (iter = xcb_res_query_client_ids_ids_iterator(qr); iter.rem;
+	    xcb_res_client_id_value_next(&iter))
+		if (iter.data->spec.mask &
+		    XCB_RES_CLIENT_ID_MASK_LOCAL_CLIENT_PID &&
+		    xcb_res_client_id_value_value_length(iter.data) == 1) {
+			ret = *xcb_res_client_id_value_value(iter.data);
+			break;
+		}
+	free(qr);
+
+	DNPRINTF(SWM_D_MISC, "win %#x: client pid %d\n", win, ret);
 
 	return (ret);
+}
+
+/* Pid of the spawned ancestor recorded in _SWM_PID by libswmhack. */
+pid_t
+window_get_swm_pid(xcb_window_t win)
+{
+	pid_t				ret = 0;
+	const char			*errstr;
+	char				buf[SWM_PROPLEN];
+	int				len;
+	xcb_get_property_cookie_t	pc;
+	xcb_get_property_reply_t	*pr;
 
-tryharder:
-	apid = get_atom_from_string("_SWM_PID");
-	pc = xcb_get_property(conn, 0, win, apid, XCB_ATOM_STRING,
+	pc = xcb_get_property(conn, 0, win, a_swm_pid, XCB_ATOM_STRING,
 	    0, SWM_PROPLEN);
 	pr = xcb_get_property_reply(conn, pc, NULL);
 	if (pr == NULL)
 		return (0);
-	if (pr->type != apid) {
+	if (pr->type != XCB_ATOM_STRING || pr->format != 8) {
 		free(pr);
 		return (0);
 	}
 
-	ret = (pid_t)strtonum(xcb_get_property_value(pr), 0, INT_MAX, &errstr);
+	len = xcb_get_property_value_length(pr);
+	if (len > 0 && len < SWM_PROPLEN) {
+		memcpy(buf, xcb_get_property_value(pr), len);
+		buf[len] = '\0';
+		ret = (pid_t)strtonum(buf, 0, INT_MAX, &errstr);
+	}
 	free(pr);
 
 	return (ret);
 }
 
+/*
+ * Find the tracked process win was launched from.  The client's own pid is
+ * looked up first, then its ancestors, and last whatever libswmhack recorded.
+ */
+struct pid_e *
+window_find_pid(xcb_window_t win)
+{
+	struct pid_e		*p;
+
+	/* Nothing to match; skip the round trips. */
+	if (pid_count == 0)
+		return (NULL);
+
+	if ((p = find_pid_ancestor(window_get_pid(win))) != NULL)
+		return (p);
+
+	return (find_pid(window_get_swm_pid(win)));
+}
+
 int
-get_swm_ws(xcb_window_t id)
+get_swm_ws(xcb_window_t id, struct swm_prefetch *pf)
 {
 	int			ws_idx = -1;
 	char			*prop = NULL;
@@ -9737,8 +11762,8 @@ get_swm_ws(xcb_window_t id)
 	xcb_get_property_reply_t	*gpr;
 
 	gpr = xcb_get_property_reply(conn,
-		xcb_get_property(conn, 0, id, a_swm_ws,
-		    XCB_ATOM_STRING, 0, SWM_PROPLEN),
+		PREFETCH(pf, swm_ws, xcb_get_property(conn, 0, id, a_swm_ws,
+		    XCB_ATOM_STRING, 0, SWM_PROPLEN)),
 		NULL);
 	if (gpr == NULL)
 		return (-1);
@@ -9769,7 +11794,7 @@ get_swm_ws(xcb_window_t id)
 }
 
 int
-get_ws_idx(struct ws_win *win)
+get_ws_idx(struct ws_win *win, struct swm_prefetch *pf)
 {
 	xcb_get_property_reply_t	*gpr;
 	int			ws_idx = -1;
@@ -9778,8 +11803,8 @@ get_ws_idx(struct ws_win *win)
 		return -1;
 
 	gpr = xcb_get_property_reply(conn,
-		xcb_get_property(conn, 0, win->id, ewmh[_NET_WM_DESKTOP].atom,
-		    XCB_ATOM_CARDINAL, 0, 1),
+		PREFETCH(pf, desktop, xcb_get_property(conn, 0, win->id,
+		    ewmh[_NET_WM_DESKTOP].atom, XCB_ATOM_CARDINAL, 0, 1)),
 		NULL);
 	if (gpr) {
 		if (gpr->type == XCB_ATOM_CARDINAL && gpr->format == 32)
@@ -9788,7 +11813,7 @@ get_ws_idx(struct ws_win *win)
 	}
 
 	if (ws_idx == -1 && !(win->quirks & SWM_Q_IGNORESPAWNWS))
-		ws_idx = get_swm_ws(win->id);
+		ws_idx = get_swm_ws(win->id, pf);
 
 	if (ws_idx > workspace_limit - 1 || ws_idx < -1)
 		ws_idx = -1;
@@ -9850,19 +11875,91 @@ unparent_window(struct ws_win *win)
 	win->state = SWM_WIN_STATE_UNPARENTING;
 }
 
+/*
+ * Select the events spectrwm wants from window id, then ask for everything
+ * manage_window() reads after its attributes.  Selecting first means a
+ * property changed after it was read still gets a PropertyNotify.
+ */
+void
+prefetch_window(xcb_window_t id, struct swm_prefetch *pf)
+{
+	uint32_t		wa[1];
+
+	wa[0] = XCB_EVENT_MASK_ENTER_WINDOW | XCB_EVENT_MASK_PROPERTY_CHANGE |
+	    XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+	xcb_change_window_attributes(conn, id, XCB_CW_EVENT_MASK, wa);
+
+	pf->geometry = xcb_get_geometry(conn, id);
+	pf->normal_hints = xcb_icccm_get_wm_normal_hints(conn, id);
+	pf->hints = xcb_icccm_get_wm_hints(conn, id);
+	pf->transient_for = xcb_icccm_get_wm_transient_for(conn, id);
+	pf->protocols = xcb_icccm_get_wm_protocols(conn, id, a_prot);
+	pf->window_type = xcb_get_property(conn, 0, id,
+	    ewmh[_NET_WM_WINDOW_TYPE].atom, XCB_ATOM_ATOM, 0, UINT32_MAX);
+	pf->class = xcb_icccm_get_wm_class(conn, id);
+	pf->net_name = xcb_get_property(conn, 0, id, ewmh[_NET_WM_NAME].atom,
+	    XCB_GET_PROPERTY_TYPE_ANY, 0, UINT_MAX);
+	pf->name = xcb_get_property(conn, 0, id, XCB_ATOM_WM_NAME,
+	    XCB_GET_PROPERTY_TYPE_ANY, 0, UINT_MAX);
+	pf->desktop = xcb_get_property(conn, 0, id, ewmh[_NET_WM_DESKTOP].atom,
+	    XCB_ATOM_CARDINAL, 0, 1);
+	pf->swm_ws = xcb_get_property(conn, 0, id, a_swm_ws, XCB_ATOM_STRING,
+	    0, SWM_PROPLEN);
+	pf->net_wm_state = xcb_get_property(conn, 0, id,
+	    ewmh[_NET_WM_STATE].atom, XCB_ATOM_ATOM, 0, UINT32_MAX);
+}
+
+xcb_get_property_cookie_t
+prefetch_take(xcb_get_property_cookie_t *c)
+{
+	xcb_get_property_cookie_t	ret = *c;
+
+	c->sequence = 0;
+	return (ret);
+}
+
+/* Drop the replies nobody took. */
+void
+prefetch_discard(struct swm_prefetch *pf)
+{
+	xcb_get_property_cookie_t	*pc[] = { &pf->wm_state,
+	    &pf->normal_hints, &pf->hints, &pf->transient_for, &pf->protocols,
+	    &pf->window_type, &pf->class, &pf->net_name, &pf->name,
+	    &pf->desktop, &pf->swm_ws, &pf->net_wm_state };
+	int				i;
+
+	if (pf->attributes.sequence)
+		xcb_discard_reply(conn, pf->attributes.sequence);
+	if (pf->geometry.sequence)
+		xcb_discard_reply(conn, pf->geometry.sequence);
+	for (i = 0; i < LENGTH(pc); i++)
+		if (pc[i]->sequence)
+			xcb_discard_reply(conn, pc[i]->sequence);
+	memset(pf, 0, sizeof *pf);
+}
+
+/*
+ * pf holds the requests for window id if the caller sent them ahead (see
+ * state_adopt()), or is NULL; either way manage_window() waits once for the
+ * attributes and once for the rest.
+ */
 struct ws_win *
-manage_window(xcb_window_t id, int spawn_pos, bool mapping)
+manage_window(xcb_window_t id, int spawn_pos, bool mapping,
+    struct swm_prefetch *pf)
 {
 	struct ws_win				*win = NULL, *ww;
 	struct swm_region			*r;
 	struct pid_e				*p;
-	struct quirk				*qp;
-	xcb_get_geometry_reply_t		*gr;
+	struct swm_quirk_result			qr;
+	struct swm_prefetch			pfl;
 	xcb_get_window_attributes_reply_t	*war = NULL;
+	xcb_get_geometry_reply_t		*gr;
 	xcb_window_t				trans = XCB_WINDOW_NONE;
-	uint32_t				i, wa[1], new_flags;
+	uint32_t				i, new_flags;
 	int					ws_idx, force_ws = -1;
-	char					*class, *instance, *name;
+	const char				*class, *instance, *name;
+
+	SWM_PROBE1(manage_start, id);
 
 	if (find_bar(id)) {
 		DNPRINTF(SWM_D_MISC, "skip; win %#x is region bar\n", id);
@@ -9893,8 +11990,13 @@ manage_window(xcb_window_t id, int spawn_pos, bool mapping)
 		DNPRINTF(SWM_D_MISC, "win %#x is new\n", id);
 	}
 
-	war = xcb_get_window_attributes_reply(conn,
-	    xcb_get_window_attributes(conn, id), NULL);
+	if (pf) {
+		war = xcb_get_window_attributes_reply(conn, pf->attributes,
+		    NULL);
+		pf->attributes.sequence = 0;
+	} else
+		war = xcb_get_window_attributes_reply(conn,
+		    xcb_get_window_attributes(conn, id), NULL);
 	if (war == NULL) {
 		DNPRINTF(SWM_D_EVENT, "skip; window lost\n");
 		goto out;
@@ -9906,20 +12008,28 @@ manage_window(xcb_window_t id, int spawn_pos, bool mapping)
 	}
 
 	if (!mapping && war->map_state == XCB_MAP_STATE_UNMAPPED &&
-	    get_win_state(id) == XCB_ICCCM_WM_STATE_WITHDRAWN) {
+	    get_win_state(id, pf) == XCB_ICCCM_WM_STATE_WITHDRAWN) {
 		DNPRINTF(SWM_D_EVENT, "skip; window withdrawn\n");
 		goto out;
 	}
 
+	if (pf == NULL) {
+		memset(&pfl, 0, sizeof pfl);
+		prefetch_window(id, &pfl);
+		pf = &pfl;
+	}
+
 	/* Try to get initial window geometry. */
-	gr = xcb_get_geometry_reply(conn, xcb_get_geometry(conn, id), NULL);
+	gr = xcb_get_geometry_reply(conn, pf->geometry, NULL);
+	pf->geometry.sequence = 0;
 	if (gr == NULL) {
 		DNPRINTF(SWM_D_MISC, "get geometry failed\n");
 		goto out;
 	}
 
 	/* Create and initialize ws_win object. */
-	if ((win = calloc(1, sizeof(struct ws_win))) == NULL)
+	if ((win = mem_calloc(SWM_MEM_WINDOWS, 1,
+	    sizeof(struct ws_win))) == NULL)
 		err(1, "manage_window: calloc: failed to allocate memory for "
 		    "new window");
 
@@ -9939,33 +12049,24 @@ manage_window(xcb_window_t id, int spawn_pos, bool mapping)
 
 	free(gr);
 
-	/* Select which X events to monitor and set border pixel color. */
-	wa[0] = XCB_EVENT_MASK_ENTER_WINDOW | XCB_EVENT_MASK_PROPERTY_CHANGE |
-	    XCB_EVENT_MASK_STRUCTURE_NOTIFY;
-
-	xcb_change_window_attributes(conn, win->id, XCB_CW_EVENT_MASK, wa);
-
 	/* Get WM_SIZE_HINTS. */
 	xcb_icccm_get_wm_normal_hints_reply(conn,
-	    xcb_icccm_get_wm_normal_hints(conn, win->id),
-	    &win->sh, NULL);
+	    prefetch_take(&pf->normal_hints), &win->sh, NULL);
 
 	/* Get WM_HINTS. */
-	xcb_icccm_get_wm_hints_reply(conn,
-	    xcb_icccm_get_wm_hints(conn, win->id),
+	xcb_icccm_get_wm_hints_reply(conn, prefetch_take(&pf->hints),
 	    &win->hints, NULL);
 
 	/* Get WM_TRANSIENT_FOR; see if window is a transient. */
 	xcb_icccm_get_wm_transient_for_reply(conn,
-	    xcb_icccm_get_wm_transient_for(conn, win->id),
-	    &trans, NULL);
+	    prefetch_take(&pf->transient_for), &trans, NULL);
 	if (trans) {
 		win->transient = trans;
 		set_child_transient(win, &win->transient);
 	}
 
 	/* Get WM_PROTOCOLS. */
-	get_wm_protocols(win);
+	get_wm_protocols(win, pf);
 
 #ifdef SWM_DEBUG
 	/* Must be after getting WM_HINTS and WM_PROTOCOLS. */
@@ -9973,16 +12074,15 @@ manage_window(xcb_window_t id, int spawn_pos, bool mapping)
 #endif
 
 	/* Set initial quirks based on EWMH. */
-	ewmh_autoquirk(win);
+	ewmh_autoquirk(win, pf);
 
 	/* Determine initial quirks. */
-	xcb_icccm_get_wm_class_reply(conn,
-	    xcb_icccm_get_wm_class(conn, win->id),
-	    &win->ch, NULL);
+	update_win_class(win, pf);
+	update_win_name(win, pf);
 
-	class = win->ch.class_name ? win->ch.class_name : "";
-	instance = win->ch.instance_name ? win->ch.instance_name : "";
-	name = get_win_name(win->id);
+	class = win->class ? win->class : "";
+	instance = win->instance ? win->instance : "";
+	name = win->title;
 
 	DNPRINTF(SWM_D_CLASS, "class: %s, instance: %s, name: %s\n", class,
 	    instance, name);
@@ -9993,21 +12093,17 @@ manage_window(xcb_window_t id, int spawn_pos, bool mapping)
 		win->java = true;
 	}
 
-	TAILQ_FOREACH(qp, &quirks, entry) {
-		if (regexec(&qp->regex_class, class, 0, NULL, 0) == 0 &&
-		    regexec(&qp->regex_instance, instance, 0, NULL, 0) == 0 &&
-		    regexec(&qp->regex_name, name, 0, NULL, 0) == 0) {
-			DNPRINTF(SWM_D_CLASS, "matched quirk: %s:%s:%s "
-			    "mask: %#x, ws: %d\n", qp->class, qp->instance,
-			    qp->name, qp->quirk, qp->ws);
-			win->quirks = qp->quirk;
-			if (qp->ws >= 0 && qp->ws < workspace_limit)
-				force_ws = qp->ws;
-		}
+	/* Later quirks win; the workspace is that of the last one with one. */
+	quirk_matcher_update();
+	quirk_match(quirk_matcher, class, instance, name, workspace_limit, &qr);
+	if (qr.rule != -1) {
+		DNPRINTF(SWM_D_CLASS, "matched quirk %d, mask: %#x, ws: %d\n",
+		    qr.rule, qr.quirk, qr.ws);
+		win->quirks = qr.quirk;
+		if (qr.ws != -1)
+			force_ws = qr.ws;
 	}
 
-	free(name);
-
 	/* Reset font sizes (the bruteforce way; no default keybinding). */
 	if (win->quirks & SWM_Q_XTERM_FONTADJ) {
 		for (i = 0; i < SWM_MAX_FONT_STEPS; i++)
@@ -10018,12 +12114,11 @@ manage_window(xcb_window_t id, int spawn_pos, bool mapping)
 
 	/* Figure out which workspace the window belongs to. */
 	if (!(win->quirks & SWM_Q_IGNOREPID) &&
-	    (p = find_pid(window_get_pid(win->id))) != NULL) {
+	    (p = window_find_pid(win->id)) != NULL) {
 		win->ws = &r->s->ws[p->ws];
-		TAILQ_REMOVE(&pidlist, p, entry);
-		free(p);
+		pid_remove(p);
 		p = NULL;
-	} else if ((ws_idx = get_ws_idx(win)) != -1 &&
+	} else if ((ws_idx = get_ws_idx(win, pf)) != -1 &&
 	    !TRANS(win)) {
 		/* _SWM_WS is set; use that. */
 		win->ws = &r->s->ws[ws_idx];
@@ -10081,7 +12176,7 @@ remanage:
 	lower_window(win);
 
 	/* Get/apply initial _NET_WM_STATE */
-	ewmh_get_wm_state(win);
+	ewmh_get_wm_state(win, pf);
 
 	/* Apply quirks. */
 	new_flags = win->ewmh_flags;
@@ -10105,7 +12200,10 @@ remanage:
 	    WIDTH(win), HEIGHT(win), win->ws->idx, YESNO(ICONIC(win)),
 	    win->transient);
 out:
+	if (pf)
+		prefetch_discard(pf);
 	free(war);
+	SWM_PROBE2(manage_done, id, WINID(win));
 	return (win);
 }
 
@@ -10117,12 +12215,14 @@ free_window(struct ws_win *win)
 	if (win == NULL)
 		return;
 
-	xcb_icccm_get_wm_class_reply_wipe(&win->ch);
+	str_release(win->class);
+	str_release(win->instance);
+	str_release(win->title);
 
 	/* paint memory */
 	memset(win, 0xff, sizeof *win);	/* XXX kill later */
 
-	free(win);
+	mem_free(win);
 	DNPRINTF(SWM_D_MISC, "done\n");
 }
 
@@ -10134,6 +12234,8 @@ unmanage_window(struct ws_win *win)
 	if (win == NULL)
 		return;
 
+	SWM_PROBE1(unmanage_start, win->id);
+
 	kill_refs(win);
 	unparent_window(win);
 
@@ -10142,6 +12244,8 @@ unmanage_window(struct ws_win *win)
 	TAILQ_INSERT_TAIL(&win->ws->unmanagedlist, win, entry);
 
 	ewmh_update_client_list();
+
+	SWM_PROBE1(unmanage_done, win->id);
 }
 
 void
@@ -10211,36 +12315,35 @@ keypress(xcb_key_press_event_t *e)
 {
 	struct action		*ap;
 	struct binding		*bp;
-	xcb_keysym_t		keysym;
+	uint64_t		start, rtt_start;
 	bool			replay = true;
 
 	last_event_time = e->time;
 
-	keysym = xcb_key_press_lookup_keysym(syms, e, 0);
-
 	DNPRINTF(SWM_D_EVENT, "keysym: %u, win (x,y): %#x (%d,%d), detail: %u, "
 	    "time: %#x, root (x,y): %#x (%d,%d), child: %#x, state: %u, "
-	    "cleaned: %u, same_screen: %s\n", keysym, e->event, e->event_x,
+	    "cleaned: %u, same_screen: %s\n",
+	    xcb_key_press_lookup_keysym(syms, e, 0), e->event, e->event_x,
 	    e->event_y, e->detail, e->time, e->root, e->root_x, e->root_y,
 	    e->child, e->state, CLEANMASK(e->state), YESNO(e->same_screen));
 
-	bp = binding_lookup(CLEANMASK(e->state), KEYBIND, keysym);
-	if (bp == NULL) {
-		/* Look for catch-all. */
-		if ((bp = binding_lookup(ANYMOD, KEYBIND, keysym)) == NULL)
-			goto out;
-	}
+	if ((bp = key_lookup(e->detail, e->state)) == NULL)
+		goto out;
 
 	replay = bp->flags & BINDING_F_REPLAY;
 
 	if ((ap = &actions[bp->action]) == NULL)
 		goto out;
 
+	start = monotonic_usec();
+	rtt_start = stat_rtt;
 	if (bp->action == FN_SPAWN_CUSTOM)
 		spawn_custom(root_to_region(e->root, SWM_CK_ALL), &ap->args,
 		    bp->spawn_name);
 	else if (ap->func)
 		ap->func(bp, root_to_region(e->root, SWM_CK_ALL), &ap->args);
+	stat_record(&stat_actions[bp->action], SWM_TRACE_ACTION, bp->action,
+	    start, rtt_start);
 
 	replay = replay && !(ap->flags & FN_F_NOREPLAY);
 
@@ -10264,23 +12367,17 @@ keyrelease(xcb_key_release_event_t *e)
 {
 	struct action		*ap;
 	struct binding		*bp;
-	xcb_keysym_t		keysym;
 
 	last_event_time = e->time;
 
-	keysym = xcb_key_release_lookup_keysym(syms, e, 0);
-
 	DNPRINTF(SWM_D_EVENT, "keysym: %u, win (x,y): %#x (%d,%d), detail: %u, "
 	    "time: %#x, root (x,y): %#x (%d,%d), child: %#x, state: %u, "
-	    "same_screen: %s\n", keysym, e->event, e->event_x, e->event_y,
+	    "same_screen: %s\n", xcb_key_release_lookup_keysym(syms, e, 0),
+	    e->event, e->event_x, e->event_y,
 	    e->detail, e->time, e->root, e->root_x, e->root_y, e->child,
 	    e->state, YESNO(e->same_screen));
 
-	bp = binding_lookup(CLEANMASK(e->state), KEYBIND, keysym);
-	if (bp == NULL)
-		/* Look for catch-all. */
-		bp = binding_lookup(ANYMOD, KEYBIND, keysym);
-
+	bp = key_lookup(e->detail, e->state);
 	if (bp && (ap = &actions[bp->action]) && !(ap->flags & FN_F_NOREPLAY) &&
 	    bp->flags & BINDING_F_REPLAY) {
 		/* Replay event to event window */
@@ -10304,6 +12401,7 @@ buttonpress(xcb_button_press_event_t *e)
 	struct swm_region	*r, *old_r;
 	struct action		*ap;
 	struct binding		*bp;
+	uint64_t		start, rtt_start;
 	bool			replay = true;
 
 	last_event_time = e->time;
@@ -10367,11 +12465,15 @@ buttonpress(xcb_button_press_event_t *e)
 	if ((ap = &actions[bp->action]) == NULL)
 		goto out;
 
+	start = monotonic_usec();
+	rtt_start = stat_rtt;
 	if (bp->action == FN_SPAWN_CUSTOM)
 		spawn_custom(root_to_region(e->root, SWM_CK_ALL), &ap->args,
 		    bp->spawn_name);
 	else if (ap->func)
 		ap->func(bp, root_to_region(e->root, SWM_CK_ALL), &ap->args);
+	stat_record(&stat_actions[bp->action], SWM_TRACE_ACTION, bp->action,
+	    start, rtt_start);
 
 	replay = replay && !(ap->flags & FN_F_NOREPLAY);
 
@@ -10926,7 +13028,8 @@ mapnotify(xcb_map_notify_event_t *e)
 
 	DNPRINTF(SWM_D_EVENT, "win %#x\n", e->window);
 
-	if ((win = manage_window(e->window, spawn_position, false)) == NULL)
+	if ((win = manage_window(e->window, spawn_position, false,
+	    NULL)) == NULL)
 		goto out;
 	ws = win->ws;
 
@@ -10984,7 +13087,7 @@ maprequest(xcb_map_request_event_t *e)
 
 	DNPRINTF(SWM_D_EVENT, "win %#x\n", e->window);
 
-	win = manage_window(e->window, spawn_position, true);
+	win = manage_window(e->window, spawn_position, true, NULL);
 	if (win == NULL)
 		goto out;
 
@@ -10997,14 +13100,9 @@ maprequest(xcb_map_request_event_t *e)
 				if (w == win || !w->mapped)
 					continue;
 
-				if (w->ch.class_name &&
-				    win->ch.class_name &&
-				    strcmp(w->ch.class_name,
-				    win->ch.class_name) == 0 &&
-				    w->ch.instance_name &&
-				    win->ch.instance_name &&
-				    strcmp(w->ch.instance_name,
-				    win->ch.instance_name) == 0)
+				/* Interned: equal strings, equal pointers. */
+				if (w->class && w->class == win->class &&
+				    w->instance && w->instance == win->instance)
 					break;
 			}
 		}
@@ -11120,12 +13218,17 @@ propertynotify(xcb_property_notify_event_t *e)
 				}
 			}
 		}
-	} else if (e->atom == XCB_ATOM_WM_CLASS ||
-	    e->atom == XCB_ATOM_WM_NAME) {
+	} else if (e->atom == XCB_ATOM_WM_CLASS) {
+		update_win_class(win, NULL);
+		if (ws->r)
+			bar_draw(ws->r->bar);
+	} else if (e->atom == XCB_ATOM_WM_NAME ||
+	    e->atom == ewmh[_NET_WM_NAME].atom) {
+		update_win_name(win, NULL);
 		if (ws->r)
 			bar_draw(ws->r->bar);
 	} else if (e->atom == a_prot) {
-		get_wm_protocols(win);
+		get_wm_protocols(win, NULL);
 	} else if (e->atom == XCB_ATOM_WM_NORMAL_HINTS) {
 		xcb_icccm_get_wm_normal_hints_reply(conn,
 		    xcb_icccm_get_wm_normal_hints(conn, win->id),
@@ -11559,62 +13662,119 @@ new_region(struct swm_screen *s, int x, int y, int w, int h)
 	xcb_map_window(conn, r->id);
 }
 
+/* Add a wanted region; like new_region(), it replaces any it overlaps. */
+void
+scan_randr_add(struct swm_output *out, int *n, int x, int y, int w, int h,
+    uint32_t rrid)
+{
+	int			i, j;
+
+	for (i = j = 0; i < *n; i++)
+		if (!(out[i].g.x < x + w && out[i].g.x + out[i].g.w > x &&
+		    out[i].g.y < y + h && out[i].g.y + out[i].g.h > y))
+			out[j++] = out[i];
+	*n = j;
+
+	out[*n].g.x = x;
+	out[*n].g.y = y;
+	out[*n].g.w = w;
+	out[*n].g.h = h;
+	out[*n].rrid = rrid;
+	out[*n].r = NULL;
+	(*n)++;
+}
+
+/*
+ * Bring the regions of a screen in line with its monitors, or its CRTCs
+ * before RandR 1.5.  A region whose geometry is unchanged is left alone, a
+ * monitor or CRTC that moved or changed mode keeps its region and bar, and
+ * only what is left over is destroyed or created.  Regions that are new or
+ * resized are marked stack_pending.
+ */
 void
 scan_randr(int idx)
 {
 #ifdef SWM_XRR_HAS_CRTC
 	int						c;
 	int						ncrtc = 0;
-#endif /* SWM_XRR_HAS_CRTC */
-	struct swm_region				*r;
-	int						num_screens;
 	xcb_randr_get_screen_resources_current_cookie_t	src;
-	xcb_randr_get_screen_resources_current_reply_t	*srr;
-	xcb_randr_get_crtc_info_cookie_t		cic;
+	xcb_randr_get_screen_resources_current_reply_t	*srr = NULL;
+	xcb_randr_get_crtc_info_cookie_t		*cic;
 	xcb_randr_get_crtc_info_reply_t			*cir = NULL;
 	xcb_randr_crtc_t				*crtc;
+#endif /* SWM_XRR_HAS_CRTC */
+#ifdef SWM_XRR_HAS_MONITORS
+	xcb_randr_get_monitors_cookie_t			gmc;
+	xcb_randr_get_monitors_reply_t			*gmr;
+	xcb_randr_monitor_info_iterator_t		mi;
+#endif /* SWM_XRR_HAS_MONITORS */
+	struct swm_screen				*s;
+	struct swm_region				*r;
+	struct swm_output				*out = NULL;
+	int						num_screens, i;
+	int						nout = 0;
+	uint32_t					wa[4];
+	uint64_t					start, rtt_start;
 	xcb_screen_t					*screen;
 
 	DNPRINTF(SWM_D_MISC, "screen: %d\n", idx);
 
+	start = monotonic_usec();
+	rtt_start = stat_rtt;
+
 	if ((screen = get_screen(idx)) == NULL)
 		errx(1, "ERROR: can't get screen %d.", idx);
 
 	num_screens = get_screen_count();
 	if (idx >= num_screens)
 		errx(1, "scan_randr: invalid screen");
-
-	/* remove any old regions */
-	while ((r = TAILQ_FIRST(&screens[idx].rl)) != NULL) {
-		r->ws->old_r = r->ws->r = NULL;
-		bar_cleanup(r);
-		xcb_destroy_window(conn, r->id);
-		r->id = XCB_WINDOW_NONE;
-		TAILQ_REMOVE(&screens[idx].rl, r, entry);
-		TAILQ_INSERT_TAIL(&screens[idx].orl, r, entry);
-	}
-	outputs = 0;
+	s = &screens[idx];
+
+#ifdef SWM_XRR_HAS_MONITORS
+	/* One reply covers all monitors; a tiled display is one monitor. */
+	if (randr_monitors) {
+		gmc = xcb_randr_get_monitors(conn, s->root, 1);
+		if ((gmr = xcb_randr_get_monitors_reply(conn, gmc, NULL))) {
+			if ((out = calloc(gmr->nMonitors + 1, sizeof *out)) ==
+			    NULL)
+				err(1, "scan_randr: calloc");
+			mi = xcb_randr_get_monitors_monitors_iterator(gmr);
+			for (; mi.rem; xcb_randr_monitor_info_next(&mi))
+				if (mi.data->width && mi.data->height)
+					scan_randr_add(out, &nout, mi.data->x,
+					    mi.data->y, mi.data->width,
+					    mi.data->height, mi.data->name);
+			free(gmr);
+		}
+		if (nout == 0) {
+			free(out);
+			out = NULL;
+		}
+	}
+#endif /* SWM_XRR_HAS_MONITORS */
 
 	/* map virtual screens onto physical screens */
 #ifdef SWM_XRR_HAS_CRTC
-	if (randr_support) {
-		src = xcb_randr_get_screen_resources_current(conn,
-		    screens[idx].root);
+	if (out == NULL && randr_support) {
+		src = xcb_randr_get_screen_resources_current(conn, s->root);
 		srr = xcb_randr_get_screen_resources_current_reply(conn, src,
 		    NULL);
-		if (srr == NULL) {
-			new_region(&screens[idx], 0, 0,
-			    screen->width_in_pixels,
-			    screen->height_in_pixels);
-			goto out;
-		} else
+		if (srr)
 			ncrtc = srr->num_crtcs;
+	}
+	if (srr) {
+		if ((out = calloc(ncrtc + 1, sizeof *out)) == NULL ||
+		    (cic = calloc(ncrtc + 1, sizeof *cic)) == NULL)
+			err(1, "scan_randr: calloc");
 
+		/* Ask about every CRTC before waiting for the first answer. */
 		crtc = xcb_randr_get_screen_resources_current_crtcs(srr);
-		for (c = 0; c < ncrtc; c++) {
-			cic = xcb_randr_get_crtc_info(conn, crtc[c],
+		for (c = 0; c < ncrtc; c++)
+			cic[c] = xcb_randr_get_crtc_info(conn, crtc[c],
 			    XCB_CURRENT_TIME);
-			cir = xcb_randr_get_crtc_info_reply(conn, cic, NULL);
+
+		for (c = 0; c < ncrtc; c++) {
+			cir = xcb_randr_get_crtc_info_reply(conn, cic[c], NULL);
 			if (cir == NULL)
 				continue;
 			if (cir->num_outputs == 0) {
@@ -11623,30 +13783,101 @@ scan_randr(int idx)
 			}
 
 			if (cir->mode == 0)
-				new_region(&screens[idx], 0, 0,
+				scan_randr_add(out, &nout, 0, 0,
 				    screen->width_in_pixels,
-				    screen->height_in_pixels);
+				    screen->height_in_pixels, crtc[c]);
 			else
-				new_region(&screens[idx],
-				    cir->x, cir->y, cir->width, cir->height);
+				scan_randr_add(out, &nout, cir->x, cir->y,
+				    cir->width, cir->height, crtc[c]);
 			free(cir);
 		}
+		free(cic);
 		free(srr);
 	}
 #endif /* SWM_XRR_HAS_CRTC */
 
+	if (out == NULL && (out = calloc(1, sizeof *out)) == NULL)
+		err(1, "scan_randr: calloc");
+
 	/* If detection failed, create a single region that spans the screen. */
-	if (TAILQ_EMPTY(&screens[idx].rl))
-		new_region(&screens[idx], 0, 0, screen->width_in_pixels,
-		    screen->height_in_pixels);
+	if (nout == 0)
+		scan_randr_add(out, &nout, 0, 0, screen->width_in_pixels,
+		    screen->height_in_pixels, 0);
+
+	/* Regions with the same geometry stay as they are. */
+	for (i = 0; i < nout; i++)
+		TAILQ_FOREACH(r, &s->rl, entry)
+			if (X(r) == out[i].g.x && Y(r) == out[i].g.y &&
+			    WIDTH(r) == out[i].g.w && HEIGHT(r) == out[i].g.h) {
+				TAILQ_REMOVE(&s->rl, r, entry);
+				r->rrid = out[i].rrid;
+				out[i].r = r;
+				break;
+			}
+
+	/* A monitor or CRTC that changed keeps its region and bar. */
+	for (i = 0; i < nout; i++) {
+		if (out[i].r != NULL || out[i].rrid == 0)
+			continue;
+		TAILQ_FOREACH(r, &s->rl, entry)
+			if (r->rrid == out[i].rrid)
+				break;
+		if (r == NULL)
+			continue;
+		TAILQ_REMOVE(&s->rl, r, entry);
+		out[i].r = r;
+
+		DNPRINTF(SWM_D_MISC, "rrid %#x: %dx%d+%d+%d -> %dx%d+%d+%d\n",
+		    r->rrid, WIDTH(r), HEIGHT(r), X(r), Y(r), out[i].g.w,
+		    out[i].g.h, out[i].g.x, out[i].g.y);
+
+		r->g = out[i].g;
+		wa[0] = X(r);
+		wa[1] = Y(r);
+		wa[2] = WIDTH(r);
+		wa[3] = HEIGHT(r);
+		xcb_configure_window(conn, r->id, XCB_CONFIG_WINDOW_X |
+		    XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH |
+		    XCB_CONFIG_WINDOW_HEIGHT, wa);
+		bar_resize(r);
+		r->stack_pending = true;
+	}
+
+	/* remove any old regions */
+	while ((r = TAILQ_FIRST(&s->rl)) != NULL) {
+		r->ws->old_r = r->ws->r = NULL;
+		bar_cleanup(r);
+		xcb_destroy_window(conn, r->id);
+		r->id = XCB_WINDOW_NONE;
+		r->rrid = 0;
+		TAILQ_REMOVE(&s->rl, r, entry);
+		TAILQ_INSERT_TAIL(&s->orl, r, entry);
+	}
+
+	/* Create the missing regions, then list them all in RandR order. */
+	for (i = 0; i < nout; i++) {
+		if (out[i].r != NULL)
+			continue;
+		new_region(s, out[i].g.x, out[i].g.y, out[i].g.w, out[i].g.h);
+		r = TAILQ_LAST(&s->rl, swm_region_list);
+		TAILQ_REMOVE(&s->rl, r, entry);
+		r->rrid = out[i].rrid;
+		r->stack_pending = true;
+		out[i].r = r;
+	}
+	for (i = 0; i < nout; i++)
+		TAILQ_INSERT_TAIL(&s->rl, out[i].r, entry);
+	outputs = nout;
+	free(out);
 
-out:
 	/* The screen shouldn't focus on unused regions. */
-	TAILQ_FOREACH(r, &screens[idx].orl, entry) {
-		if (screens[idx].r_focus == r)
-			screens[idx].r_focus = NULL;
+	TAILQ_FOREACH(r, &s->orl, entry) {
+		if (s->r_focus == r)
+			s->r_focus = NULL;
 	}
 
+	stat_record(&stat_funcs[SWM_STAT_SCAN_RANDR], SWM_TRACE_FUNC,
+	    SWM_STAT_SCAN_RANDR, start, rtt_start);
 	DNPRINTF(SWM_D_MISC, "done.\n");
 }
 
@@ -11657,9 +13888,13 @@ screenchange(xcb_randr_screen_change_notify_event_t *e)
 	struct workspace		*ws;
 	struct ws_win			*win;
 	int				i, j, num_screens;
+	uint64_t			start, rtt_start;
 
 	DNPRINTF(SWM_D_EVENT, "root: %#x\n", e->root);
 
+	start = monotonic_usec();
+	rtt_start = stat_rtt;
+
 	num_screens = get_screen_count();
 	/* silly event doesn't include the screen index */
 	for (i = 0; i < num_screens; i++)
@@ -11668,19 +13903,19 @@ screenchange(xcb_randr_screen_change_notify_event_t *e)
 	if (i >= num_screens)
 		errx(1, "screenchange: screen not found");
 
-	/* brute force for now, just re-enumerate the regions */
 	scan_randr(i);
 
 #ifdef SWM_DEBUG
 	print_win_geom(e->root);
 #endif
-	/* add bars to all regions */
+	/* New regions need a bar; the others kept theirs. */
 	TAILQ_FOREACH(r, &screens[i].rl, entry)
 		bar_setup(r);
 
-	/* Stack all regions. */
+	/* Only new or resized regions need a relayout. */
 	TAILQ_FOREACH(r, &screens[i].rl, entry)
-		stack(r);
+		if (r->stack_pending)
+			stack(r);
 
 	/* Make sure a region has focus. */
 	if (screens[i].r_focus == NULL) {
@@ -11706,10 +13941,509 @@ screenchange(xcb_randr_screen_change_notify_event_t *e)
 		r->ws->state = SWM_WS_STATE_MAPPED;
 		bar_draw(r->bar);
 	}
+
+	stat_record(&stat_funcs[SWM_STAT_SCREENCHANGE], SWM_TRACE_FUNC,
+	    SWM_STAT_SCREENCHANGE, start, rtt_start);
 }
 
+/*
+ * Tag this X server with _SWM_SESSION on the first root, unless an earlier
+ * instance already did, so that session_file is only restored on the server
+ * it was written for.
+ */
 void
-grab_windows(void)
+session_init(void)
+{
+	xcb_get_property_reply_t	*pr;
+
+	pr = xcb_get_property_reply(conn, xcb_get_property(conn, 0,
+	    screens[0].root, a_swm_session, XCB_ATOM_CARDINAL, 0, 1), NULL);
+	if (pr && pr->format == 32 && xcb_get_property_value_length(pr) ==
+	    sizeof session_id)
+		memcpy(&session_id, xcb_get_property_value(pr),
+		    sizeof session_id);
+	free(pr);
+
+	if (session_id == 0) {
+		session_id = (uint32_t)time(NULL) ^ (uint32_t)getpid() << 16 ^
+		    (uint32_t)monotonic_usec();
+		if (session_id == 0)
+			session_id = 1;
+		xcb_change_property(conn, XCB_PROP_MODE_REPLACE,
+		    screens[0].root, a_swm_session, XCB_ATOM_CARDINAL, 32, 1,
+		    &session_id);
+	}
+
+	DNPRINTF(SWM_D_INIT, "session %#x\n", session_id);
+}
+
+/* Note a change to the model; session_write() picks it up later. */
+void
+session_touch(void)
+{
+	if (session_file && session_due == 0 && running)
+		session_due = monotonic_usec() + SWM_SESSION_DELAY;
+}
+
+/* Milliseconds the main loop may sleep, at most 1000. */
+int
+session_timeout(void)
+{
+	uint64_t		now;
+
+	if (session_due == 0)
+		return (1000);
+	now = monotonic_usec();
+	if (now >= session_due)
+		return (0);
+	return (MIN(1000, (session_due - now + 999) / 1000));
+}
+
+/* Replace session_file with the current model, if it changed a while ago. */
+void
+session_write(void)
+{
+	FILE			*f;
+	char			*buf, *tmp;
+	size_t			size;
+
+	/* After quit() the file is gone for good. */
+	if (!running || session_due == 0 || monotonic_usec() < session_due)
+		return;
+	session_due = 0;
+	if (session_file == NULL)
+		return;
+
+	if ((buf = state_build(&size)) == NULL)
+		return;
+	if (asprintf(&tmp, "%s.tmp", session_file) == -1) {
+		warn("session_write: asprintf");
+		free(buf);
+		return;
+	}
+
+	if ((f = fopen(tmp, "w")) == NULL) {
+		warn("session_file: %s", tmp);
+		goto out;
+	}
+	if (fwrite(buf, 1, size, f) != size) {
+		warn("session_file: %s", tmp);
+		fclose(f);
+		unlink(tmp);
+		goto out;
+	}
+	if (fclose(f) == EOF || rename(tmp, session_file) == -1) {
+		warn("session_file: %s", session_file);
+		unlink(tmp);
+		goto out;
+	}
+	DNPRINTF(SWM_D_MISC, "wrote %s, %zu bytes\n", session_file, size);
+out:
+	free(tmp);
+	free(buf);
+}
+
+/* Serialize the model; returns a malloc'd buffer of *size bytes. */
+char *
+state_build(size_t *size)
+{
+	struct swm_state_hdr	hdr;
+	struct swm_state_ws	*sws;
+	struct swm_state_region	*srg;
+	struct swm_state_win	*swn, *first;
+	struct workspace	*ws;
+	struct swm_region	*r;
+	struct ws_win		*w;
+	char			*buf;
+	int			i, j, k, n, num_screens;
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, SWM_STATE_MAGIC, sizeof hdr.magic);
+	hdr.version = SWM_STATE_VERSION;
+	hdr.session = session_id;
+
+	num_screens = get_screen_count();
+	for (i = 0; i < num_screens; i++) {
+		hdr.nws += workspace_limit;
+		TAILQ_FOREACH(r, &screens[i].rl, entry)
+			hdr.nregions++;
+		for (j = 0; j < workspace_limit; j++)
+			TAILQ_FOREACH(w, &screens[i].ws[j].winlist, entry)
+				hdr.nwins++;
+	}
+
+	*size = sizeof hdr + hdr.nws * sizeof *sws +
+	    hdr.nregions * sizeof *srg + hdr.nwins * sizeof *swn;
+	if ((buf = calloc(1, *size)) == NULL) {
+		warn("state_build: calloc");
+		return (NULL);
+	}
+	memcpy(buf, &hdr, sizeof hdr);
+	sws = (struct swm_state_ws *)(buf + sizeof hdr);
+	srg = (struct swm_state_region *)(sws + hdr.nws);
+	swn = (struct swm_state_win *)(srg + hdr.nregions);
+
+	for (i = 0; i < num_screens; i++) {
+		TAILQ_FOREACH(r, &screens[i].rl, entry) {
+			srg->screen = i;
+			srg->g = r->g;
+			srg->ws = r->ws->idx;
+			srg->ws_prior = r->ws_prior ? r->ws_prior->idx : -1;
+			srg->focused = (screens[i].r_focus == r);
+			srg++;
+		}
+		for (j = 0; j < workspace_limit; j++) {
+			ws = &screens[i].ws[j];
+			sws->screen = i;
+			sws->idx = j;
+			sws->layout = ws->cur_layout - layouts;
+			sws->focus = WINID(ws->focus);
+			sws->focus_prev = WINID(ws->focus_prev);
+			sws->msize[0] = ws->l_state.vertical_msize;
+			sws->msize[1] = ws->l_state.horizontal_msize;
+			sws->mwin[0] = ws->l_state.vertical_mwin;
+			sws->mwin[1] = ws->l_state.horizontal_mwin;
+			sws->stacks[0] = ws->l_state.vertical_stacks;
+			sws->stacks[1] = ws->l_state.horizontal_stacks;
+			sws->flip[0] = ws->l_state.vertical_flip;
+			sws->flip[1] = ws->l_state.horizontal_flip;
+			sws->always_raise = ws->always_raise;
+			sws->bar_enabled = ws->bar_enabled;
+			if (ws->name)
+				strlcpy(sws->name, ws->name, sizeof sws->name);
+			sws++;
+
+			first = swn;
+			TAILQ_FOREACH(w, &ws->winlist, entry) {
+				swn->id = w->id;
+				swn->screen = i;
+				swn->ws = j;
+				swn->g_float = w->g_float;
+				swn->g_floatvalid = w->g_floatvalid;
+				swn++;
+			}
+			n = 0;
+			TAILQ_FOREACH(w, &ws->stack, stack_entry) {
+				for (k = 0; first + k < swn; k++)
+					if (first[k].id == w->id)
+						first[k].stack_pos = n;
+				n++;
+			}
+		}
+	}
+
+	DNPRINTF(SWM_D_INIT, "%u workspaces, %u regions, %u windows\n",
+	    hdr.nws, hdr.nregions, hdr.nwins);
+
+	return (buf);
+}
+
+/* Snapshot the model into a sealed memfd for the process restart() execs. */
+void
+state_save(void)
+{
+#if defined(__linux__) && defined(MFD_ALLOW_SEALING)
+	char			*buf, env[16];
+	size_t			size, off;
+	ssize_t			len;
+	int			fd;
+
+	if ((buf = state_build(&size)) == NULL)
+		return;
+
+	if ((fd = memfd_create("spectrwm-state", MFD_ALLOW_SEALING)) == -1) {
+		warn("state_save: memfd_create");
+		free(buf);
+		return;
+	}
+	for (off = 0; off < size; off += len)
+		if ((len = write(fd, buf + off, size - off)) <= 0) {
+			warn("state_save: write");
+			close(fd);
+			free(buf);
+			return;
+		}
+	free(buf);
+
+	/* The new process only ever reads it. */
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+	    F_SEAL_WRITE | F_SEAL_SEAL) == -1)
+		warn("state_save: F_ADD_SEALS");
+
+	snprintf(env, sizeof env, "%d", fd);
+	setenv("SWM_STATE_FD", env, 1);
+
+	DNPRINTF(SWM_D_INIT, "fd %d\n", fd);
+#endif
+}
+
+/* Read and check a snapshot.  Returns 0 if state_buf now holds one. */
+int
+state_read(int fd)
+{
+	struct stat		sb;
+	size_t			size, off;
+	ssize_t			len;
+
+	if (fstat(fd, &sb) == -1 || sb.st_size < (off_t)sizeof *state_hdr)
+		return (-1);
+	size = sb.st_size;
+	if ((state_buf = malloc(size)) == NULL) {
+		warn("state_read: malloc");
+		return (-1);
+	}
+	for (off = 0; off < size; off += len)
+		if ((len = pread(fd, state_buf + off, size - off, off)) <= 0) {
+			warn("state_read: read");
+			state_free();
+			return (-1);
+		}
+
+	state_hdr = (struct swm_state_hdr *)state_buf;
+	if (memcmp(state_hdr->magic, SWM_STATE_MAGIC,
+	    sizeof state_hdr->magic) || state_hdr->version !=
+	    SWM_STATE_VERSION || size != sizeof *state_hdr +
+	    (size_t)state_hdr->nws * sizeof *state_ws +
+	    (size_t)state_hdr->nregions * sizeof *state_regions +
+	    (size_t)state_hdr->nwins * sizeof *state_wins) {
+		warnx("state_read: ignoring incompatible snapshot");
+		state_free();
+		return (-1);
+	}
+	state_ws = (struct swm_state_ws *)(state_hdr + 1);
+	state_regions = (struct swm_state_region *)(state_ws +
+	    state_hdr->nws);
+	state_wins = (struct swm_state_win *)(state_regions +
+	    state_hdr->nregions);
+
+	DNPRINTF(SWM_D_INIT, "%u workspaces, %u regions, %u windows\n",
+	    state_hdr->nws, state_hdr->nregions, state_hdr->nwins);
+
+	return (0);
+}
+
+/*
+ * Pick up the snapshot state_save() left behind in the process we replace or,
+ * without one, what session_file had of an instance that died on this same X
+ * server.
+ */
+void
+state_load(void)
+{
+	const char		*env, *errstr;
+	int			fd;
+
+	if ((env = getenv("SWM_STATE_FD")) != NULL) {
+		fd = strtonum(env, 0, INT_MAX, &errstr);
+		unsetenv("SWM_STATE_FD");
+		if (errstr)
+			return;
+#if defined(__linux__) && defined(F_GET_SEALS)
+		if ((fcntl(fd, F_GET_SEALS) & F_SEAL_WRITE) == 0) {
+			warnx("state_load: fd %d is not a sealed snapshot", fd);
+			close(fd);
+			return;
+		}
+#endif
+		state_read(fd);
+		close(fd);
+		return;
+	}
+
+	if (session_file == NULL ||
+	    (fd = open(session_file, O_RDONLY)) == -1)
+		return;
+	if (state_read(fd) == 0 && state_hdr->session != session_id) {
+		DNPRINTF(SWM_D_INIT, "%s is from another X server\n",
+		    session_file);
+		state_free();
+	}
+	close(fd);
+}
+
+void
+state_free(void)
+{
+	free(state_buf);
+	state_buf = NULL;
+	state_hdr = NULL;
+	state_ws = NULL;
+	state_regions = NULL;
+	state_wins = NULL;
+}
+
+/* Workspace settings and what each region showed, before windows come in. */
+void
+state_restore(void)
+{
+	struct swm_state_ws	*sws;
+	struct swm_state_region	*srg;
+	struct workspace	*ws, *old_ws;
+	struct swm_region	*r = NULL;
+	uint32_t		i;
+	int			num_screens, s = -1, n = 0;
+
+	if (state_buf == NULL)
+		return;
+
+	num_screens = get_screen_count();
+	for (i = 0; i < state_hdr->nws; i++) {
+		sws = &state_ws[i];
+		if (sws->screen < 0 || sws->screen >= num_screens ||
+		    sws->idx < 0 || sws->idx >= workspace_limit)
+			continue;
+		ws = &screens[sws->screen].ws[sws->idx];
+
+		if (sws->layout >= 0 && sws->layout < LENGTH(layouts) - 1)
+			ws->cur_layout = &layouts[sws->layout];
+		ws->l_state.vertical_msize = sws->msize[0];
+		ws->l_state.horizontal_msize = sws->msize[1];
+		ws->l_state.vertical_mwin = sws->mwin[0];
+		ws->l_state.horizontal_mwin = sws->mwin[1];
+		ws->l_state.vertical_stacks = sws->stacks[0];
+		ws->l_state.horizontal_stacks = sws->stacks[1];
+		ws->l_state.vertical_flip = sws->flip[0];
+		ws->l_state.horizontal_flip = sws->flip[1];
+		ws->cur_layout->l_string(ws);
+		ws->always_raise = sws->always_raise;
+		ws->bar_enabled = sws->bar_enabled;
+
+		free(ws->name);
+		ws->name = NULL;
+		sws->name[SWM_STATE_NAMELEN - 1] = '\0';
+		if (sws->name[0] && (ws->name = strdup(sws->name)) == NULL)
+			err(1, "state_restore: strdup");
+	}
+
+	/* Regions are matched by position in the list and geometry. */
+	for (i = 0; i < state_hdr->nregions; i++) {
+		srg = &state_regions[i];
+		if (srg->screen < 0 || srg->screen >= num_screens)
+			continue;
+		if (srg->screen != s) {
+			s = srg->screen;
+			r = TAILQ_FIRST(&screens[s].rl);
+			n = 0;
+		} else if (r)
+			r = TAILQ_NEXT(r, entry);
+		if (r == NULL || memcmp(&r->g, &srg->g, sizeof r->g)) {
+			n++;
+			continue;
+		}
+
+		if (srg->ws >= 0 && srg->ws < workspace_limit &&
+		    (ws = &screens[s].ws[srg->ws]) != r->ws) {
+			/* Trade workspaces with whichever region has it. */
+			old_ws = r->ws;
+			if (ws->r) {
+				ws->r->ws = old_ws;
+				old_ws->r = ws->r;
+			} else {
+				old_ws->r = NULL;
+				old_ws->state = SWM_WS_STATE_HIDDEN;
+			}
+			r->ws = ws;
+			ws->r = r;
+			if (ws->state == SWM_WS_STATE_HIDDEN)
+				ws->state = SWM_WS_STATE_MAPPING;
+		}
+		if (srg->ws_prior >= 0 && srg->ws_prior < workspace_limit)
+			r->ws_prior = &screens[s].ws[srg->ws_prior];
+		if (srg->focused && s == 0)
+			state_focus = n;
+		n++;
+	}
+
+	ewmh_update_desktop_names();
+	ewmh_update_current_desktop();
+}
+
+int
+state_win_cmp(const void *a, const void *b)
+{
+	const struct swm_state_win	*wa = *(struct swm_state_win **)a;
+	const struct swm_state_win	*wb = *(struct swm_state_win **)b;
+
+	if (wa->ws != wb->ws)
+		return (wa->ws < wb->ws ? -1 : 1);
+	return (wa->stack_pos < wb->stack_pos ? -1 :
+	    wa->stack_pos > wb->stack_pos);
+}
+
+/*
+ * Manage the snapshot's windows on screen i in their old winlist order, then
+ * put back float geometry, stacking order and focus history.  Everything
+ * manage_window() asks about the windows is requested in one batch up front
+ * and handed to it, so adopting them waits on the server about once rather
+ * than a dozen times per window.
+ */
+void
+state_adopt(int i)
+{
+	struct swm_prefetch			*pf;
+	struct swm_state_win			*swn, **order;
+	struct swm_state_ws			*sws;
+	struct workspace			*ws;
+	struct ws_win				*win;
+	uint32_t				j, n = 0;
+
+	if (state_buf == NULL || state_hdr->nwins == 0)
+		return;
+
+	if ((pf = calloc(state_hdr->nwins, sizeof *pf)) == NULL ||
+	    (order = calloc(state_hdr->nwins, sizeof *order)) == NULL)
+		err(1, "state_adopt: calloc");
+
+	for (j = 0; j < state_hdr->nwins; j++) {
+		swn = &state_wins[j];
+		if (swn->screen != i)
+			continue;
+		pf[j].attributes = xcb_get_window_attributes(conn, swn->id);
+		pf[j].wm_state = xcb_get_property(conn, 0, swn->id, a_state,
+		    a_state, 0L, 2L);
+		prefetch_window(swn->id, &pf[j]);
+	}
+
+	for (j = 0; j < state_hdr->nwins; j++) {
+		swn = &state_wins[j];
+		if (swn->screen != i)
+			continue;
+
+		if ((win = manage_window(swn->id, SWM_STACK_TOP, false,
+		    &pf[j])) == NULL || win->ws->idx != swn->ws)
+			continue;
+		win->g_float = swn->g_float;
+		win->g_floatvalid = swn->g_floatvalid;
+		order[n++] = swn;
+	}
+
+	qsort(order, n, sizeof *order, state_win_cmp);
+	for (j = 0; j < n; j++) {
+		win = find_window(order[j]->id);
+		TAILQ_REMOVE(&win->ws->stack, win, stack_entry);
+		TAILQ_INSERT_TAIL(&win->ws->stack, win, stack_entry);
+	}
+
+	for (j = 0; j < state_hdr->nws; j++) {
+		sws = &state_ws[j];
+		if (sws->screen != i || sws->idx < 0 ||
+		    sws->idx >= workspace_limit)
+			continue;
+		ws = &screens[i].ws[sws->idx];
+		if ((win = find_window(sws->focus)) && win->ws == ws)
+			ws->focus = win;
+		if ((win = find_window(sws->focus_prev)) && win->ws == ws)
+			ws->focus_prev = win;
+	}
+
+	DNPRINTF(SWM_D_INIT, "screen %d: adopted %u windows\n", i, n);
+
+	free(order);
+	free(pf);
+}
+
+void
+grab_windows(void)
 {
 	struct swm_region		*r = NULL;
 	xcb_query_tree_cookie_t		qtc;
@@ -11722,6 +14456,9 @@ grab_windows(void)
 	DNPRINTF(SWM_D_INIT, "begin\n");
 	num_screens = get_screen_count();
 	for (i = 0; i < num_screens; i++) {
+		/* Windows handed over by a restart first, in their old order. */
+		state_adopt(i);
+
 		qtc = xcb_query_tree(conn, screens[i].root);
 		qtr = xcb_query_tree_reply(conn, qtc, NULL);
 		if (qtr == NULL)
@@ -11767,7 +14504,7 @@ grab_windows(void)
 				}
 			}
 
-			if (r)
+			if (r || find_window(wins[j]))
 				continue;
 
 			pc = xcb_icccm_get_wm_transient_for(conn, wins[j]);
@@ -11778,15 +14515,19 @@ grab_windows(void)
 				continue;
 			}
 
-			manage_window(wins[j], SWM_STACK_TOP, false);
+			manage_window(wins[j], SWM_STACK_TOP, false,
+			    NULL);
 		}
 
 		DNPRINTF(SWM_D_INIT, "grab transient windows\n");
 		for (j = 0; j < no; j++) {
+			if (find_window(wins[j]))
+				continue;
 			pc = xcb_icccm_get_wm_transient_for(conn, wins[j]);
 			if (xcb_icccm_get_wm_transient_for_reply(conn, pc,
 			    &trans, NULL))
-				manage_window(wins[j], SWM_STACK_TOP, false);
+				manage_window(wins[j], SWM_STACK_TOP, false,
+				    NULL);
 		}
 		free(qtr);
 	}
@@ -11811,15 +14552,25 @@ setup_screens(void)
 
 	/* Initial RandR setup. */
 	randr_support = false;
+	randr_monitors = false;
 	qep = xcb_get_extension_data(conn, &xcb_randr_id);
 	if (qep->present) {
+#ifdef SWM_XRR_HAS_MONITORS
+		c = xcb_randr_query_version(conn, 1, 5);
+#else
 		c = xcb_randr_query_version(conn, 1, 1);
+#endif
 		r = xcb_randr_query_version_reply(conn, c, NULL);
 		if (r) {
 			if (r->major_version >= 1) {
 				randr_support = true;
 				randr_eventbase = qep->first_event;
 			}
+#ifdef SWM_XRR_HAS_MONITORS
+			if (r->major_version > 1 || (r->major_version == 1 &&
+			    r->minor_version >= 5))
+				randr_monitors = true;
+#endif
 			free(r);
 		}
 	}
@@ -11899,6 +14650,10 @@ setup_screens(void)
 void
 setup_globals(void)
 {
+	const xcb_query_extension_reply_t	*qep;
+	xcb_res_query_version_cookie_t		c;
+	xcb_res_query_version_reply_t		*r;
+
 	if ((bar_fonts = strdup(SWM_BAR_FONTS)) == NULL)
 		err(1, "setup_globals: strdup: failed to allocate memory.");
 
@@ -11917,6 +14672,23 @@ setup_globals(void)
 	a_takefocus = get_atom_from_string("WM_TAKE_FOCUS");
 	a_utf8_string = get_atom_from_string("UTF8_STRING");
 	a_swm_ws = get_atom_from_string("_SWM_WS");
+	a_swm_session = get_atom_from_string("_SWM_SESSION");
+	a_swm_pid = get_atom_from_string("_SWM_PID");
+	a_net_wm_pid = get_atom_from_string("_NET_WM_PID");
+
+	/* Client pid lookup for windows without _NET_WM_PID needs XRes 1.2. */
+	xres_support = false;
+	qep = xcb_get_extension_data(conn, &xcb_res_id);
+	if (qep->present) {
+		c = xcb_res_query_version(conn, 1, 2);
+		r = xcb_res_query_version_reply(conn, c, NULL);
+		if (r) {
+			if (r->server_major > 1 ||
+			    (r->server_major == 1 && r->server_minor >= 2))
+				xres_support = true;
+			free(r);
+		}
+	}
 }
 
 void
@@ -11933,13 +14705,22 @@ shutdown_cleanup(void)
 		err(1, "can't disable alarm");
 
 	bar_extra_stop();
+	ctl_cleanup();
+	rec_close();
 	unmap_all();
 
 	cursors_cleanup();
 
 	clear_quirks();
+	quirk_matcher_free(quirk_matcher);
+	quirk_matcher = NULL;
 	clear_spawns();
 	clear_bindings();
+	key_table_clear();
+	free(key_grabs);
+	key_grabs = NULL;
+	key_grabs_len = 0;
+	clear_pids();
 
 	teardown_ewmh();
 
@@ -11984,13 +14765,13 @@ shutdown_cleanup(void)
 		/* Free region memory. */
 		while ((r = TAILQ_FIRST(&screens[i].rl)) != NULL) {
 			TAILQ_REMOVE(&screens[i].rl, r, entry);
-			free(r->bar);
+			mem_free(r->bar);
 			free(r);
 		}
 
 		while ((r = TAILQ_FIRST(&screens[i].orl)) != NULL) {
 			TAILQ_REMOVE(&screens[i].rl, r, entry);
-			free(r->bar);
+			mem_free(r->bar);
 			free(r);
 		}
 	}
@@ -12012,6 +14793,686 @@ shutdown_cleanup(void)
 	xcb_disconnect(conn);
 }
 
+/*
+ * Control socket.  Clients send one command per line: the name of an action
+ * from actions[] or of a spawn program, optionally "spawn_custom <name>".  A
+ * number after a name picks the numbered action, so "ws 3" is "ws_3".
+ * Lines between "begin" and "commit" form a batch that is validated up front
+ * and then run with the server grabbed, restacking and flushing only once.
+ * Every command is answered on one line: "ok <action> ws=<n> rg=<n> win=<id>"
+ * with the state it left behind, or "err <command>: <reason>".
+ */
+void
+ctl_setup(void)
+{
+	struct sockaddr_un	sun;
+	struct stat		sb;
+	mode_t			old_umask;
+
+	if (ctl_path == NULL)
+		return;
+
+	memset(&sun, 0, sizeof sun);
+	sun.sun_family = AF_UNIX;
+	if (strlcpy(sun.sun_path, ctl_path, sizeof sun.sun_path) >=
+	    sizeof sun.sun_path) {
+		add_startup_exception("control_socket: path too long: %s",
+		    ctl_path);
+		return;
+	}
+
+	/* Remove a stale socket left behind by a previous instance. */
+	if (lstat(ctl_path, &sb) == 0 && S_ISSOCK(sb.st_mode))
+		unlink(ctl_path);
+
+	if ((ctl_fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		warn("ctl_setup: socket");
+		return;
+	}
+
+	old_umask = umask(S_IRWXG | S_IRWXO);
+	if (bind(ctl_fd, (struct sockaddr *)&sun, sizeof sun) == -1) {
+		add_startup_exception("control_socket: unable to bind %s: %s",
+		    ctl_path, strerror(errno));
+		umask(old_umask);
+		close(ctl_fd);
+		ctl_fd = -1;
+		return;
+	}
+	umask(old_umask);
+
+	if (listen(ctl_fd, SWM_CTL_CLIENTS_MAX) == -1) {
+		warn("ctl_setup: listen");
+		ctl_cleanup();
+		return;
+	}
+
+	socket_setnonblock(ctl_fd);
+	fcntl(ctl_fd, F_SETFD, FD_CLOEXEC);
+
+	/* A client that goes away must not take us down with it. */
+	if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
+		err(1, "could not disable SIGPIPE");
+
+	setenv("SWM_CONTROL_SOCKET", ctl_path, 1);
+
+	DNPRINTF(SWM_D_MISC, "listening on %s\n", ctl_path);
+}
+
+void
+ctl_cleanup(void)
+{
+	int			i;
+
+	for (i = 0; i < SWM_CTL_CLIENTS_MAX; i++)
+		if (ctl_clients[i])
+			ctl_close(ctl_clients[i]);
+
+	if (ctl_fd != -1) {
+		close(ctl_fd);
+		ctl_fd = -1;
+		unlink(ctl_path);
+	}
+}
+
+void
+ctl_close(struct ctl_client *c)
+{
+	int			i;
+
+	for (i = 0; i < SWM_CTL_CLIENTS_MAX; i++)
+		if (ctl_clients[i] == c)
+			ctl_clients[i] = NULL;
+
+	for (i = 0; i < c->ncmds; i++)
+		free(c->cmds[i].spawn_name);
+
+	close(c->fd);
+	free(c);
+}
+
+void
+ctl_accept(void)
+{
+	struct ctl_client	*c;
+	int			fd, i;
+
+	if ((fd = accept(ctl_fd, NULL, NULL)) == -1) {
+		if (errno != EAGAIN && errno != EINTR)
+			warn("ctl_accept: accept");
+		return;
+	}
+
+	for (i = 0; i < SWM_CTL_CLIENTS_MAX; i++)
+		if (ctl_clients[i] == NULL)
+			break;
+	if (i == SWM_CTL_CLIENTS_MAX) {
+		DNPRINTF(SWM_D_MISC, "too many clients\n");
+		close(fd);
+		return;
+	}
+
+	if ((c = calloc(1, sizeof *c)) == NULL) {
+		warn("ctl_accept: calloc");
+		close(fd);
+		return;
+	}
+
+	socket_setnonblock(fd);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	c->fd = fd;
+	ctl_clients[i] = c;
+}
+
+void
+ctl_reply(struct ctl_client *c, const char *fmt, ...)
+{
+	va_list			ap;
+	char			buf[SWM_CTL_BUFLEN];
+	int			len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof buf - 1, fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return;
+	if ((size_t)len > sizeof buf - 2)
+		len = sizeof buf - 2;
+	buf[len++] = '\n';
+
+	/* Replies are small; a client that does not read them is dropped. */
+	if (write(c->fd, buf, len) != len)
+		c->len = SIZE_MAX;
+}
+
+/* Resolve line into cmd.  Returns 0 on success, otherwise sets errstr. */
+int
+ctl_parse(char *line, struct ctl_cmd *cmd, const char **errstr)
+{
+	struct spawn_prog	*sp;
+	char			*name, *arg, numbered[SWM_FUNCNAME_LEN];
+	int			aid;
+
+	name = strsep(&line, " \t");
+	arg = line;
+	while (arg && (*arg == ' ' || *arg == '\t'))
+		arg++;
+
+	memset(cmd, 0, sizeof *cmd);
+	cmd->action = FN_INVALID;
+
+	if (strcasecmp(name, actions[FN_SPAWN_CUSTOM].name) == 0) {
+		if (arg == NULL || *arg == '\0') {
+			*errstr = "missing spawn name";
+			return (1);
+		}
+		name = arg;
+		arg = NULL;
+	} else {
+		/* A number picks the numbered action: "ws 3" is "ws_3". */
+		if (arg && *arg != '\0' &&
+		    strspn(arg, "0123456789") == strlen(arg) &&
+		    snprintf(numbered, sizeof numbered, "%s_%s", name, arg) <
+		    (int)sizeof numbered) {
+			name = numbered;
+			arg = NULL;
+		}
+		for (aid = 0; aid < FN_INVALID; aid++)
+			if (strcasecmp(name, actions[aid].name) == 0)
+				break;
+		cmd->action = aid;
+	}
+
+	if (cmd->action == FN_INVALID) {
+		if ((sp = spawn_find(name)) == NULL) {
+			*errstr = "unknown action";
+			return (1);
+		}
+		cmd->action = FN_SPAWN_CUSTOM;
+		if ((cmd->spawn_name = strdup(sp->name)) == NULL)
+			err(1, "ctl_parse: strdup");
+	}
+
+	if (arg && *arg != '\0') {
+		*errstr = "unexpected argument";
+		goto fail;
+	}
+	if (actions[cmd->action].flags & FN_F_NOCTL) {
+		*errstr = "interactive action";
+		goto fail;
+	}
+	if (((int)cmd->action > FN_WS_1 + workspace_limit - 1 &&
+	    cmd->action <= FN_WS_22) ||
+	    ((int)cmd->action > FN_MVWS_1 + workspace_limit - 1 &&
+	    cmd->action <= FN_MVWS_22)) {
+		*errstr = "workspace out of range";
+		goto fail;
+	}
+
+	return (0);
+fail:
+	free(cmd->spawn_name);
+	cmd->spawn_name = NULL;
+	return (1);
+}
+
+/* Run n parsed commands; more than one makes an atomic batch. */
+void
+ctl_run(struct ctl_cmd *cmds, int n)
+{
+	struct binding		b;
+	struct action		*ap;
+	struct swm_region	*r;
+	uint64_t		start, rtt_start;
+	int			i, num_screens;
+
+	if (n > 1) {
+		xcb_grab_server(conn);
+		ctl_batch = true;
+	}
+
+	for (i = 0; i < n && running; i++) {
+		ap = &actions[cmds[i].action];
+
+		/* Act like a key binding without the key. */
+		memset(&b, 0, sizeof b);
+		b.type = KEYBIND;
+		b.value = XCB_NO_SYMBOL;
+		b.action = cmds[i].action;
+		b.spawn_name = cmds[i].spawn_name;
+
+		start = monotonic_usec();
+		rtt_start = stat_rtt;
+		r = root_to_region(screens[0].root, SWM_CK_ALL);
+		if (cmds[i].action == FN_SPAWN_CUSTOM)
+			spawn_custom(r, &ap->args, cmds[i].spawn_name);
+		else if (ap->func)
+			ap->func(&b, r, &ap->args);
+		stat_record(&stat_actions[b.action], SWM_TRACE_ACTION,
+		    b.action, start, rtt_start);
+	}
+
+	if (ctl_batch) {
+		ctl_batch = false;
+		num_screens = get_screen_count();
+		for (i = 0; i < num_screens; i++)
+			TAILQ_FOREACH(r, &screens[i].rl, entry)
+				if (r->stack_pending) {
+					r->stack_pending = false;
+					stack(r);
+				}
+		xcb_ungrab_server(conn);
+		focus_flush();
+	}
+
+	xcb_flush(conn);
+}
+
+void
+ctl_command(struct ctl_client *c, char *line)
+{
+	struct ctl_cmd		cmd, *cp;
+	const char		*errstr = NULL;
+	char			state[64];
+	int			i;
+
+	while (*line == ' ' || *line == '\t')
+		line++;
+	if (*line == '\0' || *line == '#')
+		return;
+
+	DNPRINTF(SWM_D_MISC, "fd %d: %s\n", c->fd, line);
+
+	if (strcasecmp(line, "begin") == 0) {
+		if (c->batch)
+			ctl_reply(c, "err begin: batch already open");
+		else {
+			c->batch = true;
+			c->batch_failed = false;
+			ctl_reply(c, "ok begin");
+		}
+		return;
+	}
+
+	if (strcasecmp(line, "stats") == 0) {
+		ctl_stats(c);
+		return;
+	}
+
+	if (strcasecmp(line, "commit") == 0 || strcasecmp(line, "abort") == 0) {
+		if (!c->batch) {
+			ctl_reply(c, "err %s: no batch open", line);
+			return;
+		}
+		if (strcasecmp(line, "abort") == 0)
+			ctl_reply(c, "ok abort %d", c->ncmds);
+		else if (c->batch_failed)
+			ctl_reply(c, "err commit: batch contains errors, "
+			    "nothing done");
+		else {
+			ctl_run(c->cmds, c->ncmds);
+			ctl_state(state, sizeof state);
+			ctl_reply(c, "ok commit %d %s", c->ncmds, state);
+		}
+		for (i = 0; i < c->ncmds; i++)
+			free(c->cmds[i].spawn_name);
+		c->ncmds = 0;
+		c->batch = false;
+		return;
+	}
+
+	if (c->batch && c->ncmds == SWM_CTL_BATCH_MAX) {
+		c->batch_failed = true;
+		ctl_reply(c, "err %s: batch too large", line);
+		return;
+	}
+
+	cp = c->batch ? &c->cmds[c->ncmds] : &cmd;
+	if (ctl_parse(line, cp, &errstr)) {
+		if (c->batch)
+			c->batch_failed = true;
+		ctl_reply(c, "err %s: %s", line, errstr);
+		return;
+	}
+
+	if (c->batch) {
+		c->ncmds++;
+		ctl_reply(c, "ok %s queued", actions[cp->action].name);
+	} else {
+		ctl_run(&cmd, 1);
+		free(cmd.spawn_name);
+		ctl_state(state, sizeof state);
+		ctl_reply(c, "ok %s %s", actions[cmd.action].name, state);
+	}
+}
+
+/* Workspace, region and focused window after a command, as key=value. */
+void
+ctl_state(char *buf, size_t len)
+{
+	struct swm_region	*r;
+	struct ws_win		*win;
+
+	r = root_to_region(screens[0].root, SWM_CK_ALL);
+	win = r->ws->focus;
+	snprintf(buf, len, "ws=%d rg=%d win=%#x", r->ws->idx + 1,
+	    get_region_index(r) + 1, win ? win->id : XCB_WINDOW_NONE);
+}
+
+/* Answer "stats" with the stats_write() text, then "ok stats". */
+void
+ctl_stats(struct ctl_client *c)
+{
+	FILE			*f;
+	char			*buf = NULL;
+	size_t			size = 0;
+
+	if ((f = open_memstream(&buf, &size)) == NULL) {
+		ctl_reply(c, "err stats: %s", strerror(errno));
+		return;
+	}
+	stats_write(f);
+	fclose(f);
+
+	if (write(c->fd, buf, size) != (ssize_t)size)
+		c->len = SIZE_MAX;
+	else
+		ctl_reply(c, "ok stats");
+	free(buf);
+}
+
+void
+ctl_read(struct ctl_client *c)
+{
+	ssize_t			n;
+	char			*line, *nl;
+
+	n = read(c->fd, c->buf + c->len, sizeof c->buf - c->len - 1);
+	if (n == -1 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if (n <= 0) {
+		ctl_close(c);
+		return;
+	}
+	c->len += n;
+	c->buf[c->len] = '\0';
+
+	line = c->buf;
+	while ((nl = strchr(line, '\n')) != NULL) {
+		*nl = '\0';
+		if (nl > line && nl[-1] == '\r')
+			nl[-1] = '\0';
+		ctl_command(c, line);
+		if (c->len == SIZE_MAX || !running) {
+			/* Write failed or we are going away. */
+			ctl_close(c);
+			return;
+		}
+		line = nl + 1;
+	}
+
+	c->len -= line - c->buf;
+	memmove(c->buf, line, c->len);
+	if (c->len == sizeof c->buf - 1) {
+		ctl_reply(c, "err line too long");
+		ctl_close(c);
+	}
+}
+
+/* Fill the SWM_CTL_CLIENTS_MAX + 1 control slots of the poll set. */
+void
+ctl_pollfds(struct pollfd *pfd)
+{
+	int			i;
+
+	pfd[0].fd = ctl_fd;
+	pfd[0].events = POLLIN;
+	for (i = 0; i < SWM_CTL_CLIENTS_MAX; i++) {
+		pfd[i + 1].fd = ctl_clients[i] ? ctl_clients[i]->fd : -1;
+		pfd[i + 1].events = POLLIN;
+	}
+}
+
+void
+ctl_check(struct pollfd *pfd)
+{
+	int			i;
+
+	for (i = 0; i < SWM_CTL_CLIENTS_MAX; i++)
+		if (ctl_clients[i] && ctl_clients[i]->fd == pfd[i + 1].fd &&
+		    pfd[i + 1].revents & (POLLIN | POLLHUP | POLLERR))
+			ctl_read(ctl_clients[i]);
+
+	if (ctl_fd != -1 && pfd[0].revents & POLLIN)
+		ctl_accept();
+}
+
+/* Start a new recording; the previous one, if any, is kept as <path>.1. */
+void
+rec_open(void)
+{
+	struct swm_rec_header	hdr;
+	char			*old;
+	int			i;
+
+	if (rec_path == NULL)
+		return;
+
+	if (access(rec_path, F_OK) == 0) {
+		if (asprintf(&old, "%s.1", rec_path) == -1)
+			err(1, "rec_open: asprintf");
+		if (rename(rec_path, old) == -1)
+			warn("event_record: rename %s", rec_path);
+		free(old);
+	}
+
+	if ((rec_file = fopen(rec_path, "w")) == NULL) {
+		warn("event_record: %s", rec_path);
+		return;
+	}
+	fcntl(fileno(rec_file), F_SETFD, FD_CLOEXEC);
+
+	memset(&hdr, 0, sizeof hdr);
+	strlcpy(hdr.magic, SWM_REC_MAGIC, sizeof hdr.magic);
+	hdr.version = SWM_REC_VERSION;
+	hdr.rec_size = sizeof(struct swm_rec);
+	hdr.start = monotonic_usec();
+	hdr.wall = time(NULL);
+	fwrite(&hdr, sizeof hdr, 1, rec_file);
+	rec_written = sizeof hdr;
+
+	/* Window indices start over in every file. */
+	free(rec_wins);
+	rec_wins_size = 1024;
+	rec_nwins = 0;
+	if ((rec_wins = calloc(rec_wins_size, sizeof *rec_wins)) == NULL)
+		err(1, "rec_open: calloc");
+
+	for (i = 0; i < SWM_EWMH_HINT_MAX; i++)
+		rec_atom(ewmh[i].atom, ewmh[i].name);
+	rec_atom(a_state, "WM_STATE");
+	rec_atom(a_prot, "WM_PROTOCOLS");
+	rec_atom(a_delete, "WM_DELETE_WINDOW");
+	rec_atom(a_takefocus, "WM_TAKE_FOCUS");
+	rec_atom(a_net_frame_extents, "_NET_FRAME_EXTENTS");
+	rec_atom(a_net_wm_pid, "_NET_WM_PID");
+	rec_atom(a_swm_ws, "_SWM_WS");
+	rec_atom(a_swm_pid, "_SWM_PID");
+	rec_dirty = true;
+}
+
+void
+rec_close(void)
+{
+	if (rec_file == NULL)
+		return;
+
+	fclose(rec_file);
+	rec_file = NULL;
+	rec_dirty = false;
+	free(rec_wins);
+	rec_wins = NULL;
+}
+
+/* Called before the main loop sleeps. */
+void
+rec_flush(void)
+{
+	if (rec_dirty) {
+		fflush(rec_file);
+		rec_dirty = false;
+	}
+}
+
+void
+rec_atom(xcb_atom_t atom, const char *name)
+{
+	struct swm_rec		rec;
+	char			pad[sizeof rec];
+	size_t			len;
+
+	if (rec_file == NULL || atom == XCB_ATOM_NONE)
+		return;
+
+	len = strlen(name);
+	memset(&rec, 0, sizeof rec);
+	rec.type = SWM_REC_ATOM;
+	rec.atom = atom;
+	rec.rtt = len;
+	fwrite(&rec, sizeof rec, 1, rec_file);
+	fwrite(name, len, 1, rec_file);
+	memset(pad, 0, sizeof pad);
+	fwrite(pad, sizeof pad - len % sizeof pad, 1, rec_file);
+	rec_written += sizeof rec + len + sizeof pad - len % sizeof pad;
+}
+
+/* Stable index of a window within the current recording. */
+uint32_t
+rec_win(xcb_window_t id)
+{
+	struct swm_rec_win	*old;
+	uint32_t		i, n, old_size;
+
+	if (id == XCB_WINDOW_NONE)
+		return (0);
+
+	for (i = id & (rec_wins_size - 1); rec_wins[i].id;
+	    i = (i + 1) & (rec_wins_size - 1))
+		if (rec_wins[i].id == id)
+			return (rec_wins[i].idx);
+
+	/* Keep the table at most half full. */
+	if (++rec_nwins > rec_wins_size / 2) {
+		old = rec_wins;
+		old_size = rec_wins_size;
+		rec_wins_size *= 2;
+		if ((rec_wins = calloc(rec_wins_size, sizeof *rec_wins)) ==
+		    NULL)
+			err(1, "rec_win: calloc");
+		for (n = 0; n < old_size; n++) {
+			if (old[n].id == 0)
+				continue;
+			for (i = old[n].id & (rec_wins_size - 1); rec_wins[i].id;
+			    i = (i + 1) & (rec_wins_size - 1))
+				;
+			rec_wins[i] = old[n];
+		}
+		free(old);
+		for (i = id & (rec_wins_size - 1); rec_wins[i].id;
+		    i = (i + 1) & (rec_wins_size - 1))
+			;
+	}
+
+	rec_wins[i].id = id;
+	rec_wins[i].idx = rec_nwins;
+	return (rec_nwins);
+}
+
+void
+rec_event(xcb_generic_event_t *evt, uint8_t type, uint64_t start,
+    uint64_t rtt_start)
+{
+	struct swm_rec		rec;
+	xcb_window_t		win = XCB_WINDOW_NONE;
+	uint64_t		usec;
+
+	if (rec_file == NULL)
+		return;
+
+	memset(&rec, 0, sizeof rec);
+	switch (type) {
+	case XCB_KEY_PRESS:
+	case XCB_KEY_RELEASE:
+	case XCB_BUTTON_PRESS:
+	case XCB_BUTTON_RELEASE:
+	case XCB_MOTION_NOTIFY:
+		win = ((xcb_key_press_event_t *)evt)->event;
+		break;
+	case XCB_ENTER_NOTIFY:
+	case XCB_LEAVE_NOTIFY:
+		win = ((xcb_enter_notify_event_t *)evt)->event;
+		break;
+	case XCB_FOCUS_IN:
+	case XCB_FOCUS_OUT:
+		win = ((xcb_focus_in_event_t *)evt)->event;
+		break;
+	case XCB_EXPOSE:
+		win = ((xcb_expose_event_t *)evt)->window;
+		break;
+	case XCB_CREATE_NOTIFY:
+		win = ((xcb_create_notify_event_t *)evt)->window;
+		break;
+	case XCB_DESTROY_NOTIFY:
+		win = ((xcb_destroy_notify_event_t *)evt)->window;
+		break;
+	case XCB_UNMAP_NOTIFY:
+		win = ((xcb_unmap_notify_event_t *)evt)->window;
+		break;
+	case XCB_MAP_NOTIFY:
+		win = ((xcb_map_notify_event_t *)evt)->window;
+		break;
+	case XCB_MAP_REQUEST:
+		win = ((xcb_map_request_event_t *)evt)->window;
+		break;
+	case XCB_REPARENT_NOTIFY:
+		win = ((xcb_reparent_notify_event_t *)evt)->window;
+		break;
+	case XCB_CONFIGURE_NOTIFY:
+		win = ((xcb_configure_notify_event_t *)evt)->window;
+		break;
+	case XCB_CONFIGURE_REQUEST:
+		win = ((xcb_configure_request_event_t *)evt)->window;
+		break;
+	case XCB_PROPERTY_NOTIFY:
+		win = ((xcb_property_notify_event_t *)evt)->window;
+		rec.atom = ((xcb_property_notify_event_t *)evt)->atom;
+		break;
+	case XCB_CLIENT_MESSAGE:
+		win = ((xcb_client_message_event_t *)evt)->window;
+		rec.atom = ((xcb_client_message_event_t *)evt)->type;
+		break;
+	}
+
+	usec = monotonic_usec() - start;
+	rec.start = start;
+	rec.usec = usec > UINT32_MAX ? UINT32_MAX : usec;
+	rec.rtt = stat_rtt - rtt_start > UINT16_MAX ? UINT16_MAX :
+	    stat_rtt - rtt_start;
+	rec.win = rec_win(win);
+	rec.type = type;
+	if (evt->response_type & 0x80)
+		rec.flags |= SWM_REC_F_SENT;
+
+	fwrite(&rec, sizeof rec, 1, rec_file);
+	rec_dirty = true;
+	rec_written += sizeof rec;
+
+	if (rec_written >= rec_limit) {
+		rec_close();
+		rec_open();
+	}
+}
+
 void
 event_error(xcb_generic_error_t *e)
 {
@@ -12028,13 +15489,18 @@ void
 event_handle(xcb_generic_event_t *evt)
 {
 	uint8_t			type = XCB_EVENT_RESPONSE_TYPE(evt);
+	uint64_t		start, rtt_start;
+
+	start = monotonic_usec();
+	rtt_start = stat_rtt;
+	SWM_PROBE1(event_start, type);
 
 	DNPRINTF(SWM_D_EVENT, "%s(%d), seq %u\n",
 	    xcb_event_get_label(XCB_EVENT_RESPONSE_TYPE(evt)),
 	    XCB_EVENT_RESPONSE_TYPE(evt), evt->sequence);
 
 	switch (type) {
-#define EVENT(type, callback) case type: callback((void *)evt); return
+#define EVENT(type, callback) case type: callback((void *)evt); break
 	EVENT(0, event_error);
 	EVENT(XCB_BUTTON_PRESS, buttonpress);
 	EVENT(XCB_BUTTON_RELEASE, buttonrelease);
@@ -12074,15 +15540,21 @@ event_handle(xcb_generic_event_t *evt)
 	EVENT(XCB_UNMAP_NOTIFY, unmapnotify);
 	/*EVENT(XCB_VISIBILITY_NOTIFY, );*/
 #undef EVENT
+	default:
+		if (type - randr_eventbase == XCB_RANDR_SCREEN_CHANGE_NOTIFY)
+			screenchange((void *)evt);
 	}
-	if (type - randr_eventbase == XCB_RANDR_SCREEN_CHANGE_NOTIFY)
-		screenchange((void *)evt);
+
+	stat_record(&stat_events[type < SWM_STAT_EVENTS ? type :
+	    SWM_STAT_EVENTS], SWM_TRACE_EVENT, type, start, rtt_start);
+	rec_event(evt, type, start, rtt_start);
+	SWM_PROBE2(event_done, type, stat_rtt - rtt_start);
 }
 
 int
 main(int argc, char *argv[])
 {
-	struct pollfd		pfd[2];
+	struct pollfd		*pfd = NULL;
 	struct sigaction	sact;
 	struct stat		sb;
 	struct passwd		*pwd;
@@ -12090,6 +15562,8 @@ main(int argc, char *argv[])
 	xcb_generic_event_t	*evt;
 	xcb_mapping_notify_event_t *mne;
 	int			xfd, i, num_screens, num_readable;
+	int			npfd, pfd_size = 0;
+	uint64_t		poll_start;
 	char			conf[PATH_MAX], *cfile = NULL;
 	bool			stdin_ready = false, startup = true;
 
@@ -12101,6 +15575,7 @@ main(int argc, char *argv[])
 #endif
 
 	start_argv = argv;
+	phase_begin();
 	warnx("Welcome to spectrwm V%s Build: %s", SPECTRWM_VERSION, buildstr);
 	if (setlocale(LC_CTYPE, "") == NULL || setlocale(LC_TIME, "") == NULL)
 		warnx("no locale support");
@@ -12114,6 +15589,7 @@ main(int argc, char *argv[])
 	sigaction(SIGQUIT, &sact, NULL);
 	sigaction(SIGTERM, &sact, NULL);
 	sigaction(SIGHUP, &sact, NULL);
+	sigaction(SIGUSR1, &sact, NULL);
 
 	sact.sa_handler = sighdlr;
 	sact.sa_flags = SA_NOCLDSTOP;
@@ -12129,15 +15605,19 @@ main(int argc, char *argv[])
 	XSetEventQueueOwner(display, XCBOwnsEventQueue);
 
 	xcb_prefetch_extension_data(conn, &xcb_randr_id);
+	xcb_prefetch_extension_data(conn, &xcb_res_id);
 	xfd = xcb_get_file_descriptor(conn);
+	phase_mark("XOpenDisplay");
 
 	/* look for local and global conf file */
 	pwd = getpwuid(getuid());
 	if (pwd == NULL)
 		errx(1, "invalid user: %d", getuid());
 
+	grab_begin = monotonic_usec();
 	xcb_grab_server(conn);
 	xcb_aux_sync(conn);
+	phase_mark("grab_server");
 
 	/* Flush the event queue. */
 	while ((evt = get_next_event(false))) {
@@ -12160,19 +15640,27 @@ main(int argc, char *argv[])
 
 	if (enable_wm())
 		errx(1, "another window manager is currently running");
+	phase_mark("enable_wm");
 
 	/* Load Xcursors and/or cursorfont glyph cursors. */
 	cursors_load();
 
 	xcb_aux_sync(conn);
+	phase_mark("cursors_load");
 
 	setup_globals();
+	phase_mark("setup_globals");
 	setup_screens();
+	phase_mark("setup_screens");
 	setup_ewmh();
+	phase_mark("setup_ewmh");
 	setup_keybindings();
 	setup_btnbindings();
+	phase_mark("setup_keybindings");
 	setup_quirks();
 	setup_spawn();
+	setup_pids();
+	phase_mark("setup_quirks");
 
 	/* load config */
 	for (i = 0; ; i++) {
@@ -12211,10 +15699,25 @@ main(int argc, char *argv[])
 noconfig:
 
 	/* load conf (if any) */
-	if (cfile)
+	if (cfile) {
 		conf_load(cfile, SWM_CONF_DEFAULT);
+		if ((conf_path = strdup(cfile)) == NULL)
+			err(1, "strdup");
+	}
 
 	validate_spawns();
+	ctl_setup();
+	rec_open();
+	phase_mark("conf_load");
+
+	/*
+	 * Pick up where the process restart() replaced or one that crashed left
+	 * off.
+	 */
+	session_init();
+	state_load();
+	state_restore();
+	phase_mark("state_restore");
 
 	if (getenv("SWM_STARTED") == NULL)
 		setenv("SWM_STARTED", "YES", 1);
@@ -12222,22 +15725,30 @@ noconfig:
 	/* setup all bars */
 	num_screens = get_screen_count();
 	for (i = 0; i < num_screens; i++)
-		TAILQ_FOREACH(r, &screens[i].rl, entry)
+		TAILQ_FOREACH(r, &screens[i].rl, entry) {
 			bar_setup(r);
+			phase_mark("bar_setup");
+		}
 
 	/* Manage existing windows. */
 	grab_windows();
+	state_free();
+	phase_mark("grab_windows");
 
 	grabkeys();
+	phase_mark("grabkeys");
 	grabbuttons();
+	phase_mark("grabbuttons");
 
 	/* Stack all regions to trigger mapping. */
 	for (i = 0; i < num_screens; i++)
 		TAILQ_FOREACH(r, &screens[i].rl, entry)
 			stack(r);
+	phase_mark("stack");
 
 	xcb_ungrab_server(conn);
 	xcb_flush(conn);
+	grab_usec = monotonic_usec() - grab_begin;
 
 	/* Update state and bar of each newly mapped workspace. */
 	for (i = 0; i < num_screens; i++)
@@ -12245,12 +15756,7 @@ noconfig:
 			r->ws->state = SWM_WS_STATE_MAPPED;
 			bar_draw(r->bar);
 		}
-
-	memset(&pfd, 0, sizeof(pfd));
-	pfd[0].fd = xfd;
-	pfd[0].events = POLLIN;
-	pfd[1].fd = STDIN_FILENO;
-	pfd[1].events = POLLIN;
+	phase_mark("bar_draw");
 
 	while (running) {
 		while ((evt = get_next_event(false))) {
@@ -12267,27 +15773,58 @@ noconfig:
 			if (focus_mode == SWM_FOCUS_FOLLOW)
 				r = root_to_region(screens[0].root,
 				    SWM_CK_POINTER);
-			else
-				r = TAILQ_FIRST(&screens[0].rl);
+			else {
+				/* The region focused before a restart. */
+				i = 0;
+				TAILQ_FOREACH(r, &screens[0].rl, entry)
+					if (i++ == state_focus)
+						break;
+				if (r == NULL)
+					r = TAILQ_FIRST(&screens[0].rl);
+			}
+			state_focus = -1;
 
 			if (r) {
 				focus_region(r);
 				focus_flush();
-				continue;
 			}
+			phase_mark("focus");
+			phase_write();
+			if (r)
+				continue;
 		}
 
 		if (search_resp)
 			search_do_resp();
 
-		num_readable = poll(pfd, bar_extra ? 2 : 1, 1000);
+		/* X connection, bar_action script, control socket, children. */
+		npfd = pid_pollfds(&pfd, &pfd_size, SWM_POLL_PIDFD);
+		pfd[SWM_POLL_X].fd = xfd;
+		pfd[SWM_POLL_X].events = POLLIN;
+		pfd[SWM_POLL_STDIN].fd = bar_extra ? STDIN_FILENO : -1;
+		pfd[SWM_POLL_STDIN].events = POLLIN;
+		ctl_pollfds(pfd + SWM_POLL_CTL);
+		rec_flush();
+
+		poll_start = monotonic_usec();
+		num_readable = poll(pfd, npfd, session_timeout());
+		stat_poll_usec += monotonic_usec() - poll_start;
 		if (num_readable == -1) {
 			DNPRINTF(SWM_D_MISC, "poll failed: %s",
 			    strerror(errno));
-		} else if (num_readable > 0 && bar_extra &&
-		    pfd[1].revents & POLLIN) {
-			stdin_ready = true;
+		} else if (num_readable > 0) {
+			if (bar_extra && pfd[SWM_POLL_STDIN].revents & POLLIN)
+				stdin_ready = true;
+			ctl_check(pfd + SWM_POLL_CTL);
+			pid_pollfds_check(pfd + SWM_POLL_PIDFD,
+			    npfd - SWM_POLL_PIDFD);
 		}
+		pid_expire();
+
+		if (stats_dump_pending)
+			stats_dump();
+
+		session_write();
 
 		if (restart_wm)
 			restart(NULL, NULL, NULL);
@@ -12309,6 +15846,7 @@ noconfig:
 	}
 done:
 	shutdown_cleanup();
+	free(pfd);
 
 	return (0);
 }